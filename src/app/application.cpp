@@ -60,16 +60,14 @@ bool Application::initialize()
   int attempt = 0;
   bool retry;
   std::string path = config_->path().toLocal8Bit().data();
+  std::string cachePath = saveLocation("partcache/").toLocal8Bit().data();
   
   do {
     retry = false;
     
     // try to load LDraw part library
     try {
-      if (path.empty())
-        library_ = new ldraw::part_library;
-      else
-        library_ = new ldraw::part_library(path);
+      library_ = new ldraw::part_library(path, cachePath);
     } catch (const ldraw::exception &) {
       QMessageBox *alert =
           new QMessageBox(QMessageBox::Critical,
@@ -89,7 +87,7 @@ bool Application::initialize()
         // Last attempt
         if (!config_->path().isEmpty()) {
           try {
-            library_ = new ldraw::part_library;
+            library_ = new ldraw::part_library(std::string(), cachePath);
           } catch (...) {
             return false;
           }
@@ -112,6 +110,9 @@ bool Application::initialize()
     config_->writeConfig();
   }
   
+  library_->set_residency_policy(ldraw::part_library::header_residency);
+  connect(qApp, SIGNAL(applicationStateChanged(Qt::ApplicationState)), this, SLOT(refreshLibrary(Qt::ApplicationState)));
+  
   params_ = new ldraw_renderer::parameters();
   params_->set_shading(true);
   params_->set_shader(false);
@@ -221,4 +222,12 @@ void Application::configUpdated()
   }
 }
 
+// Parts installed while the window was in the background are linkable once
+// it comes back; the directory watch makes this free when nothing changed.
+void Application::refreshLibrary(Qt::ApplicationState state)
+{
+  if (state == Qt::ApplicationActive && library_)
+    library_->refresh();
+}
+
 }
@@ -9,6 +9,7 @@
 #include <QObject>
 #include <QProcess>
 #include <QString>
+#include <Qt>
 
 #include "config.h"
 
@@ -73,6 +74,9 @@ class Application : public QObject
 
  public slots:
   void configUpdated();
+  
+ private slots:
+  void refreshLibrary(Qt::ApplicationState state);
                       
  private:
   static Application *instance_;
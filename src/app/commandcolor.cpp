@@ -29,16 +29,25 @@ CommandColor::~CommandColor()
 void CommandColor::redo()
 {
   for (QSet<int>::ConstIterator it = selection_.constBegin(); it != selection_.constEnd(); ++it) {
-    if (model_->elements()[*it]->capabilities() & ldraw::capability_color)
+    if (model_->elements()[*it]->capabilities() & ldraw::capability_color) {
       dynamic_cast<ldraw::element_colored_base *>(model_->elements()[*it])->set_color(color_);
+      
+      // references tell the model themselves
+      if (model_->elements()[*it]->get_type() != ldraw::type_ref)
+        model_->element_changed(*it);
+    }
   }
 }
 
 void CommandColor::undo()
 {
   for (QSet<int>::ConstIterator it = selection_.constBegin(); it != selection_.constEnd(); ++it) {
-    if (model_->elements()[*it]->capabilities() & ldraw::capability_color)
+    if (model_->elements()[*it]->capabilities() & ldraw::capability_color) {
       dynamic_cast<ldraw::element_colored_base *>(model_->elements()[*it])->set_color(oldcolors_[*it]);
+      
+      if (model_->elements()[*it]->get_type() != ldraw::type_ref)
+        model_->element_changed(*it);
+    }
   }
 }
 
@@ -117,8 +117,9 @@ void CommandTransform::redo()
 void CommandTransform::undo()
 {
   for (QSet<int>::ConstIterator it = selection_.constBegin(); it != selection_.constEnd(); ++it) {
-    if (model_->elements()[*it]->get_type() == ldraw::type_ref)
+    if (model_->elements()[*it]->get_type() == ldraw::type_ref) {
       CAST_AS_REF(model_->elements()[*it])->set_matrix(oldmatrices_[*it]);
+    }
   }
 }
 
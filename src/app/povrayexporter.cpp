@@ -298,10 +298,11 @@ void POVRayExporter::fillPartsRecursive(const ldraw::model_multipart *main, cons
       } else if ((*it)->get_type() == ldraw::type_ref) {
         ldraw::element_ref *elem = CAST_AS_REF(*it);
         
-        ldraw::matrix om = elem->get_matrix();
-        if (ldraw::utils::is_singular_matrix(om))
+        if (elem->is_singular())
           continue;
         
+        ldraw::matrix om = elem->get_matrix();
+        
         if (!elem->get_model() || blacklist.find(elem->get_model()) != blacklist.end())
           continue;
 	
@@ -484,7 +484,6 @@ ldraw::vector RenderWidget::unproject(const QPoint &position, const ldraw::matri
   GLdouble modelviewCoerced[16];
   GLint viewport[4];
   GLdouble x, y, z;
-  GLfloat depth;
 
   ldraw::matrix modelViewInv = modelView.transpose();
   
@@ -499,8 +498,6 @@ ldraw::vector RenderWidget::unproject(const QPoint &position, const ldraw::matri
   
   glGetIntegerv(GL_VIEWPORT, viewport);
 
-  glReadPixels(position.x(), viewport[3] - position.y(), 1, 1, GL_DEPTH_COMPONENT, GL_FLOAT, &depth);
-
   gluUnProject(position.x(), viewport[3] - position.y(), 0.1,
                modelviewCoerced, projectionCoerced, viewport,
                &x, &y, &z);
@@ -510,76 +507,63 @@ ldraw::vector RenderWidget::unproject(const QPoint &position, const ldraw::matri
   return ldraw::vector(x, -y, -z);
 }
 
+// Projects the axes of the anchor (7 pixels wide on screen) and picks the
+// one closest to (x, y), without a trip through GL_SELECT.
 RenderWidget::AnchorMode RenderWidget::anchorHitTest(int x, int y)
 {
-  GLint hits, viewport[4];
-  GLuint selectionBuffer[20];
+  static const float axes[3][6] = {
+    {-10.0f, 0.0f, 0.0f, 10.0f, 0.0f, 0.0f},
+    {0.0f, -10.0f, 0.0f, 0.0f, 10.0f, 0.0f},
+    {0.0f, 0.0f, -10.0f, 0.0f, 0.0f, 10.0f}
+  };
+  static const AnchorMode modes[3] = {AxisX, AxisY, AxisZ};
 
-  glPushAttrib(GL_LINE_BIT);
-  glLineWidth(7.0f);
+  ldraw::matrix projection(projectionMatrix_);
+  ldraw::matrix m = projection.transpose() * (anchor_ * 3.0f);
 
-  glSelectBuffer(5, selectionBuffer);
-  glRenderMode(GL_SELECT);
+  AnchorMode result = AxisNone;
+  float nearest = 6.0f;
 
-  glGetIntegerv(GL_VIEWPORT, viewport);
+  for (int i = 0; i < 3; ++i) {
+    float s[2][2];
+    bool visible = true;
 
-  glMatrixMode(GL_PROJECTION);
-  glPushMatrix();
-  glLoadIdentity();
-  gluPickMatrix(x - 3, viewport[3] - (y - 3), 6, 6, viewport);
-  glMultMatrixf(projectionMatrix_);
+    for (int j = 0; j < 2 && visible; ++j) {
+      const float *v = &axes[i][j * 3];
+      float c[4];
 
-  glMatrixMode(GL_MODELVIEW);
-  glLoadIdentity();
-  glMultMatrixf((anchor_ * 3.0f).transpose().get_pointer());
-  
-  glInitNames();
+      for (int r = 0; r < 4; ++r)
+        c[r] = m.value(r, 0) * v[0] + m.value(r, 1) * v[1] + m.value(r, 2) * v[2] + m.value(r, 3);
 
-  glPushName(0);
-  glBegin(GL_LINES);
-  glVertex3f(-10.0f, 0.0f, 0.0f);
-  glVertex3f(10.0f, 0.0f, 0.0f);
-  glEnd();
-  glPopName();
-  
-  glPushName(1);
-  glBegin(GL_LINES);
-  glVertex3f(0.0f, -10.0f, 0.0f);
-  glVertex3f(0.0f, 10.0f, 0.0f);
-  glEnd();
-  glPopName();
+      if (c[3] <= 0.0f)
+        visible = false;
 
-  glPushName(2);
-  glBegin(GL_LINES);
-  glVertex3f(0.0f, 0.0f, -10.0f);
-  glVertex3f(0.0f, 0.0f, 10.0f);
-  glEnd();
-  glPopName();
-
-  hits = glRenderMode(GL_RENDER);
-
-  glPopMatrix();
+      s[j][0] = (c[0] / c[3] + 1.0f) * 0.5f * width_;
+      s[j][1] = (1.0f - c[1] / c[3]) * 0.5f * height_;
+    }
 
-  glMatrixMode(GL_PROJECTION);
-  glPopMatrix();
+    if (!visible)
+      continue;
 
-  glPopAttrib();
+    float dx = s[1][0] - s[0][0];
+    float dy = s[1][1] - s[0][1];
+    float len2 = dx * dx + dy * dy;
+    float t = 0.0f;
 
-  if (hits < 0)
-    return AxisNone;
+    if (len2 > 0.0f)
+      t = qBound(0.0f, ((x - s[0][0]) * dx + (y - s[0][1]) * dy) / len2, 1.0f);
 
-  for (int i = 0; i < hits; ++i) {
-    GLuint idx = selectionBuffer[i * 4 + 3];
+    float ex = s[0][0] + t * dx - x;
+    float ey = s[0][1] + t * dy - y;
+    float distance = std::sqrt(ex * ex + ey * ey);
 
-    if (idx == 0)
-      return AxisX;
-    else if (idx == 1)
-      return AxisY;
-    else if (idx == 2)
-      return AxisZ;
+    if (distance < nearest) {
+      nearest = distance;
+      result = modes[i];
+    }
   }
 
-  return AxisNone;
+  return result;
 }
 
 void RenderWidget::renderPointArray() const
@@ -1126,20 +1110,15 @@ void RenderWidget::mouseMoveEvent(QMouseEvent *event)
 
     update();
   } else if (anchorEnabled_) {
-    makeCurrent();
-
     AnchorMode old = anchorHover_;
 
     if ((anchorHover_ = anchorHitTest(
             event->pos().x(),
             event->pos().y())) != AxisNone ||
         old != AxisNone) {
-      doneCurrent();
       update();
       return;
     }
-
-    doneCurrent();
   }
 }
 
@@ -0,0 +1,110 @@
+/* libLDR: Portable and easy-to-use LDraw format abstraction & I/O reference library *
+ * To obtain more information about LDraw, visit http://www.ldraw.org.               *
+ * Distributed in terms of the GNU Lesser General Public License v3                  *
+ *                                                                                   *
+ * Author: (c)2006-2013 Park "segfault" J. K. <mastermind_at_planetmono_dot_org>     */
+
+#include <algorithm>
+#include <cstdlib>
+#include <iterator>
+
+#include "arena.h"
+
+namespace ldraw
+{
+
+namespace
+{
+
+// enough for any element, and for SSE loads of the vectors inside them
+const std::size_t alignment = 16;
+
+// blocks grow with the arena, so that small primitives stay small and large
+// models do not end up with thousands of blocks
+const std::size_t min_block_size = 2048;
+const std::size_t max_block_size = 65536;
+
+}
+
+arena::arena()
+    : m_cursor(0L), m_end(0L), m_capacity(0)
+{
+}
+
+arena::~arena()
+{
+  release();
+}
+
+void* arena::allocate(std::size_t size)
+{
+  size = (size + alignment - 1) & ~(alignment - 1);
+
+  if ((std::size_t)(m_end - m_cursor) < size) {
+    std::size_t bsize = std::max(min_block_size, std::min(max_block_size, m_capacity));
+    bsize = std::max(bsize, size);
+
+    char *p = static_cast<char *>(std::malloc(bsize));
+    if (!p)
+      throw std::bad_alloc();
+
+    block b = { p, p + bsize };
+    m_blocks.insert(std::upper_bound(m_blocks.begin(), m_blocks.end(), b), b);
+
+    m_cursor = p;
+    m_end = p + bsize;
+    m_capacity += bsize;
+  }
+
+  void *r = m_cursor;
+  m_cursor += size;
+
+  return r;
+}
+
+bool arena::owns(const void *p) const
+{
+  const char *c = static_cast<const char *>(p);
+  block b = { const_cast<char *>(c), 0L };
+
+  std::vector<block>::const_iterator it = std::upper_bound(m_blocks.begin(), m_blocks.end(), b);
+  if (it == m_blocks.begin())
+    return false;
+
+  --it;
+  return c >= (*it).begin && c < (*it).end;
+}
+
+void arena::adopt(arena &a)
+{
+  if (&a == this || a.m_blocks.empty())
+    return;
+
+  std::vector<block> merged;
+  merged.reserve(m_blocks.size() + a.m_blocks.size());
+  std::merge(m_blocks.begin(), m_blocks.end(), a.m_blocks.begin(), a.m_blocks.end(), std::back_inserter(merged));
+  m_blocks.swap(merged);
+
+  // keep filling whichever block has more room left
+  if (a.m_end - a.m_cursor > m_end - m_cursor) {
+    m_cursor = a.m_cursor;
+    m_end = a.m_end;
+  }
+  m_capacity += a.m_capacity;
+
+  a.m_blocks.clear();
+  a.m_cursor = a.m_end = 0L;
+  a.m_capacity = 0;
+}
+
+void arena::release()
+{
+  for (std::vector<block>::iterator it = m_blocks.begin(); it != m_blocks.end(); ++it)
+    std::free((*it).begin);
+
+  m_blocks.clear();
+  m_cursor = m_end = 0L;
+  m_capacity = 0;
+}
+
+}
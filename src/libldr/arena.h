@@ -0,0 +1,73 @@
+/* libLDR: Portable and easy-to-use LDraw format abstraction & I/O reference library *
+ * To obtain more information about LDraw, visit http://www.ldraw.org.               *
+ * Distributed in terms of the GNU Lesser General Public License v3                  *
+ *                                                                                   *
+ * Author: (c)2006-2013 Park "segfault" J. K. <mastermind_at_planetmono_dot_org>     */
+
+#ifndef _LIBLDR_ARENA_H_
+#define _LIBLDR_ARENA_H_
+
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "common.h"
+
+namespace ldraw
+{
+
+// Bump allocator for the elements of a model. Objects are carved out of
+// blocks of growing size and neither moved nor freed individually; release()
+// hands all blocks back at once. Destructors are the owner's business.
+class LIBLDR_EXPORT arena
+{
+ public:
+  arena();
+  ~arena();
+
+  void* allocate(std::size_t size);
+  bool owns(const void *p) const;
+
+  // moves every block of a into this arena, leaving a empty
+  void adopt(arena &a);
+  void release();
+
+  std::size_t capacity() const { return m_capacity; }
+
+  template <class T, class... Args> T* create(Args&&... args)
+  {
+    return new (allocate(sizeof(T))) T(std::forward<Args>(args)...);
+  }
+
+ private:
+  arena(const arena &);
+  arena& operator=(const arena &);
+
+  struct block
+  {
+    char *begin;
+    char *end;
+
+    bool operator<(const block &rhs) const { return begin < rhs.begin; }
+  };
+
+  // sorted by address so that owns() can bisect
+  std::vector<block> m_blocks;
+  char *m_cursor;
+  char *m_end;
+  std::size_t m_capacity;
+};
+
+// Constructs T in the arena if there is one, on the heap otherwise.
+template <class T, class... Args> T* arena_new(arena *a, Args&&... args)
+{
+  if (a)
+    return a->create<T>(std::forward<Args>(args)...);
+
+  return new T(std::forward<Args>(args)...);
+}
+
+}
+
+#endif
@@ -0,0 +1,168 @@
+/* libLDR: Portable and easy-to-use LDraw format abstraction & I/O reference library *
+ * To obtain more information about LDraw, visit http://www.ldraw.org.               *
+ * Distributed in terms of the GNU Lesser General Public License v3                  *
+ *                                                                                   *
+ * Author: (c)2006-2013 Park "segfault" J. K. <mastermind_at_planetmono_dot_org>     */
+
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+
+#include "utils.h"
+
+#include "atom.h"
+
+namespace ldraw
+{
+
+namespace
+{
+
+struct atom_entry
+{
+  std::string str;
+  unsigned int folded;
+  bool stud;
+};
+
+/* Entries live in fixed-size chunks that never move, so str() can be read
+ * without locking while other threads (e.g. the part prefetcher) intern new
+ * names. The index is read under a shared lock; only insertion takes it
+ * exclusively. */
+class atom_table
+{
+ public:
+  static const unsigned int chunk_bits = 10;
+  static const unsigned int chunk_size = 1 << chunk_bits;
+  static const unsigned int max_chunks = 1 << 16;
+
+  atom_table() : m_count(0)
+  {
+    for (unsigned int i = 0; i < max_chunks; ++i)
+      m_chunks[i] = 0L;
+
+    // id 0 is the empty string
+    insert(std::string(), 0);
+  }
+
+  static atom_table& instance()
+  {
+    static atom_table table;
+
+    return table;
+  }
+
+  const atom_entry& at(unsigned int id) const { return m_chunks[id >> chunk_bits][id & (chunk_size - 1)]; }
+
+  // 0 if str was never interned
+  unsigned int find(const std::string &str) const
+  {
+    std::shared_lock<std::shared_timed_mutex> lock(m_mutex);
+
+    std::unordered_map<std::string, unsigned int>::const_iterator it = m_index.find(str);
+
+    return it != m_index.end() ? (*it).second : 0;
+  }
+
+  unsigned int intern(const std::string &str)
+  {
+    unsigned int id = find(str);
+    if (id)
+      return id;
+
+    std::lock_guard<std::shared_timed_mutex> lock(m_mutex);
+
+    // another thread may have got there in between
+    std::unordered_map<std::string, unsigned int>::const_iterator it = m_index.find(str);
+    if (it != m_index.end())
+      return (*it).second;
+
+    std::string folded = utils::translate_string(str);
+    if (folded == str)
+      return insert(str, m_count);
+
+    unsigned int fid;
+    it = m_index.find(folded);
+    if (it != m_index.end())
+      fid = (*it).second;
+    else
+      fid = insert(folded, m_count);
+
+    return insert(str, fid);
+  }
+
+ private:
+  // must be called with the mutex held
+  unsigned int insert(const std::string &str, unsigned int folded)
+  {
+    unsigned int id = m_count;
+    unsigned int chunk = id >> chunk_bits;
+
+    if (chunk >= max_chunks)
+      throw exception(__func__, exception::fatal, "Atom table exhausted.");
+    if (!m_chunks[chunk])
+      m_chunks[chunk] = new atom_entry[chunk_size];
+
+    atom_entry &e = m_chunks[chunk][id & (chunk_size - 1)];
+    e.str = str;
+    e.folded = folded;
+    e.stud = id == folded ? str.find("stu") != std::string::npos : at(folded).stud;
+
+    m_index[str] = id;
+    ++m_count;
+
+    return id;
+  }
+
+  mutable std::shared_timed_mutex m_mutex;
+  std::unordered_map<std::string, unsigned int> m_index;
+  atom_entry *m_chunks[max_chunks];
+  unsigned int m_count;
+};
+
+}
+
+atom::atom(const std::string &str)
+{
+  m_id = str.empty() ? 0 : atom_table::instance().intern(str);
+}
+
+const std::string& atom::str() const
+{
+  return atom_table::instance().at(m_id).str;
+}
+
+atom atom::folded() const
+{
+  atom a;
+  a.m_id = atom_table::instance().at(m_id).folded;
+
+  return a;
+}
+
+atom atom::find(const std::string &str)
+{
+  atom a;
+
+  if (!str.empty())
+    a.m_id = atom_table::instance().find(str);
+
+  return a;
+}
+
+atom atom::find_folded(const std::string &str)
+{
+  atom a = find(str);
+
+  if (a.empty() && !str.empty())
+    return find(utils::translate_string(str));
+
+  return a.folded();
+}
+
+bool atom::is_stud() const
+{
+  return atom_table::instance().at(m_id).stud;
+}
+
+}
@@ -0,0 +1,55 @@
+/* libLDR: Portable and easy-to-use LDraw format abstraction & I/O reference library *
+ * To obtain more information about LDraw, visit http://www.ldraw.org.               *
+ * Distributed in terms of the GNU Lesser General Public License v3                  *
+ *                                                                                   *
+ * Author: (c)2006-2013 Park "segfault" J. K. <mastermind_at_planetmono_dot_org>     */
+
+#ifndef _LIBLDR_ATOM_H_
+#define _LIBLDR_ATOM_H_
+
+#include <string>
+
+#include "common.h"
+
+namespace ldraw
+{
+
+// Interned string. Every distinct spelling is stored once in a global table
+// and referred to by a small integer id; its case-folded form (as produced by
+// utils::translate_string()) is interned alongside, so case-insensitive name
+// comparisons reduce to comparing folded() ids. Atoms are never freed, so
+// lookups that may miss should go through find() rather than add to the
+// table.
+class LIBLDR_EXPORT atom
+{
+ public:
+  atom() : m_id(0) {}
+  atom(const std::string &str);
+
+  unsigned int id() const { return m_id; }
+  bool empty() const { return m_id == 0; }
+
+  const std::string& str() const;
+  atom folded() const;
+
+  // true if the folded name contains "stu" (see utils::is_stud())
+  bool is_stud() const;
+
+  bool operator==(const atom &rhs) const { return m_id == rhs.m_id; }
+  bool operator!=(const atom &rhs) const { return m_id != rhs.m_id; }
+  bool operator<(const atom &rhs) const { return m_id < rhs.m_id; }
+
+  static atom fold(const std::string &str) { return atom(str).folded(); }
+
+  // Like atom(str) and fold(str), but the empty atom if the spelling (for
+  // find_folded(), the folded spelling) was never interned.
+  static atom find(const std::string &str);
+  static atom find_folded(const std::string &str);
+
+ private:
+  unsigned int m_id;
+};
+
+}
+
+#endif
@@ -12,8 +12,8 @@
 #include "elements.h"
 #include "extension.h"
 
-#define CAST_AS_BFC(c) (dynamic_cast<ldraw::element_bfc *>(c))
-#define CAST_AS_CONST_BFC(c) (dynamic_cast<const ldraw::element_bfc *>(c))
+#define CAST_AS_BFC(c) (ldraw::element_cast<ldraw::element_bfc>(c))
+#define CAST_AS_CONST_BFC(c) (ldraw::element_cast<const ldraw::element_bfc>(c))
 
 namespace ldraw
 {
@@ -54,6 +54,8 @@ class LIBLDR_EXPORT bfc_certification : public extension
 class LIBLDR_EXPORT element_bfc : public element_base
 {
   public:
+	static const type type_tag = type_bfc;
+	
 	enum command 
 	{
 		cw          = 0x1,
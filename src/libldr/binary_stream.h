@@ -0,0 +1,95 @@
+/* libLDR: Portable and easy-to-use LDraw format abstraction & I/O reference library *
+ * To obtain more information about LDraw, visit http://www.ldraw.org.               *
+ * Distributed in terms of the GNU Lesser General Public License v3                  *
+ *                                                                                   *
+ * Author: (c)2006-2013 Park "segfault" J. K. <mastermind_at_planetmono_dot_org>     */
+
+#ifndef _LIBLDR_BINARY_STREAM_H_
+#define _LIBLDR_BINARY_STREAM_H_
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <stdint.h>
+
+#include "math.h"
+
+namespace ldraw
+{
+
+// Native byte order serialization used by the on-disk caches. Strings are
+// stored as a u32 length followed by the bytes.
+class binary_writer
+{
+ public:
+  template <typename T> void put(T v) { m_buf.append(reinterpret_cast<const char *>(&v), sizeof(T)); }
+  void put(const std::string &s) { put<uint32_t>(s.length()); m_buf.append(s); }
+  void put(const vector &v) { m_buf.append(reinterpret_cast<const char *>(v.get_pointer()), sizeof(float) * 3); }
+
+  const std::string& buffer() const { return m_buf; }
+
+ private:
+  std::string m_buf;
+};
+
+// Bounds-checked counterpart of binary_writer. Reading past the end yields
+// zero values and clears ok().
+class binary_reader
+{
+ public:
+  binary_reader(const char *data, std::size_t size) : m_cursor(data), m_end(data + size), m_ok(true) {}
+
+  bool ok() const { return m_ok; }
+  // for contents that are well-formed but make no sense
+  void fail() { m_ok = false; }
+
+  template <typename T> T get()
+  {
+    T v = T();
+    if (check(sizeof(T))) {
+      std::memcpy(&v, m_cursor, sizeof(T));
+      m_cursor += sizeof(T);
+    }
+    return v;
+  }
+
+  std::string get_string()
+  {
+    uint32_t len = get<uint32_t>();
+    if (!check(len))
+      return std::string();
+
+    std::string s(m_cursor, len);
+    m_cursor += len;
+    return s;
+  }
+
+  vector get_vector()
+  {
+    float v[3];
+    if (check(sizeof(v))) {
+      std::memcpy(v, m_cursor, sizeof(v));
+      m_cursor += sizeof(v);
+      return vector(v[0], v[1], v[2]);
+    }
+    return vector();
+  }
+
+ private:
+  bool check(std::size_t len)
+  {
+    if (m_ok && (std::size_t)(m_end - m_cursor) >= len)
+      return true;
+
+    m_ok = false;
+    return false;
+  }
+
+  const char *m_cursor;
+  const char *m_end;
+  bool m_ok;
+};
+
+}
+
+#endif
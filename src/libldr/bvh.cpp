@@ -0,0 +1,559 @@
+/* libLDR: Portable and easy-to-use LDraw format abstraction & I/O reference library *
+ * To obtain more information about LDraw, visit http://www.ldraw.org.               *
+ * Distributed in terms of the GNU Lesser General Public License v3                  *
+ *                                                                                   *
+ * Author: (c)2006-2013 Park "segfault" J. K. <mastermind_at_planetmono_dot_org>     */
+
+#include <algorithm>
+#include <limits>
+#include <map>
+
+#include "elements.h"
+#include "filter.h"
+#include "flat_geometry.h"
+#include "frustum.h"
+#include "geometry_store.h"
+#include "model.h"
+
+#include "bvh.h"
+
+namespace ldraw
+{
+
+namespace
+{
+
+const int leaf_size = 4;
+const int max_stack = 64;
+
+// handed out to every tree built, so that a tree built in place of a deleted
+// one never passes for it
+unsigned int next_generation = 0;
+
+struct centroid_less
+{
+  int axis;
+
+  template <class T> bool operator()(const T &a, const T &b) const
+  {
+    return a.min[axis] + a.max[axis] < b.min[axis] + b.max[axis];
+  }
+};
+
+inline float dot(const float *a, const float *b)
+{
+  return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+inline void cross(const float *a, const float *b, float *out)
+{
+  out[0] = a[1] * b[2] - a[2] * b[1];
+  out[1] = a[2] * b[0] - a[0] * b[2];
+  out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+// Moller-Trumbore; both faces count, as BFC has no say in what is clicked
+bool intersect_triangle(const float *v, const float *origin, const float *direction, float &t)
+{
+  float e1[3] = { v[3] - v[0], v[4] - v[1], v[5] - v[2] };
+  float e2[3] = { v[6] - v[0], v[7] - v[1], v[8] - v[2] };
+  float p[3], q[3];
+
+  cross(direction, e2, p);
+  float det = dot(e1, p);
+  if (det == 0.0f)
+    return false;
+
+  float inv = 1.0f / det;
+  float s[3] = { origin[0] - v[0], origin[1] - v[1], origin[2] - v[2] };
+
+  float u = dot(s, p) * inv;
+  if (u < 0.0f || u > 1.0f)
+    return false;
+
+  cross(s, e1, q);
+  float w = dot(direction, q) * inv;
+  if (w < 0.0f || u + w > 1.0f)
+    return false;
+
+  t = dot(e2, q) * inv;
+
+  return t > 0.0f;
+}
+
+bool intersect_box(const float *min, const float *max, const float *origin, const float *inv_direction, float depth)
+{
+  float tnear = 0.0f, tfar = depth;
+
+  for (int i = 0; i < 3; ++i) {
+    float t1 = (min[i] - origin[i]) * inv_direction[i];
+    float t2 = (max[i] - origin[i]) * inv_direction[i];
+
+    if (t1 > t2)
+      std::swap(t1, t2);
+    if (t1 > tnear)
+      tnear = t1;
+    if (t2 < tfar)
+      tfar = t2;
+    if (tnear > tfar)
+      return false;
+  }
+
+  return true;
+}
+
+}
+
+void box_tree::build(std::vector<box> &boxes)
+{
+  clear();
+
+  if (boxes.empty())
+    return;
+
+  m_nodes.reserve(boxes.size() / leaf_size * 2 + 1);
+  m_items.reserve(boxes.size());
+  build(boxes, 0, (int)boxes.size());
+}
+
+void box_tree::clear()
+{
+  m_nodes.clear();
+  m_items.clear();
+}
+
+// Median split along the axis in which the centers spread the most.
+void box_tree::build(std::vector<box> &boxes, int begin, int end)
+{
+  int index = (int)m_nodes.size();
+  node n;
+  float cmin[3], cmax[3];
+
+  for (int j = 0; j < 3; ++j) {
+    n.min[j] = boxes[begin].min[j];
+    n.max[j] = boxes[begin].max[j];
+    cmin[j] = cmax[j] = boxes[begin].min[j] + boxes[begin].max[j];
+  }
+
+  for (int i = begin + 1; i < end; ++i) {
+    for (int j = 0; j < 3; ++j) {
+      float c = boxes[i].min[j] + boxes[i].max[j];
+
+      n.min[j] = std::min(n.min[j], boxes[i].min[j]);
+      n.max[j] = std::max(n.max[j], boxes[i].max[j]);
+      cmin[j] = std::min(cmin[j], c);
+      cmax[j] = std::max(cmax[j], c);
+    }
+  }
+
+  int axis = 0;
+  for (int j = 1; j < 3; ++j) {
+    if (cmax[j] - cmin[j] > cmax[axis] - cmin[axis])
+      axis = j;
+  }
+
+  n.first = (int)m_items.size();
+  n.count = end - begin;
+  n.right = 0;
+  m_nodes.push_back(n);
+
+  // coincident centers cannot be told apart by splitting
+  if (end - begin <= leaf_size || cmax[axis] == cmin[axis]) {
+    for (int i = begin; i < end; ++i)
+      m_items.push_back(boxes[i].id);
+
+    return;
+  }
+
+  int mid = (begin + end) / 2;
+  centroid_less less = { axis };
+  std::nth_element(boxes.begin() + begin, boxes.begin() + mid, boxes.begin() + end, less);
+
+  build(boxes, begin, mid);
+  m_nodes[index].right = (int)m_nodes.size();
+  build(boxes, mid, end);
+}
+
+triangle_bvh::triangle_bvh(model *m, void *arg)
+    : extension(m, arg), m_hash(0), m_generation(0)
+{
+}
+
+void triangle_bvh::update()
+{
+  std::set<model *> checked;
+
+  checked.insert(m_model);
+  rebuild(checked);
+}
+
+const triangle_bvh* triangle_bvh::current(model *m)
+{
+  std::set<model *> checked;
+
+  return refresh(m, checked);
+}
+
+// Every model is looked at once per pass, however often it is referenced;
+// a tree is stale if its own model changed or any tree below was rebuilt.
+// m_dependencies is only followed once the references are known to lead
+// where they did: a model dropped since may have been deleted.
+triangle_bvh* triangle_bvh::refresh(model *m, std::set<model *> &checked)
+{
+  triangle_bvh *b = m->custom_data<triangle_bvh>();
+
+  if (!checked.insert(m).second)
+    return b;
+
+  if (!b) {
+    b = m->init_custom_data<triangle_bvh>();
+    b->rebuild(checked);
+
+    return b;
+  }
+
+  if (b->m_hash != m->content_hash()) {
+    b->rebuild(checked);
+
+    return b;
+  }
+
+  // relinking a reference leaves the content hash alone
+  const std::vector<int> &refs = m->geometry().refs();
+  bool stale = refs.size() != b->m_links.size();
+
+  for (unsigned int i = 0; i < refs.size() && !stale; ++i)
+    stale = CAST_AS_CONST_REF(m->elements()[refs[i]])->get_model() != b->m_links[i];
+
+  for (std::vector<dependency>::const_iterator it = b->m_dependencies.begin(); it != b->m_dependencies.end() && !stale; ++it) {
+    const triangle_bvh *d = refresh(it->m, checked);
+
+    if (!d || d->m_generation != it->generation)
+      stale = true;
+  }
+
+  if (stale)
+    b->rebuild(checked);
+
+  return b;
+}
+
+void triangle_bvh::rebuild(std::set<model *> &checked)
+{
+  m_tree.clear();
+  m_triangles.clear();
+  m_elements.clear();
+  m_instances.clear();
+  m_dependencies.clear();
+  m_links.clear();
+
+  m_hash = m_model->content_hash();
+  m_generation = ++next_generation;
+
+  const geometry_store &g = m_model->geometry();
+  const geometry_store::stream &tris = g.get(geometry_store::triangles);
+  const geometry_store::stream &quads = g.get(geometry_store::quads);
+
+  m_triangles.reserve((tris.size() + quads.size() * 2) * 9);
+  m_triangles.insert(m_triangles.end(), tris.positions.begin(), tris.positions.end());
+  m_elements.insert(m_elements.end(), tris.indices.begin(), tris.indices.end());
+
+  for (int i = 0; i < quads.size(); ++i) {
+    const float *v = quads.position(i, 0);
+
+    m_triangles.insert(m_triangles.end(), v, v + 9);
+    m_triangles.insert(m_triangles.end(), v, v + 3);
+    m_triangles.insert(m_triangles.end(), v + 6, v + 12);
+    m_elements.push_back(quads.indices[i]);
+    m_elements.push_back(quads.indices[i]);
+  }
+
+  // Library parts are not edited, so what a part references is flattened
+  // into triangles of its own rather than held as instances; a ray through a
+  // part then walks one tree instead of one per stud and edge primitive.
+  // The triangles count as the reference they came from.
+  bool flatten = m_model->modeltype() == model::part || m_model->modeltype() == model::primitive;
+
+  if (flatten) {
+    for (std::vector<int>::const_iterator it = g.refs().begin(); it != g.refs().end(); ++it) {
+      const element_ref *l = CAST_AS_CONST_REF(m_model->elements()[*it]);
+      model *lm = l->get_model();
+
+      if (!lm || lm == m_model || l->is_singular())
+        continue;
+
+      flat_geometry f;
+      f.build(lm, l->get_matrix(), color(16), 1);
+
+      const flat_geometry::stream &t = f.get(flat_geometry::triangles);
+      m_triangles.insert(m_triangles.end(), t.positions.begin(), t.positions.end());
+      m_elements.insert(m_elements.end(), t.size(), *it);
+    }
+  }
+
+  int ntriangles = (int)m_elements.size();
+  std::vector<box_tree::box> items(ntriangles);
+
+  for (int i = 0; i < ntriangles; ++i) {
+    const float *v = &m_triangles[i * 9];
+    box_tree::box &it = items[i];
+
+    for (int j = 0; j < 3; ++j) {
+      it.min[j] = std::min(v[j], std::min(v[j + 3], v[j + 6]));
+      it.max[j] = std::max(v[j], std::max(v[j + 3], v[j + 6]));
+    }
+    it.id = i;
+  }
+
+  // one tree per referenced model, whatever the number of references
+  std::map<model *, const triangle_bvh *> trees;
+
+  for (std::vector<int>::const_iterator it = g.refs().begin(); it != g.refs().end(); ++it) {
+    const element_ref *l = CAST_AS_CONST_REF(m_model->elements()[*it]);
+    model *lm = l->get_model();
+
+    m_links.push_back(lm);
+
+    if (flatten || !lm || lm == m_model || l->is_singular())
+      continue;
+
+    std::map<model *, const triangle_bvh *>::iterator ti = trees.find(lm);
+    if (ti == trees.end()) {
+      const triangle_bvh *t = refresh(lm, checked);
+
+      // a model referencing its way back here has no tree yet
+      if (t) {
+        dependency d = { lm, t->m_generation };
+        m_dependencies.push_back(d);
+      }
+
+      ti = trees.insert(std::make_pair(lm, t)).first;
+    }
+
+    const triangle_bvh *tree = ti->second;
+    if (!tree || tree->is_empty())
+      continue;
+
+    const box_tree::node &root = tree->m_tree.nodes()[0];
+    vector min, max;
+    metrics(vector(root.min[0], root.min[1], root.min[2]), vector(root.max[0], root.max[1], root.max[2])).transformed_bounds(l->get_matrix(), min, max);
+
+    box_tree::box b;
+    for (int j = 0; j < 3; ++j) {
+      b.min[j] = min[j];
+      b.max[j] = max[j];
+    }
+    b.id = ntriangles + (int)m_instances.size();
+    items.push_back(b);
+
+    instance in = { tree, ~l->get_matrix(), *it };
+    m_instances.push_back(in);
+  }
+
+  m_tree.build(items);
+}
+
+bool triangle_bvh::intersect(const ray &r, pick_result &result, const filter *skip) const
+{
+  if (m_tree.is_empty())
+    return false;
+
+  const float origin[3] = { r.origin.x(), r.origin.y(), r.origin.z() };
+  const float direction[3] = { r.direction.x(), r.direction.y(), r.direction.z() };
+  float depth = result.depth;
+  int element = -1;
+
+  if (!traverse(origin, direction, depth, element, skip))
+    return false;
+
+  result.depth = depth;
+  result.element = element;
+
+  return true;
+}
+
+bool triangle_bvh::traverse(const float *origin, const float *direction, float &depth, int &element, const filter *skip) const
+{
+  const float inv_direction[3] = { 1.0f / direction[0], 1.0f / direction[1], 1.0f / direction[2] };
+  const std::vector<box_tree::node> &nodes = m_tree.nodes();
+  const std::vector<int> &items = m_tree.items();
+  const int ntriangles = (int)m_elements.size();
+  int stack[max_stack];
+  int sp = 0;
+  bool hit = false;
+
+  stack[sp++] = 0;
+
+  while (sp) {
+    int index = stack[--sp];
+    const box_tree::node &n = nodes[index];
+
+    if (!intersect_box(n.min, n.max, origin, inv_direction, depth))
+      continue;
+
+    if (n.right) {
+      stack[sp++] = n.right;
+      stack[sp++] = index + 1;
+      continue;
+    }
+
+    for (int i = n.first; i < n.first + n.count; ++i) {
+      int id = items[i];
+
+      if (id < ntriangles) {
+        float t;
+
+        if (skip && skip->query(m_model, m_elements[id], 0))
+          continue;
+
+        if (intersect_triangle(&m_triangles[id * 9], origin, direction, t) && t < depth) {
+          depth = t;
+          element = m_elements[id];
+          hit = true;
+        }
+      } else {
+        const instance &in = m_instances[id - ntriangles];
+        const matrix &m = in.inverse;
+        float o[3], d[3];
+        int sub;
+
+        if (skip && skip->query(m_model, in.element, 0))
+          continue;
+
+        // affine, so depths along the ray carry over unchanged
+        for (int j = 0; j < 3; ++j) {
+          o[j] = m.value(j, 0) * origin[0] + m.value(j, 1) * origin[1] + m.value(j, 2) * origin[2] + m.value(j, 3);
+          d[j] = m.value(j, 0) * direction[0] + m.value(j, 1) * direction[1] + m.value(j, 2) * direction[2];
+        }
+
+        if (in.tree->traverse(o, d, depth, sub, 0L)) {
+          element = in.element;
+          hit = true;
+        }
+      }
+    }
+  }
+
+  return hit;
+}
+
+reference_bvh::reference_bvh(model *m, void *arg)
+    : extension(m, arg), m_hash(0)
+{
+}
+
+void reference_bvh::update()
+{
+  const geometry_store &g = m_model->geometry();
+  std::vector<box_tree::box> items;
+
+  m_hash = m_model->hash();
+  m_boxes.clear();
+  m_elements.clear();
+  m_slots.assign(m_model->elements().size(), -1);
+
+  for (std::vector<int>::const_iterator it = g.refs().begin(); it != g.refs().end(); ++it) {
+    const element_ref *l = CAST_AS_CONST_REF(m_model->elements()[*it]);
+    model *lm = l->get_model();
+
+    if (!lm)
+      continue;
+
+    const metrics *mt = metrics::current(lm);
+    if (!mt)
+      continue;
+
+    vector min, max;
+    mt->transformed_bounds(l->get_matrix(), min, max);
+
+    box_tree::box b;
+    for (int j = 0; j < 3; ++j) {
+      b.min[j] = min[j];
+      b.max[j] = max[j];
+    }
+    b.id = (int)m_boxes.size();
+    items.push_back(b);
+
+    m_slots[*it] = (int)m_boxes.size();
+    m_boxes.push_back(mt->oriented(l->get_matrix()));
+    m_elements.push_back(*it);
+  }
+
+  m_tree.build(items);
+}
+
+const reference_bvh* reference_bvh::current(model *m)
+{
+  reference_bvh *b = m->custom_data<reference_bvh>();
+
+  // the boxes come from the metrics of the submodels below, so anything
+  // changed down there counts too
+  if (!b || b->m_hash != m->hash()) {
+    m->update_custom_data<reference_bvh>();
+    b = m->custom_data<reference_bvh>();
+  }
+
+  return b;
+}
+
+void reference_bvh::query(const frustum &f, std::vector<int> &result, const filter *skip) const
+{
+  if (m_tree.is_empty())
+    return;
+
+  const std::vector<box_tree::node> &nodes = m_tree.nodes();
+  const std::vector<int> &items = m_tree.items();
+  int stack[max_stack];
+  int sp = 0;
+
+  stack[sp++] = 0;
+
+  while (sp) {
+    int index = stack[--sp];
+    const box_tree::node &n = nodes[index];
+    frustum::containment c = f.test(n.min, n.max);
+
+    if (c == frustum::outside)
+      continue;
+
+    if (c == frustum::intersecting && n.right) {
+      stack[sp++] = n.right;
+      stack[sp++] = index + 1;
+      continue;
+    }
+
+    // everything below is in if the node is; otherwise a leaf to sort out
+    for (int i = n.first; i < n.first + n.count; ++i) {
+      int id = items[i];
+
+      if (skip && skip->query(m_model, m_elements[id], 0))
+        continue;
+
+      if (c == frustum::inside || f.test(m_boxes[id]) != frustum::outside)
+        result.push_back(m_elements[id]);
+    }
+  }
+}
+
+const oriented_box* reference_bvh::bounds(int index) const
+{
+  if (index < 0 || index >= (int)m_slots.size() || m_slots[index] == -1)
+    return 0L;
+
+  return &m_boxes[m_slots[index]];
+}
+
+pick_result pick(model *m, const ray &r, const filter *skip)
+{
+  pick_result result;
+
+  result.element = -1;
+  result.depth = std::numeric_limits<float>::max();
+
+  if (triangle_bvh::current(m)->intersect(r, result, skip))
+    result.point = r.origin + r.direction * result.depth;
+
+  return result;
+}
+
+}
@@ -0,0 +1,171 @@
+/* libLDR: Portable and easy-to-use LDraw format abstraction & I/O reference library *
+ * To obtain more information about LDraw, visit http://www.ldraw.org.               *
+ * Distributed in terms of the GNU Lesser General Public License v3                  *
+ *                                                                                   *
+ * Author: (c)2006-2013 Park "segfault" J. K. <mastermind_at_planetmono_dot_org>     */
+
+#ifndef _LIBLDR_BVH_H_
+#define _LIBLDR_BVH_H_
+
+#include <stdint.h>
+#include <set>
+#include <vector>
+
+#include "extension.h"
+#include "math.h"
+#include "metrics.h"
+
+namespace ldraw
+{
+
+class filter;
+class frustum;
+class model;
+
+// Half-line from origin along direction; the direction need not be normalized.
+struct LIBLDR_EXPORT ray
+{
+  vector origin;
+  vector direction;
+};
+
+struct LIBLDR_EXPORT pick_result
+{
+  int element;  // index into model::elements(), -1 if nothing was hit
+  float depth;  // distance along the ray in units of its direction
+  vector point; // where the ray hits the surface
+};
+
+// Median-split hierarchy of axis-aligned boxes. The items below any node
+// are a contiguous run of items(), so a query can take a whole subtree at
+// once.
+class LIBLDR_EXPORT box_tree
+{
+  public:
+    struct box
+    {
+      float min[3];
+      float max[3];
+      int id;
+    };
+
+    struct node
+    {
+      float min[3];
+      float max[3];
+      int first; // first of the items below in items()
+      int count; // number of items below
+      int right; // second child, the first one follows directly; 0 for leaves
+    };
+
+    // reorders boxes
+    void build(std::vector<box> &boxes);
+    void clear();
+
+    bool is_empty() const { return m_nodes.empty(); }
+    const std::vector<node>& nodes() const { return m_nodes; }
+    // ids of the boxes, in tree order
+    const std::vector<int>& items() const { return m_items; }
+
+  private:
+    void build(std::vector<box> &boxes, int begin, int end);
+
+    std::vector<node> m_nodes;
+    std::vector<int> m_items;
+};
+
+// Bounding volume hierarchy over the triangles and quads of a model. Each
+// referenced model gets a tree of its own, which the parent holds as one
+// instance per reference, so a part is only ever built once however many
+// times it is used; inside a part, whatever it references is flattened into
+// its own tree through flat_geometry. pick() rebuilds whatever has changed
+// since, as told by model::content_hash().
+class LIBLDR_EXPORT triangle_bvh : public extension
+{
+  public:
+    triangle_bvh(model *m, void *arg = 0L);
+    virtual ~triangle_bvh() {}
+
+    static const std::string identifier() { return "triangle_bvh"; }
+
+    void update();
+
+    // The tree of m, after rebuilding where m or anything below it changed.
+    static const triangle_bvh* current(model *m);
+
+    bool is_empty() const { return m_tree.is_empty(); }
+
+    // Nearest hit of r closer than result.depth. Elements for which
+    // skip->query(model, index, 0) is true are passed over.
+    bool intersect(const ray &r, pick_result &result, const filter *skip = 0L) const;
+
+  private:
+    struct instance
+    {
+      const triangle_bvh *tree;
+      matrix inverse;
+      int element;
+    };
+
+    struct dependency
+    {
+      model *m;
+      unsigned int generation;
+    };
+
+    // checked holds the models already brought up to date in this pass
+    static triangle_bvh* refresh(model *m, std::set<model *> &checked);
+    void rebuild(std::set<model *> &checked);
+    bool traverse(const float *origin, const float *direction, float &depth, int &element, const filter *skip) const;
+
+    box_tree m_tree;
+    std::vector<float> m_triangles;  // 9 floats each
+    std::vector<int> m_elements;     // element of each triangle
+    std::vector<instance> m_instances; // ids after the triangles
+    std::vector<dependency> m_dependencies; // one per referenced model
+    std::vector<model *> m_links;           // model of each reference
+    uint64_t m_hash;
+    unsigned int m_generation;
+};
+
+// Bounding volume hierarchy over the references of a model, each taken as
+// the metrics of its model placed by the reference, for region queries such
+// as rubber-band selection. The metrics are brought up to date through
+// metrics::current(), and the tree is rebuilt whenever model::hash() says
+// anything below has changed.
+class LIBLDR_EXPORT reference_bvh : public extension
+{
+  public:
+    reference_bvh(model *m, void *arg = 0L);
+    virtual ~reference_bvh() {}
+
+    static const std::string identifier() { return "reference_bvh"; }
+
+    void update();
+
+    // The tree of m, rebuilt first if m or a submodel below has changed.
+    static const reference_bvh* current(model *m);
+
+    // Appends the references inside or partly inside f, in no particular
+    // order. Those for which skip->query(model, index, 0) is true are
+    // passed over.
+    void query(const frustum &f, std::vector<int> &result, const filter *skip = 0L) const;
+
+    // the placed box of reference index
+    const oriented_box* bounds(int index) const;
+
+  private:
+    box_tree m_tree;
+    std::vector<oriented_box> m_boxes;
+    std::vector<int> m_elements; // element of each box
+    std::vector<int> m_slots;    // box of each element, -1 for none
+    uint64_t m_hash;
+};
+
+// Nearest element of m under r, given in the coordinates of m. Elements for
+// which skip->query(m, index, 0) is true are passed over.
+LIBLDR_EXPORT pick_result pick(model *m, const ray &r, const filter *skip = 0L);
+
+}
+
+#endif
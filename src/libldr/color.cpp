@@ -4,9 +4,10 @@
  *                                                                                   *
  * Author: (c)2006-2008 Park "segfault" J. K. <mastermind_at_planetmono_dot_org>     */
 
+#include <atomic>
 #include <iostream>
-#include <sstream>
 #include <map>
+#include <mutex>
 
 #include "color.h"
 
@@ -171,46 +172,161 @@ const color_entity color::color_chart[] = {
 
 const int color::color_chart_count = sizeof(color_chart) / sizeof(color_entity);
 
+namespace
+{
+
+/* Entities are looked up without locking. Ids of the standard range index a
+ * flat table; everything else (direct colors, unknown ids) goes through an
+ * open-addressed table whose keys are claimed with compare-and-swap and never
+ * released. An entity, once published, lives until exit. */
+const unsigned int standard_range = 513;
+const unsigned int custom_table_size = 4096;
+
+std::atomic<const color_entity *> standard_table[standard_range];
+std::atomic<unsigned int> custom_keys[custom_table_size];
+std::atomic<const color_entity *> custom_table[custom_table_size];
+
+// the odd id beyond custom_table_size distinct ones ends up here
+std::mutex overflow_mutex;
+std::map<unsigned int, const color_entity *> overflow_table;
+
+// marks ids which could not be resolved
+const color_entity unresolved = { material_normal, {0, 0, 0, 0}, {0, 0, 0, 0}, 0, 0, "", 0L };
+
+// returns the slot of id, claiming a free one if asked to; -1 if id is not
+// there, -2 if the table is full
+int custom_slot(unsigned int id, bool claim)
+{
+  unsigned int h = (id * 2654435761u) % custom_table_size;
+  
+  for (unsigned int i = 0; i < custom_table_size; ++i) {
+    unsigned int slot = (h + i) % custom_table_size;
+    unsigned int k = custom_keys[slot].load(std::memory_order_acquire);
+    
+    if (k == 0) {
+      if (!claim)
+        return -1;
+      if (custom_keys[slot].compare_exchange_strong(k, id) || k == id)
+        return slot;
+    } else if (k == id) {
+      return slot;
+    }
+  }
+  
+  return -2;
+}
+
+const color_entity* find(unsigned int id)
+{
+  if (id < standard_range)
+    return standard_table[id].load(std::memory_order_acquire);
+  
+  int slot = custom_slot(id, false);
+  if (slot >= 0)
+    return custom_table[slot].load(std::memory_order_acquire);
+  else if (slot == -1)
+    return 0L;
+  
+  std::lock_guard<std::mutex> lock(overflow_mutex);
+  
+  std::map<unsigned int, const color_entity *>::const_iterator it = overflow_table.find(id);
+  if (it != overflow_table.end())
+    return (*it).second;
+  
+  return 0L;
+}
+
+const color_entity* publish(unsigned int id, const color_entity *e)
+{
+  std::atomic<const color_entity *> *target = 0L;
+  
+  if (id < standard_range) {
+    target = &standard_table[id];
+  } else {
+    int slot = custom_slot(id, true);
+    if (slot >= 0)
+      target = &custom_table[slot];
+  }
+  
+  const color_entity *expected = 0L;
+  
+  if (target) {
+    if (target->compare_exchange_strong(expected, e))
+      return e;
+  } else {
+    std::lock_guard<std::mutex> lock(overflow_mutex);
+    
+    std::map<unsigned int, const color_entity *>::const_iterator it = overflow_table.find(id);
+    if (it == overflow_table.end()) {
+      overflow_table[id] = e;
+      return e;
+    }
+    
+    expected = (*it).second;
+  }
+  
+  // somebody else was faster
+  if (e != &unresolved)
+    delete e;
+  
+  return expected;
+}
+
+}
+
 void color::init()
 {
   color_map_type &m = *const_cast<color_map_type *>(&color_map);
   
-  for (int i = 0; i < color_chart_count; ++i)
+  for (int i = 0; i < color_chart_count; ++i) {
     m[color_chart[i].id] = &color_chart[i];
+    
+    if (color_chart[i].id < standard_range)
+      standard_table[color_chart[i].id].store(&color_chart[i], std::memory_order_release);
+  }
   
   m_initialized = true;
 }
 
-color::~color()
+const color_entity* color::get_entity() const
+{
+  const color_entity *e = find(m_id);
+  
+  if (!e)
+    e = resolve(m_id);
+  
+  if (e == &unresolved)
+    return &color_chart[0];
+  
+  return e;
+}
+
+bool color::is_valid() const
 {
-  if (m_custom_color)
-    delete m_entity;
+  const color_entity *e = find(m_id);
+  
+  if (!e)
+    e = resolve(m_id);
+  
+  return e != &unresolved;
 }
 
-// Map color-id to appropriate color value
-void color::link()
+// Creates the entity of a color id, and caches it
+const color_entity* color::resolve(unsigned int id)
 {
   if (!m_initialized)
     throw exception(__func__, exception::user_error, "Color table is not initialized! run color::init() first.");
   
-  m_custom_color = false;
-  m_valid = true;
+  const color_entity *e;
   
-  const color_map_type::const_iterator it = color_map.find(m_id);
-  if (it != color_map.end()) {
-    m_entity = (*it).second;
-    return;
-  }
-  
-  if (m_id >= 256 && m_id <= 512) {
+  if (id >= 256 && id <= 512) {
     // Blended color (256 <= n <= 512)
-    m_custom_color = true;
-    const color_entity *c1 = color((m_id - 256) / 16).get_entity();
-    const color_entity *c2 = color((m_id - 256) % 16).get_entity();
+    const color_entity *c1 = color((id - 256) / 16).get_entity();
+    const color_entity *c2 = color((id - 256) % 16).get_entity();
     
     color_entity *nc = new color_entity;
     nc->material = material_normal;
-    nc->id = m_id;
+    nc->id = id;
     nc->name = "Blended color";
     nc->rgba[0] = (unsigned char) (((int) c1->rgba[0] + (int) c2->rgba[0])/2);
     nc->rgba[1] = (unsigned char) (((int) c1->rgba[1] + (int) c2->rgba[1])/2);
@@ -221,17 +337,16 @@ void color::link()
     nc->complement[1] = 89;
     nc->complement[2] = 89;
     nc->complement[3] = 255;
+    nc->luminance = 0;
+    nc->traits = 0L;
     
-    m_entity = nc;
-    
-    return;
-  } else if ((m_id & 0xff000000) == 0x04000000) {
-    m_custom_color = true;
-    unsigned int v = m_id & 0xfff;
+    e = nc;
+  } else if ((id & 0xff000000) == 0x04000000) {
+    unsigned int v = id & 0xfff;
 
     color_entity *nc = new color_entity;
     nc->material = material_normal;
-    nc->id = m_id;
+    nc->id = id;
     nc->name = "Custom color";
     nc->rgba[0] = (unsigned char) (((v & 0xf00) >> 8) * 255.0f / 15.0f);
     nc->rgba[1] = (unsigned char) (((v & 0x0f0) >> 4) * 255.0f / 15.0f);
@@ -242,17 +357,16 @@ void color::link()
     nc->complement[1] = (unsigned char) (((v & 0x0f0000) >> 16) * 255.0f / 15.0f);
     nc->complement[2] = (unsigned char) (((v & 0x00f000) >> 12) * 255.0f / 15.0f);
     nc->complement[3] = 255;
+    nc->luminance = 0;
+    nc->traits = 0L;
 
-    m_entity = nc;
-
-    return;
-  } else if ((m_id & 0xff000000) == 0x02000000) {
-    m_custom_color = true;
-    unsigned int v = m_id & 0xffffff;
+    e = nc;
+  } else if ((id & 0xff000000) == 0x02000000) {
+    unsigned int v = id & 0xffffff;
 
     color_entity *nc = new color_entity;
     nc->material = material_normal;
-    nc->id = m_id;
+    nc->id = id;
     nc->name = "Custom color";
     nc->rgba[0] = (unsigned char) ((v & 0xff0000) >> 16);
     nc->rgba[1] = (unsigned char) ((v & 0x00ff00) >> 8);
@@ -263,27 +377,18 @@ void color::link()
     nc->complement[1] = nc->rgba[1] / 2;
     nc->complement[2] = nc->rgba[2] / 2;
     nc->complement[3] = nc->rgba[3] / 2;
+    nc->luminance = 0;
+    nc->traits = 0L;
 
-    m_entity = nc;
+    e = nc;
+  } else {
+    // complain only once per id
+    std::cerr << "[libLDR] couldn't resolve color " << id << std::endl;
     
-    return;
-  }
-  
-  if (m_id == 16 || m_id == 24) {
-    m_entity = &color_chart[0];
-    return;
+    e = &unresolved;
   }
   
-  std::cerr << "[libLDR] couldn't resolve color " << m_id << std::endl;
-  
-  // No color
-  m_valid = false;
-  m_entity = &color_chart[0];
-  
-  /*std::ostringstream s;
-    s << "Invalid color value '" << m_id << "'.";
-    throw exception(__func__, exception::warning, s.str());*/
+  return publish(id, e);
 }
 
 }
-
@@ -55,7 +55,9 @@ class color_entity
   const void *traits;
 };
 
-// Represents a color.
+// Represents a color. Only the LDraw color id is stored; the entity is looked
+// up on demand. Entities of blended and direct colors are created once per id
+// and shared, so colors are cheap to copy around.
 class LIBLDR_EXPORT color
 {
  public:
@@ -67,32 +69,26 @@ class LIBLDR_EXPORT color
   
   static void init();
   
-  color() : m_valid(true), m_id(0) { link(); }
-  color(int id) : m_id(id) { link(); }
-  color(const color &c) : m_id(c.get_id()) { link(); }
-  ~color();
+  color() : m_id(0) {}
+  color(int id) : m_id(id) {}
   
-  void operator=(int cid) { m_id = cid; link(); }
-  void operator=(const color &rhs) { m_id = rhs.get_id(); link(); }
+  void operator=(int cid) { m_id = cid; }
   bool operator<(const color &rhs) const { return m_id < rhs.get_id(); }
   bool operator==(const color &rhs) const { return m_id == rhs.get_id(); }
   
   unsigned int get_id() const { return m_id; }
-  void set_id(int i) { m_id = i; link(); }
+  void set_id(int i) { m_id = i; }
   
-  bool is_valid() { return m_valid; }
-  bool is_null() { return m_id == 16 || m_id == 24; }
-  const color_entity* get_entity() const { return m_entity; }
+  bool is_valid() const;
+  bool is_null() const { return m_id == 16 || m_id == 24; }
+  const color_entity* get_entity() const;
   
  private:
   static bool m_initialized;
   
-  void link();
+  static const color_entity* resolve(unsigned int id);
   
-  bool m_custom_color;
-  bool m_valid;
   unsigned int m_id;
-  const color_entity *m_entity;
 };
 
 }
@@ -0,0 +1,292 @@
+/* libLDR: Portable and easy-to-use LDraw format abstraction & I/O reference library *
+ * To obtain more information about LDraw, visit http://www.ldraw.org.               *
+ * Distributed in terms of the GNU Lesser General Public License v3                  *
+ *                                                                                   *
+ * Author: (c)2006-2013 Park "segfault" J. K. <mastermind_at_planetmono_dot_org>     */
+
+#include <algorithm>
+
+#ifdef LIBLDR_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "compressed_stream.h"
+
+namespace ldraw
+{
+
+namespace
+{
+
+const std::size_t chunk_size = 65536;
+
+#ifdef LIBLDR_HAVE_ZLIB
+// windowBits for inflateInit2/deflateInit2 that selects the gzip wrapper
+const int gzip_window_bits = 16 + MAX_WBITS;
+#else
+void unsupported(const char *location)
+{
+  throw exception(location, exception::user_error, "libLDR was built without zlib; compressed models are not supported.");
+}
+#endif
+
+}
+
+compression detect_compression(const char *data, std::size_t length)
+{
+  const unsigned char *d = reinterpret_cast<const unsigned char *>(data);
+
+  if (length >= 2 && d[0] == 0x1f && d[1] == 0x8b)
+    return compression_gzip;
+  else if (length >= 4 && d[0] == 0x28 && d[1] == 0xb5 && d[2] == 0x2f && d[3] == 0xfd)
+    return compression_zstd;
+
+  return compression_none;
+}
+
+bool compression_available()
+{
+#ifdef LIBLDR_HAVE_ZLIB
+  return true;
+#else
+  return false;
+#endif
+}
+
+#ifdef LIBLDR_HAVE_ZLIB
+
+gzip_reader::gzip_reader(const char *data, std::size_t length)
+    : m_stream(0L), m_input(0L), m_end(false)
+{
+  init();
+
+  z_stream *z = static_cast<z_stream *>(m_zstream);
+
+  // zlib counts in uInt, so anything larger is handed over in pieces by read()
+  m_data = data;
+  m_remaining = length;
+  z->next_in = 0L;
+  z->avail_in = 0;
+}
+
+gzip_reader::gzip_reader(std::istream &stream)
+    : m_stream(&stream), m_input(new char[chunk_size]), m_end(false)
+{
+  init();
+
+  m_data = 0L;
+  m_remaining = 0;
+}
+
+gzip_reader::~gzip_reader()
+{
+  z_stream *z = static_cast<z_stream *>(m_zstream);
+
+  inflateEnd(z);
+  delete z;
+  delete [] m_input;
+}
+
+void gzip_reader::init()
+{
+  z_stream *z = new z_stream;
+
+  z->zalloc = Z_NULL;
+  z->zfree = Z_NULL;
+  z->opaque = Z_NULL;
+  z->next_in = Z_NULL;
+  z->avail_in = 0;
+
+  if (inflateInit2(z, gzip_window_bits) != Z_OK) {
+    delete z;
+    delete [] m_input;
+    throw exception(__func__, exception::fatal, "Could not initialize zlib.");
+  }
+
+  m_zstream = z;
+}
+
+bool gzip_reader::refill()
+{
+  z_stream *z = static_cast<z_stream *>(m_zstream);
+
+  if (m_stream) {
+    m_stream->read(m_input, chunk_size);
+    z->next_in = reinterpret_cast<Bytef *>(m_input);
+    z->avail_in = (uInt) m_stream->gcount();
+  } else {
+    std::size_t n = std::min(m_remaining, (std::size_t) 1 << 30);
+    z->next_in = reinterpret_cast<Bytef *>(const_cast<char *>(m_data));
+    z->avail_in = (uInt) n;
+    m_data += n;
+    m_remaining -= n;
+  }
+
+  return z->avail_in > 0;
+}
+
+std::size_t gzip_reader::read(char *buf, std::size_t length)
+{
+  z_stream *z = static_cast<z_stream *>(m_zstream);
+
+  length = std::min(length, (std::size_t) 1 << 30);
+  z->next_out = reinterpret_cast<Bytef *>(buf);
+  z->avail_out = (uInt) length;
+
+  while (z->avail_out > 0 && !m_end) {
+    if (z->avail_in == 0 && !refill())
+      throw exception(__func__, exception::user_error, "Unexpected end of compressed data.");
+
+    int r = inflate(z, Z_NO_FLUSH);
+
+    if (r == Z_STREAM_END) {
+      // gzip files may consist of several members in a row
+      if (z->avail_in == 0 && !refill())
+        m_end = true;
+      else
+        inflateReset(z);
+    } else if (r != Z_OK) {
+      throw exception(__func__, exception::user_error, "Corrupt compressed data.");
+    }
+  }
+
+  return length - z->avail_out;
+}
+
+gzip_streambuf::gzip_streambuf(std::ostream &stream)
+    : m_stream(stream), m_buffer(new char[chunk_size]), m_output(new char[chunk_size]), m_finished(false)
+{
+  z_stream *z = new z_stream;
+
+  z->zalloc = Z_NULL;
+  z->zfree = Z_NULL;
+  z->opaque = Z_NULL;
+
+  if (deflateInit2(z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, gzip_window_bits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+    delete z;
+    delete [] m_buffer;
+    delete [] m_output;
+    throw exception(__func__, exception::fatal, "Could not initialize zlib.");
+  }
+
+  m_zstream = z;
+  setp(m_buffer, m_buffer + chunk_size);
+}
+
+gzip_streambuf::~gzip_streambuf()
+{
+  finish();
+
+  z_stream *z = static_cast<z_stream *>(m_zstream);
+  deflateEnd(z);
+  delete z;
+
+  delete [] m_buffer;
+  delete [] m_output;
+}
+
+void gzip_streambuf::finish()
+{
+  if (m_finished)
+    return;
+
+  deflate_buffer(Z_FINISH);
+  m_stream.flush();
+  m_finished = true;
+}
+
+gzip_streambuf::int_type gzip_streambuf::overflow(int_type c)
+{
+  if (m_finished || !deflate_buffer(Z_NO_FLUSH))
+    return traits_type::eof();
+
+  if (!traits_type::eq_int_type(c, traits_type::eof())) {
+    *pptr() = traits_type::to_char_type(c);
+    pbump(1);
+  }
+
+  return traits_type::not_eof(c);
+}
+
+int gzip_streambuf::sync()
+{
+  // only hands over what zlib has ready; flushing the compressor itself on
+  // every sync would cost compression ratio
+  if (m_finished || !deflate_buffer(Z_NO_FLUSH))
+    return -1;
+
+  m_stream.flush();
+
+  return m_stream ? 0 : -1;
+}
+
+bool gzip_streambuf::deflate_buffer(int flush)
+{
+  z_stream *z = static_cast<z_stream *>(m_zstream);
+
+  z->next_in = reinterpret_cast<Bytef *>(pbase());
+  z->avail_in = (uInt) (pptr() - pbase());
+
+  do {
+    z->next_out = reinterpret_cast<Bytef *>(m_output);
+    z->avail_out = chunk_size;
+
+    if (deflate(z, flush) == Z_STREAM_ERROR)
+      return false;
+
+    m_stream.write(m_output, chunk_size - z->avail_out);
+  } while (z->avail_out == 0);
+
+  setp(m_buffer, m_buffer + chunk_size);
+
+  return m_stream.good();
+}
+
+#else
+
+gzip_reader::gzip_reader(const char *, std::size_t)
+{
+  unsupported(__func__);
+}
+
+gzip_reader::gzip_reader(std::istream &)
+{
+  unsupported(__func__);
+}
+
+gzip_reader::~gzip_reader()
+{
+}
+
+std::size_t gzip_reader::read(char *, std::size_t)
+{
+  return 0;
+}
+
+gzip_streambuf::gzip_streambuf(std::ostream &stream)
+    : m_stream(stream)
+{
+  unsupported(__func__);
+}
+
+gzip_streambuf::~gzip_streambuf()
+{
+}
+
+void gzip_streambuf::finish()
+{
+}
+
+gzip_streambuf::int_type gzip_streambuf::overflow(int_type)
+{
+  return traits_type::eof();
+}
+
+int gzip_streambuf::sync()
+{
+  return -1;
+}
+
+#endif
+
+}
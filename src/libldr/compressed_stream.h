@@ -0,0 +1,84 @@
+/* libLDR: Portable and easy-to-use LDraw format abstraction & I/O reference library *
+ * To obtain more information about LDraw, visit http://www.ldraw.org.               *
+ * Distributed in terms of the GNU Lesser General Public License v3                  *
+ *                                                                                   *
+ * Author: (c)2006-2013 Park "segfault" J. K. <mastermind_at_planetmono_dot_org>     */
+
+#ifndef _LIBLDR_COMPRESSED_STREAM_H_
+#define _LIBLDR_COMPRESSED_STREAM_H_
+
+#include <cstddef>
+#include <istream>
+#include <ostream>
+#include <streambuf>
+#include <string>
+
+#include "common.h"
+
+namespace ldraw
+{
+
+enum compression { compression_none, compression_gzip, compression_zstd };
+
+// Tells compressed data apart by its magic number.
+LIBLDR_EXPORT compression detect_compression(const char *data, std::size_t length);
+
+// true if compressed models can be read and written (libLDR built with zlib)
+LIBLDR_EXPORT bool compression_available();
+
+// Decompresses a gzip stream piece by piece, from memory or from an istream.
+class LIBLDR_EXPORT gzip_reader
+{
+ public:
+  gzip_reader(const char *data, std::size_t length);
+  explicit gzip_reader(std::istream &stream);
+  ~gzip_reader();
+
+  // fills buf with up to length bytes; returns 0 at the end of the stream
+  std::size_t read(char *buf, std::size_t length);
+
+ private:
+  gzip_reader(const gzip_reader &);
+  gzip_reader& operator=(const gzip_reader &);
+
+  void init();
+  bool refill();
+
+  void *m_zstream;
+  std::istream *m_stream;
+  char *m_input;
+  const char *m_data;
+  std::size_t m_remaining;
+  bool m_end;
+};
+
+// Output buffer which gzips everything written through it into another
+// stream. The gzip trailer is written by finish() or the destructor.
+class LIBLDR_EXPORT gzip_streambuf : public std::streambuf
+{
+ public:
+  explicit gzip_streambuf(std::ostream &stream);
+  virtual ~gzip_streambuf();
+
+  void finish();
+
+ protected:
+  virtual int_type overflow(int_type c);
+  virtual int sync();
+
+ private:
+  gzip_streambuf(const gzip_streambuf &);
+  gzip_streambuf& operator=(const gzip_streambuf &);
+
+  bool deflate_buffer(int flush);
+
+  void *m_zstream;
+  std::ostream &m_stream;
+  char *m_buffer;
+  char *m_output;
+  bool m_finished;
+};
+
+}
+
+#endif
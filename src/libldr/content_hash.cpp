@@ -0,0 +1,137 @@
+/* libLDR: Portable and easy-to-use LDraw format abstraction & I/O reference library *
+ * To obtain more information about LDraw, visit http://www.ldraw.org.               *
+ * Distributed in terms of the GNU Lesser General Public License v3                  *
+ *                                                                                   *
+ * Author: (c)2006-2013 Park "segfault" J. K. <mastermind_at_planetmono_dot_org>     */
+
+#include <cstring>
+
+#include "elements.h"
+#include "visitor.h"
+
+#include "content_hash.h"
+
+namespace ldraw
+{
+
+namespace
+{
+
+// murmur3 finalizer
+inline uint64_t mix(uint64_t x)
+{
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ULL;
+  x ^= x >> 33;
+  
+  return x;
+}
+
+inline uint64_t float_bits(float f)
+{
+  uint32_t u;
+  
+  // -0.0 and 0.0 are the same coordinate
+  if (f == 0.0f)
+    f = 0.0f;
+  std::memcpy(&u, &f, sizeof(u));
+  
+  return u;
+}
+
+struct element_hasher
+{
+  uint64_t h;
+  
+  void add(uint64_t v) { h = hash_combine(h, v); }
+  
+  void add(const vector &v)
+  {
+    const float *p = v.get_pointer();
+    add((float_bits(p[0]) << 32) | float_bits(p[1]));
+    add(float_bits(p[2]));
+  }
+  
+  void add(const std::string &s) { add(hash_bytes(s.data(), s.size())); }
+  
+  void operator()(const element_comment &c) { add(c.get_comment()); }
+  void operator()(const element_state &s) { add(s.get_state()); }
+  void operator()(const element_print &p) { add(p.get_string()); }
+  void operator()(const element_bfc &b) { add(b.get_command()); }
+  
+  void operator()(const element_ref &r)
+  {
+    const float *m = r.get_matrix().get_pointer();
+    
+    add(r.get_color().get_id());
+    for (int i = 0; i < 16; i += 2)
+      add((float_bits(m[i]) << 32) | float_bits(m[i + 1]));
+    add(r.filename_atom().folded().str());
+  }
+  
+  void operator()(const element_line &l)
+  {
+    add(l.get_color().get_id());
+    add(l.pos1());
+    add(l.pos2());
+  }
+  
+  void operator()(const element_triangle &t)
+  {
+    add(t.get_color().get_id());
+    add(t.pos1());
+    add(t.pos2());
+    add(t.pos3());
+  }
+  
+  void operator()(const element_quadrilateral &q)
+  {
+    add(q.get_color().get_id());
+    add(q.pos1());
+    add(q.pos2());
+    add(q.pos3());
+    add(q.pos4());
+  }
+  
+  void operator()(const element_condline &l)
+  {
+    add(l.get_color().get_id());
+    add(l.pos1());
+    add(l.pos2());
+    add(l.pos3());
+    add(l.pos4());
+  }
+};
+
+}
+
+uint64_t hash_bytes(const char *data, std::size_t length)
+{
+  // FNV-1a
+  uint64_t h = 0xcbf29ce484222325ULL;
+  
+  for (std::size_t i = 0; i < length; ++i) {
+    h ^= (unsigned char) data[i];
+    h *= 0x100000001b3ULL;
+  }
+  
+  return mix(h);
+}
+
+uint64_t hash_combine(uint64_t seed, uint64_t value)
+{
+  return mix(seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2)));
+}
+
+uint64_t hash_element(const element_base *e)
+{
+  element_hasher h = { (uint64_t) e->get_type() };
+  
+  visit(e, h);
+  
+  return h.h;
+}
+
+}
@@ -0,0 +1,32 @@
+/* libLDR: Portable and easy-to-use LDraw format abstraction & I/O reference library *
+ * To obtain more information about LDraw, visit http://www.ldraw.org.               *
+ * Distributed in terms of the GNU Lesser General Public License v3                  *
+ *                                                                                   *
+ * Author: (c)2006-2013 Park "segfault" J. K. <mastermind_at_planetmono_dot_org>     */
+
+#ifndef _LIBLDR_CONTENT_HASH_H_
+#define _LIBLDR_CONTENT_HASH_H_
+
+#include <cstddef>
+#include <stdint.h>
+
+#include "common.h"
+
+namespace ldraw
+{
+
+class element_base;
+
+// 64-bit hashing used by model::content_hash() and model::hash(). Not
+// cryptographic; values stay the same between runs and platforms.
+LIBLDR_EXPORT uint64_t hash_bytes(const char *data, std::size_t length);
+LIBLDR_EXPORT uint64_t hash_combine(uint64_t seed, uint64_t value);
+
+// What the element looks like to the file: its type, color, coordinates and
+// text. References are hashed by their case-folded filename, not by what
+// they are linked to.
+LIBLDR_EXPORT uint64_t hash_element(const element_base *e);
+
+}
+
+#endif
@@ -7,6 +7,7 @@
 
 #include "model.h"
 #include "part_library.h"
+#include "utils.h"
 
 #include "elements.h"
 
@@ -15,12 +16,14 @@ namespace ldraw {
 element_ref::element_ref(const color &color, const matrix &matrix, const std::string &filename)
   : element_colored_base(color), m_matrix(matrix), m_model(0L), m_parent(0L), m_linkpoint(0L)
 {
+	classify();
 	set_filename(filename);
 }
 
 element_ref::element_ref(element_ref &rhs)
 	: element_colored_base(rhs.get_color()), m_matrix(rhs.get_matrix()),
-   m_model(0L), m_parent(0L), m_linkpoint(rhs.linkpoint())
+   m_model(0L), m_parent(0L), m_linkpoint(rhs.linkpoint()),
+   m_transform_class(rhs.m_transform_class), m_determinant_sign(rhs.m_determinant_sign)
 {
 	set_filename(rhs.filename());
 }
@@ -31,11 +34,50 @@ element_ref::~element_ref()
 		m_linkpoint->unlink_element(this);
 }
 
+void element_ref::set_color(const color &c)
+{
+	m_color = c;
+	changed();
+}
+
+void element_ref::set_matrix(const matrix &m)
+{
+	m_matrix = m;
+	classify();
+	changed();
+}
+
+void element_ref::set_model(model *m)
+{
+	m_model = m;
+	
+	// what the reference leads to is part of model::hash()
+	if (m_parent)
+		m_parent->subtree_changed();
+}
+
+void element_ref::changed()
+{
+	if (m_parent)
+		m_parent->element_changed(this);
+}
+
+void element_ref::classify()
+{
+	m_transform_class = utils::classify_transform(m_matrix);
+	
+	if (m_transform_class == transform_singular)
+		m_determinant_sign = 0;
+	else
+		m_determinant_sign = utils::det3(m_matrix) < 0.0f ? -1 : 1;
+}
+
 void element_ref::set_filename(const std::string &s)
 {
-	m_filename = s;
+	m_filename = atom(s);
 	
 	link();
+	changed();
 }
 
 void element_ref::link()
@@ -61,6 +103,8 @@ void element_ref::operator= (element_ref &rhs)
 	m_model = 0L;
 	m_color = rhs.get_color();
 	m_matrix = rhs.get_matrix();
+	m_transform_class = rhs.m_transform_class;
+	m_determinant_sign = rhs.m_determinant_sign;
 	m_parent = 0L;
 	m_linkpoint = rhs.linkpoint();
 	set_filename(rhs.filename());
@@ -10,26 +10,28 @@
 #include <string>
 
 #include "common.h"
+#include "atom.h"
 #include "color.h"
 #include "math.h"
 
-#define CAST_AS_COMMENT(c)         (dynamic_cast<ldraw::element_comment         *>(c))
-#define CAST_AS_STATE(c)           (dynamic_cast<ldraw::element_state           *>(c))
-#define CAST_AS_PRINT(c)           (dynamic_cast<ldraw::element_print           *>(c))
-#define CAST_AS_REF(c)             (dynamic_cast<ldraw::element_ref             *>(c))
-#define CAST_AS_LINE(c)            (dynamic_cast<ldraw::element_line            *>(c))
-#define CAST_AS_TRIANGLE(c)        (dynamic_cast<ldraw::element_triangle        *>(c))
-#define CAST_AS_QUADRILATERAL(c)   (dynamic_cast<ldraw::element_quadrilateral   *>(c))
-#define CAST_AS_CONDLINE(c)        (dynamic_cast<ldraw::element_condline        *>(c))
+// Checked downcasts; 0L if the element is of another type.
+#define CAST_AS_COMMENT(c)         (ldraw::element_cast<ldraw::element_comment>(c))
+#define CAST_AS_STATE(c)           (ldraw::element_cast<ldraw::element_state>(c))
+#define CAST_AS_PRINT(c)           (ldraw::element_cast<ldraw::element_print>(c))
+#define CAST_AS_REF(c)             (ldraw::element_cast<ldraw::element_ref>(c))
+#define CAST_AS_LINE(c)            (ldraw::element_cast<ldraw::element_line>(c))
+#define CAST_AS_TRIANGLE(c)        (ldraw::element_cast<ldraw::element_triangle>(c))
+#define CAST_AS_QUADRILATERAL(c)   (ldraw::element_cast<ldraw::element_quadrilateral>(c))
+#define CAST_AS_CONDLINE(c)        (ldraw::element_cast<ldraw::element_condline>(c))
 
-#define CAST_AS_CONST_COMMENT(c)         (dynamic_cast<const ldraw::element_comment         *>(c))
-#define CAST_AS_CONST_STATE(c)           (dynamic_cast<const ldraw::element_state           *>(c))
-#define CAST_AS_CONST_PRINT(c)           (dynamic_cast<const ldraw::element_print           *>(c))
-#define CAST_AS_CONST_REF(c)             (dynamic_cast<const ldraw::element_ref             *>(c))
-#define CAST_AS_CONST_LINE(c)            (dynamic_cast<const ldraw::element_line            *>(c))
-#define CAST_AS_CONST_TRIANGLE(c)        (dynamic_cast<const ldraw::element_triangle        *>(c))
-#define CAST_AS_CONST_QUADRILATERAL(c)   (dynamic_cast<const ldraw::element_quadrilateral   *>(c))
-#define CAST_AS_CONST_CONDLINE(c)        (dynamic_cast<const ldraw::element_condline        *>(c))
+#define CAST_AS_CONST_COMMENT(c)         (ldraw::element_cast<const ldraw::element_comment>(c))
+#define CAST_AS_CONST_STATE(c)           (ldraw::element_cast<const ldraw::element_state>(c))
+#define CAST_AS_CONST_PRINT(c)           (ldraw::element_cast<const ldraw::element_print>(c))
+#define CAST_AS_CONST_REF(c)             (ldraw::element_cast<const ldraw::element_ref>(c))
+#define CAST_AS_CONST_LINE(c)            (ldraw::element_cast<const ldraw::element_line>(c))
+#define CAST_AS_CONST_TRIANGLE(c)        (ldraw::element_cast<const ldraw::element_triangle>(c))
+#define CAST_AS_CONST_QUADRILATERAL(c)   (ldraw::element_cast<const ldraw::element_quadrilateral>(c))
+#define CAST_AS_CONST_CONDLINE(c)        (ldraw::element_cast<const ldraw::element_condline>(c))
 
 namespace ldraw
 {
@@ -70,6 +72,18 @@ public:
   virtual unsigned int capabilities() const { return 0; }
 };
 
+// Downcast after comparing the type tag, instead of going through RTTI. T is
+// an element class (possibly const-qualified) carrying a static type_tag.
+template <class T> inline T* element_cast(element_base *e)
+{
+  return (e && e->get_type() == T::type_tag) ? static_cast<T *>(e) : 0L;
+}
+
+template <class T> inline const T* element_cast(const element_base *e)
+{
+  return (e && e->get_type() == T::type_tag) ? static_cast<const T *>(e) : 0L;
+}
+
 // Colored element
 class LIBLDR_EXPORT element_colored_base : public element_base
 {
@@ -80,7 +94,7 @@ public:
   virtual unsigned int capabilities() const { return capability_color; };
   
   const color& get_color() const { return m_color; }
-  void set_color(const color &c) { m_color = c; }
+  virtual void set_color(const color &c) { m_color = c; }
   
 protected:
   color m_color;
@@ -90,6 +104,8 @@ protected:
 class LIBLDR_EXPORT element_comment : public element_base
 {
 public:
+  static const type type_tag = type_comment;
+  
   element_comment(const std::string &s) : m_str(s) {}
   element_comment(const element_comment &c) : element_base(), m_str(c.get_comment()) {}
   ~element_comment() {}
@@ -111,6 +127,7 @@ class LIBLDR_EXPORT element_state : public element_base
 {
 public:
   enum state { state_step, state_pause, state_clear, state_save };
+  static const type type_tag = type_state;
   
   element_state(state s) : element_base(), m_state(s) {}
   element_state(const element_state &s) : element_base(), m_state(s.get_state()) {}
@@ -132,6 +149,8 @@ private:
 class LIBLDR_EXPORT element_print : public element_base
 {
 public:
+  static const type type_tag = type_print;
+  
   element_print(const std::string &s) : element_base(), m_str(s) {}
   element_print(const element_print &p) : element_base(), m_str(p.get_string()) {}
   ~element_print() {}
@@ -152,17 +171,28 @@ private:
 class LIBLDR_EXPORT element_ref : public element_colored_base
 {
 public:
+  static const type type_tag = type_ref;
+  
   element_ref(const color &color, const matrix &matrix, const std::string &filename);
   element_ref(element_ref &rhs);
   ~element_ref();
   
   const matrix& get_matrix() const { return m_matrix; }
-  const std::string& filename() const { return m_filename; }
+  // what kind of transformation the matrix is; worked out when it is set
+  transform_class get_transform_class() const { return (transform_class)m_transform_class; }
+  // sign of the determinant of the matrix: -1 if it mirrors, 0 if singular
+  int determinant_sign() const { return m_determinant_sign; }
+  bool is_mirrored() const { return m_determinant_sign < 0; }
+  bool is_singular() const { return m_transform_class == transform_singular; }
+  const std::string& filename() const { return m_filename.str(); }
+  const atom& filename_atom() const { return m_filename; }
   model* get_model() const { return m_model; }
   model* parent() const { return m_parent; }
   part_library* linkpoint() { return m_linkpoint; }
   
-  void set_matrix(const matrix &m) { m_matrix = m; }
+  // These tell the parent model themselves; see model::element_changed().
+  void set_color(const color &c);
+  void set_matrix(const matrix &m);
   void set_filename(const std::string &s);
   void link();
   
@@ -177,21 +207,27 @@ private:
   friend class part_library;
   friend class reader;
   
-  void set_model(model *m) { m_model = m; }
+  void set_model(model *m);
   void set_parent(model *p) { m_parent = p; }
   void resolve(part_library *l) { m_linkpoint = l; }
+  void classify();
+  void changed();
   
   matrix m_matrix;
-  std::string m_filename;
+  atom m_filename;
   model *m_model;
   model *m_parent;
   part_library *m_linkpoint;
+  unsigned char m_transform_class;
+  signed char m_determinant_sign;
 };
 
 // Line
 class LIBLDR_EXPORT element_line : public element_colored_base
 {
 public:
+  static const type type_tag = type_line;
+  
   element_line(const color &c, const vector &p1, const vector &p2) :
       element_colored_base(c), m_pos1(p1), m_pos2(p2) {}
   element_line(const element_line &l) :
@@ -217,6 +253,8 @@ private:
 class LIBLDR_EXPORT element_triangle : public element_colored_base
 {
 public:
+  static const type type_tag = type_triangle;
+  
   element_triangle(const color &c, const vector &p1, const vector &p2, const vector &p3) :
       element_colored_base(c), m_pos1(p1), m_pos2(p2), m_pos3(p3) {}
   element_triangle(const element_triangle &t) :
@@ -243,6 +281,8 @@ private:
 class LIBLDR_EXPORT element_quadrilateral : public element_colored_base
 {
 public:
+  static const type type_tag = type_quadrilateral;
+  
   element_quadrilateral(const color &c, const vector &p1, const vector &p2, const vector &p3, const vector &p4) :
       element_colored_base(c), m_pos1(p1), m_pos2(p2), m_pos3(p3), m_pos4(p4) {}
   element_quadrilateral(const element_quadrilateral &q) :
@@ -271,6 +311,8 @@ private:
 class LIBLDR_EXPORT element_condline : public element_colored_base
 {
 public:
+  static const type type_tag = type_condline;
+  
   element_condline(const color &c, const vector &p1, const vector &p2, const vector &p3, const vector &p4) :
       element_colored_base(c), m_pos1(p1), m_pos2(p2), m_pos3(p3), m_pos4(p4) {}
   element_condline(const element_condline &l) :
@@ -0,0 +1,51 @@
+/* libLDR: Portable and easy-to-use LDraw format abstraction & I/O reference library *
+ * To obtain more information about LDraw, visit http://www.ldraw.org.               *
+ * Distributed in terms of the GNU Lesser General Public License v3                  *
+ *                                                                                   *
+ * Author: (c)2006-2013 Park "segfault" J. K. <mastermind_at_planetmono_dot_org>     */
+
+#include <map>
+
+#include "common.h"
+#include "exception.h"
+
+#include "extension.h"
+
+namespace ldraw
+{
+
+namespace
+{
+
+// function-local so that it is ready for whichever static initializer asks first
+std::map<std::string, int>& slots()
+{
+  static std::map<std::string, int> s;
+  return s;
+}
+
+}
+
+int extension_registry::assign(const std::string &identifier)
+{
+  std::map<std::string, int> &s = slots();
+  std::map<std::string, int>::const_iterator it = s.find(identifier);
+
+  if (it != s.end())
+    return (*it).second;
+
+  if ((int)s.size() >= max_slots)
+    throw exception(__func__, exception::fatal, "too many extension types: " + identifier);
+
+  int slot = (int)s.size();
+  s[identifier] = slot;
+
+  return slot;
+}
+
+int extension_registry::size()
+{
+  return (int)slots().size();
+}
+
+}
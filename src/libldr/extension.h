@@ -7,6 +7,8 @@
 #ifndef _LIBLDR_EXTENSION_H_
 #define _LIBLDR_EXTENSION_H_
 
+#include <string>
+
 #include "common.h"
 
 namespace ldraw
@@ -29,6 +31,26 @@ class LIBLDR_EXPORT extension
 	void *m_arg;
 };
 
+// Hands out a dense slot number to every extension identifier, so that models
+// can keep their extensions in a plain array. The same identifier always maps
+// to the same slot, even if several modules instantiate extension_slot<T>.
+class LIBLDR_EXPORT extension_registry
+{
+  public:
+	static const int max_slots = 16;
+
+	static int assign(const std::string &identifier);
+	static int size();
+};
+
+// Slot of extension class T, assigned during static initialization.
+template <class T> struct extension_slot
+{
+	static const int index;
+};
+
+template <class T> const int extension_slot<T>::index = extension_registry::assign(T::identifier());
+
 }
 
 #endif
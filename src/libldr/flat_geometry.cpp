@@ -0,0 +1,260 @@
+/* libLDR: Portable and easy-to-use LDraw format abstraction & I/O reference library *
+ * To obtain more information about LDraw, visit http://www.ldraw.org.               *
+ * Distributed in terms of the GNU Lesser General Public License v3                  *
+ *                                                                                   *
+ * Author: (c)2006-2013 Park "segfault" J. K. <mastermind_at_planetmono_dot_org>     */
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <map>
+#include <thread>
+
+#include "elements.h"
+#include "geometry_store.h"
+#include "model.h"
+
+#include "flat_geometry.h"
+
+namespace ldraw
+{
+
+namespace
+{
+
+// primitives of the root model handed out to a thread at once
+const int slice_size = 16384;
+
+// what each geometry_store stream turns into, and how many of it
+const struct { flat_geometry::primitive target; int count; } mapping[] = {
+  { flat_geometry::lines, 1 },
+  { flat_geometry::triangles, 1 },
+  { flat_geometry::triangles, 2 },
+  { flat_geometry::condlines, 1 }
+};
+
+struct counts
+{
+  std::size_t n[flat_geometry::primitive_count];
+};
+
+// Primitives under m, each model counted once. Also builds the geometry of
+// every model on the way, so that the workers only ever read it.
+const counts& count(const model *m, std::map<const model *, counts> &memo)
+{
+  std::map<const model *, counts>::iterator it = memo.find(m);
+  if (it != memo.end())
+    return (*it).second;
+  
+  counts c = {};
+  const geometry_store &g = m->geometry();
+  
+  for (int p = 0; p < geometry_store::primitive_count; ++p)
+    c.n[mapping[p].target] += (std::size_t) g.get((geometry_store::primitive)p).size() * mapping[p].count;
+  
+  for (std::vector<int>::const_iterator rit = g.refs().begin(); rit != g.refs().end(); ++rit) {
+    const model *sub = CAST_AS_CONST_REF(m->elements()[*rit])->get_model();
+    
+    if (sub) {
+      const counts &s = count(sub, memo);
+      for (int p = 0; p < flat_geometry::primitive_count; ++p)
+        c.n[p] += s.n[p];
+    }
+  }
+  
+  return memo[m] = c;
+}
+
+// color a reference passes on to its contents
+inline unsigned int inherit(const element_ref *r, unsigned int current)
+{
+  unsigned int id = r->get_color().get_id();
+  
+  return (id == 16 || id == 24) ? current : id;
+}
+
+inline const unsigned char* resolve_rgba(unsigned int id, unsigned int current)
+{
+  if (id == 16)
+    return color(current).get_entity()->rgba;
+  else if (id == 24)
+    return color(current).get_entity()->complement;
+  
+  return color(id).get_entity()->rgba;
+}
+
+// Either a reference of the root model with everything below it, or a slice
+// of the root model's own primitives. Writes from offset on.
+struct task
+{
+  const element_ref *ref;
+  geometry_store::primitive p;
+  int begin, end;
+  std::size_t offset[flat_geometry::primitive_count];
+};
+
+struct worker
+{
+  flat_geometry::stream *out;
+  const model *root;
+  const matrix *transform;
+  unsigned int base;
+  const std::vector<task> *tasks;
+  std::atomic<int> *next;
+  
+  float *pos[flat_geometry::primitive_count];
+  unsigned char *col[flat_geometry::primitive_count];
+  
+  void run()
+  {
+    int i;
+    
+    while ((i = (*next)++) < (int) tasks->size()) {
+      const task &t = (*tasks)[i];
+      
+      for (int p = 0; p < flat_geometry::primitive_count; ++p) {
+        pos[p] = out[p].positions.empty() ? 0L : &out[p].positions[t.offset[p] * out[p].vertices * 3];
+        col[p] = out[p].colors.empty() ? 0L : &out[p].colors[t.offset[p] * 4];
+      }
+      
+      if (t.ref)
+        emit_model(t.ref->get_model(), *transform * t.ref->get_matrix(), inherit(t.ref, base));
+      else
+        emit_range(root->geometry(), t.p, t.begin, t.end, *transform, base);
+    }
+  }
+  
+  void emit_model(const model *m, const matrix &transform, unsigned int current)
+  {
+    const geometry_store &g = m->geometry();
+    
+    for (int p = 0; p < geometry_store::primitive_count; ++p)
+      emit_range(g, (geometry_store::primitive)p, 0, g.get((geometry_store::primitive)p).size(), transform, current);
+    
+    for (std::vector<int>::const_iterator it = g.refs().begin(); it != g.refs().end(); ++it) {
+      const element_ref *r = CAST_AS_CONST_REF(m->elements()[*it]);
+      
+      if (r->get_model())
+        emit_model(r->get_model(), transform * r->get_matrix(), inherit(r, current));
+    }
+  }
+  
+  void emit_range(const geometry_store &g, geometry_store::primitive p, int begin, int end, const matrix &transform, unsigned int current)
+  {
+    const geometry_store::stream &s = g.get(p);
+    float *&dp = pos[mapping[p].target];
+    unsigned char *&dc = col[mapping[p].target];
+    
+    if (begin == end)
+      return;
+    
+    if (p == geometry_store::quads) {
+      // (1, 2, 3) and (1, 3, 4)
+      static const int split[] = { 0, 1, 2, 0, 2, 3 };
+      float q[12];
+      
+      for (int i = begin; i < end; ++i) {
+        transform.transform(s.position(i, 0), q, 4);
+        for (int v = 0; v < 6; ++v, dp += 3)
+          std::memcpy(dp, &q[split[v] * 3], sizeof(float) * 3);
+      }
+    } else {
+      std::size_t n = (std::size_t) (end - begin) * s.vertices;
+      
+      transform.transform(s.position(begin, 0), dp, n);
+      dp += n * 3;
+    }
+    
+    // colors mostly come in runs
+    unsigned int lastid = 0;
+    const unsigned char *rgba = 0L;
+    
+    for (int i = begin; i < end; ++i) {
+      if (!rgba || s.colors[i] != lastid) {
+        lastid = s.colors[i];
+        rgba = resolve_rgba(lastid, current);
+      }
+      
+      for (int k = 0; k < mapping[p].count; ++k, dc += 4)
+        std::memcpy(dc, rgba, 4);
+    }
+  }
+};
+
+}
+
+flat_geometry::flat_geometry()
+{
+  m_streams[lines].vertices = 2;
+  m_streams[triangles].vertices = 3;
+  m_streams[condlines].vertices = 4;
+}
+
+void flat_geometry::build(const model *m, const matrix &transform, const ldraw::color &c, int threads)
+{
+  std::map<const model *, counts> memo;
+  const counts &total = count(m, memo);
+  const geometry_store &g = m->geometry();
+  
+  std::vector<task> tasks;
+  std::size_t offset[primitive_count] = {};
+  
+  // the root's own primitives first, then its references in order; output
+  // is the same however many threads run
+  for (int p = 0; p < geometry_store::primitive_count; ++p) {
+    int size = g.get((geometry_store::primitive)p).size();
+    
+    for (int begin = 0; begin < size; begin += slice_size) {
+      task t = { 0L, (geometry_store::primitive)p, begin, std::min(size, begin + slice_size), {} };
+      
+      std::copy(offset, offset + primitive_count, t.offset);
+      offset[mapping[p].target] += (std::size_t) (t.end - t.begin) * mapping[p].count;
+      tasks.push_back(t);
+    }
+  }
+  
+  for (std::vector<int>::const_iterator it = g.refs().begin(); it != g.refs().end(); ++it) {
+    const element_ref *r = CAST_AS_CONST_REF(m->elements()[*it]);
+    
+    if (r->get_model()) {
+      task t = { r, geometry_store::lines, 0, 0, {} };
+      const counts &s = memo[r->get_model()];
+      
+      std::copy(offset, offset + primitive_count, t.offset);
+      for (int p = 0; p < primitive_count; ++p)
+        offset[p] += s.n[p];
+      tasks.push_back(t);
+    }
+  }
+  
+  for (int p = 0; p < primitive_count; ++p) {
+    m_streams[p].positions.resize(total.n[p] * m_streams[p].vertices * 3);
+    m_streams[p].colors.resize(total.n[p] * 4);
+  }
+  
+  if (threads <= 0)
+    threads = std::max(1, (int) std::thread::hardware_concurrency());
+  threads = std::max(1, std::min(threads, (int) tasks.size()));
+  
+  std::atomic<int> next(0);
+  worker w = { m_streams, m, &transform, c.get_id(), &tasks, &next, {}, {} };
+  
+  // every worker writes to ranges of its own
+  std::vector<worker> workers(threads, w);
+  std::vector<std::thread> pool;
+  for (int i = 1; i < threads; ++i)
+    pool.push_back(std::thread(&worker::run, &workers[i]));
+  workers[0].run();
+  for (std::vector<std::thread>::iterator it = pool.begin(); it != pool.end(); ++it)
+    (*it).join();
+}
+
+void flat_geometry::clear()
+{
+  for (int i = 0; i < primitive_count; ++i) {
+    std::vector<float>().swap(m_streams[i].positions);
+    std::vector<unsigned char>().swap(m_streams[i].colors);
+  }
+}
+
+}
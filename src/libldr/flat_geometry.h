@@ -0,0 +1,64 @@
+/* libLDR: Portable and easy-to-use LDraw format abstraction & I/O reference library *
+ * To obtain more information about LDraw, visit http://www.ldraw.org.               *
+ * Distributed in terms of the GNU Lesser General Public License v3                  *
+ *                                                                                   *
+ * Author: (c)2006-2013 Park "segfault" J. K. <mastermind_at_planetmono_dot_org>     */
+
+#ifndef _LIBLDR_FLAT_GEOMETRY_H_
+#define _LIBLDR_FLAT_GEOMETRY_H_
+
+#include <cstddef>
+#include <vector>
+
+#include "color.h"
+#include "common.h"
+#include "math.h"
+
+namespace ldraw
+{
+
+class model;
+
+/* World-space copy of every line, triangle and conditional line of a model
+ * and of all models referenced from it, with colors 16 and 24 resolved
+ * against the enclosing references. Quads come out as two triangles.
+ * Meant for exporters and anything else that would otherwise walk the
+ * hierarchy with a matrix stack of its own.
+ *
+ *   flat_geometry g;
+ *   g.build(model);
+ *   const flat_geometry::stream &t = g.get(flat_geometry::triangles);
+ */
+class LIBLDR_EXPORT flat_geometry
+{
+ public:
+  enum primitive { lines, triangles, condlines, primitive_count };
+
+  struct stream
+  {
+    int vertices;                  // per primitive
+    std::vector<float> positions;  // x, y, z of every vertex
+    std::vector<unsigned char> colors;  // RGBA of every primitive
+
+    int size() const { return (int)(colors.size() / 4); }
+    const float* position(int i, int v) const { return &positions[(i * vertices + v) * 3]; }
+    const unsigned char* color(int i) const { return &colors[i * 4]; }
+  };
+
+  flat_geometry();
+
+  const stream& get(primitive p) const { return m_streams[p]; }
+
+  // Replaces the contents with the geometry of m placed by transform, in
+  // color c. The references of m are distributed over the given number of
+  // threads; 0 uses one per core, 1 does all of the work on the caller.
+  void build(const model *m, const matrix &transform = matrix(), const ldraw::color &c = ldraw::color(16), int threads = 0);
+  void clear();
+
+ private:
+  stream m_streams[primitive_count];
+};
+
+}
+
+#endif
@@ -0,0 +1,91 @@
+/* libLDR: Portable and easy-to-use LDraw format abstraction & I/O reference library *
+ * To obtain more information about LDraw, visit http://www.ldraw.org.               *
+ * Distributed in terms of the GNU Lesser General Public License v3                  *
+ *                                                                                   *
+ * Author: (c)2006-2013 Park "segfault" J. K. <mastermind_at_planetmono_dot_org>     */
+
+#include <cmath>
+
+#include "metrics.h"
+
+#include "frustum.h"
+
+namespace ldraw
+{
+
+frustum::frustum(const matrix &transform)
+{
+  init(transform, -1.0f, -1.0f, 1.0f, 1.0f);
+}
+
+frustum::frustum(const matrix &transform, float x0, float y0, float x1, float y1)
+{
+  init(transform, x0, y0, x1, y1);
+}
+
+// Each bound on x/w, y/w or z/w is a linear inequality in the rows of the
+// transform, so the planes come straight out of them.
+void frustum::init(const matrix &transform, float x0, float y0, float x1, float y1)
+{
+  const float bounds[6][3] = {
+    // row, factor of the row, factor of the w row
+    { 0,  1.0f, -x0 },
+    { 0, -1.0f,  x1 },
+    { 1,  1.0f, -y0 },
+    { 1, -1.0f,  y1 },
+    { 2,  1.0f, 1.0f },
+    { 2, -1.0f, 1.0f }
+  };
+
+  for (int i = 0; i < 6; ++i) {
+    int r = (int) bounds[i][0];
+
+    for (int j = 0; j < 4; ++j)
+      m_planes[i][j] = bounds[i][1] * transform.value(r, j) + bounds[i][2] * transform.value(3, j);
+  }
+}
+
+frustum::containment frustum::test(const float *min, const float *max) const
+{
+  containment result = inside;
+
+  for (int i = 0; i < 6; ++i) {
+    const float *p = m_planes[i];
+    float s = p[3], r = 0.0f;
+
+    for (int j = 0; j < 3; ++j) {
+      s += p[j] * (min[j] + max[j]) * 0.5f;
+      r += std::fabs(p[j]) * (max[j] - min[j]) * 0.5f;
+    }
+
+    if (s < -r)
+      return outside;
+    else if (s < r)
+      result = intersecting;
+  }
+
+  return result;
+}
+
+frustum::containment frustum::test(const oriented_box &box) const
+{
+  containment result = inside;
+
+  for (int i = 0; i < 6; ++i) {
+    const float *p = m_planes[i];
+    float s = p[0] * box.center.x() + p[1] * box.center.y() + p[2] * box.center.z() + p[3];
+    float r = 0.0f;
+
+    for (int j = 0; j < 3; ++j)
+      r += std::fabs(p[0] * box.axes[j].x() + p[1] * box.axes[j].y() + p[2] * box.axes[j].z());
+
+    if (s < -r)
+      return outside;
+    else if (s < r)
+      result = intersecting;
+  }
+
+  return result;
+}
+
+}
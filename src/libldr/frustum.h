@@ -0,0 +1,46 @@
+/* libLDR: Portable and easy-to-use LDraw format abstraction & I/O reference library *
+ * To obtain more information about LDraw, visit http://www.ldraw.org.               *
+ * Distributed in terms of the GNU Lesser General Public License v3                  *
+ *                                                                                   *
+ * Author: (c)2006-2013 Park "segfault" J. K. <mastermind_at_planetmono_dot_org>     */
+
+#ifndef _LIBLDR_FRUSTUM_H_
+#define _LIBLDR_FRUSTUM_H_
+
+#include "common.h"
+#include "math.h"
+
+namespace ldraw
+{
+
+struct oriented_box;
+
+// Convex volume bounded by six planes, such as what a camera sees.
+class LIBLDR_EXPORT frustum
+{
+ public:
+  enum containment { outside, intersecting, inside };
+
+  // Points p for which (x, y, z, w) = transform * p satisfies -w <= x, y, z
+  // <= w, i.e. transform maps into clip space like projection * modelview.
+  explicit frustum(const matrix &transform);
+  // The part of the above that falls within [x0, x1] x [y0, y1] in
+  // normalized device coordinates, e.g. a rectangle on screen.
+  frustum(const matrix &transform, float x0, float y0, float x1, float y1);
+
+  containment test(const float *min, const float *max) const;
+  containment test(const vector &min, const vector &max) const { return test(min.get_pointer(), max.get_pointer()); }
+  containment test(const oriented_box &box) const;
+
+  // a, b, c, d such that a*x + b*y + c*z + d >= 0 inside
+  const float* plane(int i) const { return m_planes[i]; }
+
+ private:
+  void init(const matrix &transform, float x0, float y0, float x1, float y1);
+
+  float m_planes[6][4];
+};
+
+}
+
+#endif
@@ -0,0 +1,91 @@
+/* libLDR: Portable and easy-to-use LDraw format abstraction & I/O reference library *
+ * To obtain more information about LDraw, visit http://www.ldraw.org.               *
+ * Distributed in terms of the GNU Lesser General Public License v3                  *
+ *                                                                                   *
+ * Author: (c)2006-2013 Park "segfault" J. K. <mastermind_at_planetmono_dot_org>     */
+
+#include "elements.h"
+#include "visitor.h"
+
+#include "geometry_store.h"
+
+namespace ldraw
+{
+
+geometry_store::geometry_store()
+{
+  m_streams[lines].vertices = 2;
+  m_streams[triangles].vertices = 3;
+  m_streams[quads].vertices = 4;
+  m_streams[condlines].vertices = 4;
+}
+
+namespace
+{
+
+struct appender
+{
+  geometry_store *g;
+  int index;
+
+  void operator()(const element_line &l)
+  {
+    vector v[] = { l.pos1(), l.pos2() };
+    g->append(geometry_store::lines, v, l.get_color().get_id(), index);
+  }
+
+  void operator()(const element_triangle &l)
+  {
+    vector v[] = { l.pos1(), l.pos2(), l.pos3() };
+    g->append(geometry_store::triangles, v, l.get_color().get_id(), index);
+  }
+
+  void operator()(const element_quadrilateral &l)
+  {
+    vector v[] = { l.pos1(), l.pos2(), l.pos3(), l.pos4() };
+    g->append(geometry_store::quads, v, l.get_color().get_id(), index);
+  }
+
+  void operator()(const element_condline &l)
+  {
+    vector v[] = { l.pos1(), l.pos2(), l.pos3(), l.pos4() };
+    g->append(geometry_store::condlines, v, l.get_color().get_id(), index);
+  }
+
+  void operator()(const element_ref &) { g->append_ref(index); }
+  void operator()(const element_base &) {}
+};
+
+}
+
+void geometry_store::append(const element_base *e, int index)
+{
+  appender a = { this, index };
+
+  visit(e, a);
+}
+
+void geometry_store::append(primitive p, const vector *v, unsigned int color, int index)
+{
+  stream &s = m_streams[p];
+
+  for (int i = 0; i < s.vertices; ++i)
+    s.positions.insert(s.positions.end(), v[i].get_pointer(), v[i].get_pointer() + 3);
+
+  s.colors.push_back(color);
+  s.indices.push_back(index);
+}
+
+void geometry_store::clear()
+{
+  // give the memory back, too
+  for (int i = 0; i < primitive_count; ++i) {
+    std::vector<float>().swap(m_streams[i].positions);
+    std::vector<unsigned int>().swap(m_streams[i].colors);
+    std::vector<int>().swap(m_streams[i].indices);
+  }
+
+  std::vector<int>().swap(m_refs);
+}
+
+}
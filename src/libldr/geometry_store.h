@@ -0,0 +1,60 @@
+/* libLDR: Portable and easy-to-use LDraw format abstraction & I/O reference library *
+ * To obtain more information about LDraw, visit http://www.ldraw.org.               *
+ * Distributed in terms of the GNU Lesser General Public License v3                  *
+ *                                                                                   *
+ * Author: (c)2006-2013 Park "segfault" J. K. <mastermind_at_planetmono_dot_org>     */
+
+#ifndef _LIBLDR_GEOMETRY_STORE_H_
+#define _LIBLDR_GEOMETRY_STORE_H_
+
+#include <vector>
+
+#include "common.h"
+#include "math.h"
+
+namespace ldraw
+{
+
+class element_base;
+
+// Dense copy of the drawable elements of a model, sorted by type. Meant for
+// consumers that run through every line or triangle of a model and do not
+// care how they are interleaved with the other elements; indices lead back
+// to model::elements(). Obtained through model::geometry().
+class LIBLDR_EXPORT geometry_store
+{
+ public:
+  enum primitive { lines, triangles, quads, condlines, primitive_count };
+
+  struct stream
+  {
+    int vertices;                  // per primitive
+    std::vector<float> positions;  // x, y, z of every vertex
+    std::vector<unsigned int> colors;
+    std::vector<int> indices;
+
+    int size() const { return (int)indices.size(); }
+    const float* position(int i, int v) const { return &positions[(i * vertices + v) * 3]; }
+    vector vertex(int i, int v) const { const float *p = position(i, v); return vector(p[0], p[1], p[2]); }
+  };
+
+  geometry_store();
+
+  const stream& get(primitive p) const { return m_streams[p]; }
+
+  // indices of the references
+  const std::vector<int>& refs() const { return m_refs; }
+
+  void append(const element_base *e, int index);
+  void append(primitive p, const vector *v, unsigned int color, int index);
+  void append_ref(int index) { m_refs.push_back(index); }
+  void clear();
+
+ private:
+  stream m_streams[primitive_count];
+  std::vector<int> m_refs;
+};
+
+}
+
+#endif
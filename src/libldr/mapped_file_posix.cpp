@@ -0,0 +1,91 @@
+/* libLDR: Portable and easy-to-use LDraw format abstraction & I/O reference library *
+ * To obtain more information about LDraw, visit http://www.ldraw.org.               *
+ * Distributed in terms of the GNU Lesser General Public License v3                  *
+ *                                                                                   *
+ * Author: (c)2006-2013 Park "segfault" J. K. <mastermind_at_planetmono_dot_org>     */
+
+#ifndef _MSC_VER
+
+/* platform-specific file mapping for POSIX compatible systems */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mapped_file.h"
+
+namespace ldraw
+{
+
+static const char empty_mapping[] = "";
+
+mapped_file::mapped_file()
+    : m_data(0L), m_size(0), m_open(false), m_file(0L), m_mapping(0L)
+{
+}
+
+mapped_file::mapped_file(const std::string &path)
+    : m_data(0L), m_size(0), m_open(false), m_file(0L), m_mapping(0L)
+{
+  open(path);
+}
+
+mapped_file::~mapped_file()
+{
+  close();
+}
+
+bool mapped_file::open(const std::string &path)
+{
+  close();
+
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    ::close(fd);
+    return false;
+  }
+
+  // mmap() refuses zero-length mappings
+  if (st.st_size == 0) {
+    ::close(fd);
+    m_data = empty_mapping;
+    m_size = 0;
+    m_open = true;
+    return true;
+  }
+
+  void *p = mmap(0L, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+
+  if (p == MAP_FAILED)
+    return false;
+
+#ifdef MADV_SEQUENTIAL
+  madvise(p, st.st_size, MADV_SEQUENTIAL);
+#endif
+
+  m_data = static_cast<const char *>(p);
+  m_size = st.st_size;
+  m_open = true;
+
+  return true;
+}
+
+void mapped_file::close()
+{
+  if (m_open && m_size > 0)
+    munmap(const_cast<char *>(m_data), m_size);
+
+  m_data = 0L;
+  m_size = 0;
+  m_open = false;
+}
+
+}
+
+#endif
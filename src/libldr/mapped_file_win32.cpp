@@ -0,0 +1,98 @@
+/* libLDR: Portable and easy-to-use LDraw format abstraction & I/O reference library *
+ * To obtain more information about LDraw, visit http://www.ldraw.org.               *
+ * Distributed in terms of the GNU Lesser General Public License v3                  *
+ *                                                                                   *
+ * Author: (c)2006-2013 Park "segfault" J. K. <mastermind_at_planetmono_dot_org>     */
+
+#ifdef _MSC_VER
+
+/* platform-specific file mapping for MSVC compiler */
+
+#include <Windows.h>
+
+#include "mapped_file.h"
+
+namespace ldraw
+{
+
+static const char empty_mapping[] = "";
+
+mapped_file::mapped_file()
+    : m_data(0L), m_size(0), m_open(false), m_file(0L), m_mapping(0L)
+{
+}
+
+mapped_file::mapped_file(const std::string &path)
+    : m_data(0L), m_size(0), m_open(false), m_file(0L), m_mapping(0L)
+{
+  open(path);
+}
+
+mapped_file::~mapped_file()
+{
+  close();
+}
+
+bool mapped_file::open(const std::string &path)
+{
+  close();
+
+  HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, 0L, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0L);
+  if (file == INVALID_HANDLE_VALUE)
+    return false;
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size)) {
+    CloseHandle(file);
+    return false;
+  }
+
+  // CreateFileMapping() refuses zero-length mappings
+  if (size.QuadPart == 0) {
+    CloseHandle(file);
+    m_data = empty_mapping;
+    m_size = 0;
+    m_open = true;
+    return true;
+  }
+
+  HANDLE mapping = CreateFileMappingA(file, 0L, PAGE_READONLY, 0, 0, 0L);
+  if (!mapping) {
+    CloseHandle(file);
+    return false;
+  }
+
+  void *p = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  if (!p) {
+    CloseHandle(mapping);
+    CloseHandle(file);
+    return false;
+  }
+
+  m_file = file;
+  m_mapping = mapping;
+  m_data = static_cast<const char *>(p);
+  m_size = (std::size_t) size.QuadPart;
+  m_open = true;
+
+  return true;
+}
+
+void mapped_file::close()
+{
+  if (m_open && m_size > 0) {
+    UnmapViewOfFile(m_data);
+    CloseHandle(m_mapping);
+    CloseHandle(m_file);
+  }
+
+  m_file = 0L;
+  m_mapping = 0L;
+  m_data = 0L;
+  m_size = 0;
+  m_open = false;
+}
+
+}
+
+#endif
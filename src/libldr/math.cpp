@@ -6,6 +6,15 @@
 
 #include <cmath>
 
+// SSE is part of every x86-64 target; NEON of every AArch64 one
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define LIBLDR_SIMD_SSE
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define LIBLDR_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
 #include "math.h"
 
 namespace ldraw
@@ -135,11 +144,42 @@ matrix matrix::operator- (const matrix &m) const
   return out;
 }
 
+// The SIMD kernels below add up the products in the same order as the
+// scalar code, so they give bit-identical results.
+
 // Matrix-by-matrix Multiplication
 matrix matrix::operator* (const matrix &m) const
 {
   matrix n;
   
+#if defined(LIBLDR_SIMD_SSE)
+  __m128 b0 = _mm_loadu_ps(m.m_matrix[0]);
+  __m128 b1 = _mm_loadu_ps(m.m_matrix[1]);
+  __m128 b2 = _mm_loadu_ps(m.m_matrix[2]);
+  __m128 b3 = _mm_loadu_ps(m.m_matrix[3]);
+  
+  // row i of the product is the rows of m weighted by row i of this
+  for (int i = 0; i < 4; i++) {
+    __m128 r = _mm_mul_ps(_mm_set1_ps(value(i, 0)), b0);
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(value(i, 1)), b1));
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(value(i, 2)), b2));
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(value(i, 3)), b3));
+    _mm_storeu_ps(n.m_matrix[i], r);
+  }
+#elif defined(LIBLDR_SIMD_NEON)
+  float32x4_t b0 = vld1q_f32(m.m_matrix[0]);
+  float32x4_t b1 = vld1q_f32(m.m_matrix[1]);
+  float32x4_t b2 = vld1q_f32(m.m_matrix[2]);
+  float32x4_t b3 = vld1q_f32(m.m_matrix[3]);
+  
+  for (int i = 0; i < 4; i++) {
+    float32x4_t r = vmulq_n_f32(b0, value(i, 0));
+    r = vaddq_f32(r, vmulq_n_f32(b1, value(i, 1)));
+    r = vaddq_f32(r, vmulq_n_f32(b2, value(i, 2)));
+    r = vaddq_f32(r, vmulq_n_f32(b3, value(i, 3)));
+    vst1q_f32(n.m_matrix[i], r);
+  }
+#else
   for (int i = 0; i < 4; i++) {
     for (int j = 0; j < 4; j++) {
       n.value(i, j) = 0.0f;
@@ -147,6 +187,7 @@ matrix matrix::operator* (const matrix &m) const
         n.value(i, j) += value(i, k) * m.value(k, j);
     }
   }
+#endif
   
   return n;
 }
@@ -154,11 +195,39 @@ matrix matrix::operator* (const matrix &m) const
 // Linear transform
 vector matrix::operator* (const vector &v) const
 {
+#if defined(LIBLDR_SIMD_SSE)
+  __m128 x = _mm_loadu_ps(v.get_pointer());
+  __m128 r0 = _mm_mul_ps(_mm_loadu_ps(m_matrix[0]), x);
+  __m128 r1 = _mm_mul_ps(_mm_loadu_ps(m_matrix[1]), x);
+  __m128 r2 = _mm_mul_ps(_mm_loadu_ps(m_matrix[2]), x);
+  __m128 r3 = _mm_setzero_ps();
+  
+  // column k now holds the k-th product of every row
+  _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+  
+  float out[4];
+  _mm_storeu_ps(out, _mm_add_ps(_mm_add_ps(_mm_add_ps(r0, r1), r2), r3));
+  
+  return vector(out[0], out[1], out[2]);
+#elif defined(LIBLDR_SIMD_NEON)
+  // vld4q deinterleaves the rows into columns
+  float32x4x4_t c = vld4q_f32(&m_matrix[0][0]);
+  float32x4_t r = vmulq_n_f32(c.val[0], v.x());
+  r = vaddq_f32(r, vmulq_n_f32(c.val[1], v.y()));
+  r = vaddq_f32(r, vmulq_n_f32(c.val[2], v.z()));
+  r = vaddq_f32(r, vmulq_n_f32(c.val[3], v.w()));
+  
+  float out[4];
+  vst1q_f32(out, r);
+  
+  return vector(out[0], out[1], out[2]);
+#else
   return vector(
       value(0, 0)*v.x() + value(0, 1)*v.y() + value(0, 2)*v.z() + value(0, 3)*v.w(),
       value(1, 0)*v.x() + value(1, 1)*v.y() + value(1, 2)*v.z() + value(1, 3)*v.w(),
       value(2, 0)*v.x() + value(2, 1)*v.y() + value(2, 2)*v.z() + value(2, 3)*v.w()
                 );
+#endif
 }
 
 // Scalar multiplication
@@ -177,6 +246,90 @@ matrix matrix::operator* (const int &f) const
 // Matrix Inversion
 matrix matrix::operator~() const
 {
+#if defined(LIBLDR_SIMD_SSE)
+  // Cramer's rule on four lanes at once, after Intel's "Streaming SIMD
+  // Extensions - Inverse of 4x4 Matrix" (AP-928)
+  const float *src = get_pointer();
+  __m128 minor0, minor1, minor2, minor3;
+  __m128 row0, row1 = _mm_setzero_ps(), row2, row3 = _mm_setzero_ps();
+  __m128 det, tmp1 = _mm_setzero_ps();
+  matrix dst;
+  
+  // transpose, with rows 1 and 3 rotated by two
+  tmp1 = _mm_loadh_pi(_mm_loadl_pi(tmp1, (const __m64 *)(src)), (const __m64 *)(src + 4));
+  row1 = _mm_loadh_pi(_mm_loadl_pi(row1, (const __m64 *)(src + 8)), (const __m64 *)(src + 12));
+  row0 = _mm_shuffle_ps(tmp1, row1, 0x88);
+  row1 = _mm_shuffle_ps(row1, tmp1, 0xDD);
+  tmp1 = _mm_loadh_pi(_mm_loadl_pi(tmp1, (const __m64 *)(src + 2)), (const __m64 *)(src + 6));
+  row3 = _mm_loadh_pi(_mm_loadl_pi(row3, (const __m64 *)(src + 10)), (const __m64 *)(src + 14));
+  row2 = _mm_shuffle_ps(tmp1, row3, 0x88);
+  row3 = _mm_shuffle_ps(row3, tmp1, 0xDD);
+  
+  tmp1 = _mm_mul_ps(row2, row3);
+  tmp1 = _mm_shuffle_ps(tmp1, tmp1, 0xB1);
+  minor0 = _mm_mul_ps(row1, tmp1);
+  minor1 = _mm_mul_ps(row0, tmp1);
+  tmp1 = _mm_shuffle_ps(tmp1, tmp1, 0x4E);
+  minor0 = _mm_sub_ps(_mm_mul_ps(row1, tmp1), minor0);
+  minor1 = _mm_sub_ps(_mm_mul_ps(row0, tmp1), minor1);
+  minor1 = _mm_shuffle_ps(minor1, minor1, 0x4E);
+  
+  tmp1 = _mm_mul_ps(row1, row2);
+  tmp1 = _mm_shuffle_ps(tmp1, tmp1, 0xB1);
+  minor0 = _mm_add_ps(_mm_mul_ps(row3, tmp1), minor0);
+  minor3 = _mm_mul_ps(row0, tmp1);
+  tmp1 = _mm_shuffle_ps(tmp1, tmp1, 0x4E);
+  minor0 = _mm_sub_ps(minor0, _mm_mul_ps(row3, tmp1));
+  minor3 = _mm_sub_ps(_mm_mul_ps(row0, tmp1), minor3);
+  minor3 = _mm_shuffle_ps(minor3, minor3, 0x4E);
+  
+  tmp1 = _mm_mul_ps(_mm_shuffle_ps(row1, row1, 0x4E), row3);
+  tmp1 = _mm_shuffle_ps(tmp1, tmp1, 0xB1);
+  row2 = _mm_shuffle_ps(row2, row2, 0x4E);
+  minor0 = _mm_add_ps(_mm_mul_ps(row2, tmp1), minor0);
+  minor2 = _mm_mul_ps(row0, tmp1);
+  tmp1 = _mm_shuffle_ps(tmp1, tmp1, 0x4E);
+  minor0 = _mm_sub_ps(minor0, _mm_mul_ps(row2, tmp1));
+  minor2 = _mm_sub_ps(_mm_mul_ps(row0, tmp1), minor2);
+  minor2 = _mm_shuffle_ps(minor2, minor2, 0x4E);
+  
+  tmp1 = _mm_mul_ps(row0, row1);
+  tmp1 = _mm_shuffle_ps(tmp1, tmp1, 0xB1);
+  minor2 = _mm_add_ps(_mm_mul_ps(row3, tmp1), minor2);
+  minor3 = _mm_sub_ps(_mm_mul_ps(row2, tmp1), minor3);
+  tmp1 = _mm_shuffle_ps(tmp1, tmp1, 0x4E);
+  minor2 = _mm_sub_ps(_mm_mul_ps(row3, tmp1), minor2);
+  minor3 = _mm_sub_ps(minor3, _mm_mul_ps(row2, tmp1));
+  
+  tmp1 = _mm_mul_ps(row0, row3);
+  tmp1 = _mm_shuffle_ps(tmp1, tmp1, 0xB1);
+  minor1 = _mm_sub_ps(minor1, _mm_mul_ps(row2, tmp1));
+  minor2 = _mm_add_ps(_mm_mul_ps(row1, tmp1), minor2);
+  tmp1 = _mm_shuffle_ps(tmp1, tmp1, 0x4E);
+  minor1 = _mm_add_ps(_mm_mul_ps(row2, tmp1), minor1);
+  minor2 = _mm_sub_ps(minor2, _mm_mul_ps(row1, tmp1));
+  
+  tmp1 = _mm_mul_ps(row0, row2);
+  tmp1 = _mm_shuffle_ps(tmp1, tmp1, 0xB1);
+  minor1 = _mm_add_ps(_mm_mul_ps(row3, tmp1), minor1);
+  minor3 = _mm_sub_ps(minor3, _mm_mul_ps(row1, tmp1));
+  tmp1 = _mm_shuffle_ps(tmp1, tmp1, 0x4E);
+  minor1 = _mm_sub_ps(minor1, _mm_mul_ps(row3, tmp1));
+  minor3 = _mm_add_ps(_mm_mul_ps(row1, tmp1), minor3);
+  
+  /* Calculate determinant; a true division rather than _mm_rcp_ss, which
+     is only good for 12 bits */
+  det = _mm_mul_ps(row0, minor0);
+  det = _mm_add_ps(_mm_shuffle_ps(det, det, 0x4E), det);
+  det = _mm_add_ss(_mm_shuffle_ps(det, det, 0xB1), det);
+  det = _mm_div_ss(_mm_set_ss(1.0f), det);
+  det = _mm_shuffle_ps(det, det, 0x00);
+  
+  _mm_storeu_ps(dst.m_matrix[0], _mm_mul_ps(det, minor0));
+  _mm_storeu_ps(dst.m_matrix[1], _mm_mul_ps(det, minor1));
+  _mm_storeu_ps(dst.m_matrix[2], _mm_mul_ps(det, minor2));
+  _mm_storeu_ps(dst.m_matrix[3], _mm_mul_ps(det, minor3));
+#else
   float tmp[12], src[16], det;
   matrix dst;
   
@@ -203,14 +356,14 @@ matrix matrix::operator~() const
   tmp[11] = src[ 9] * src[12];
   
   /* Calculate first 8 elements (cofactors) */
-  dst.value(0, 0) = tmp[0]*src[5] + tmp[3]*src[6] + tmp[ 4]*src[7] - tmp[1]*src[5] + tmp[2]*src[6] + tmp[ 5]*src[7];
-  dst.value(0, 1) = tmp[1]*src[4] + tmp[6]*src[6] + tmp[ 9]*src[7] - tmp[0]*src[4] + tmp[7]*src[6] + tmp[ 8]*src[7];
-  dst.value(0, 2) = tmp[2]*src[4] + tmp[7]*src[5] + tmp[10]*src[7] - tmp[3]*src[4] + tmp[6]*src[5] + tmp[11]*src[7];
-  dst.value(0, 3) = tmp[5]*src[4] + tmp[8]*src[5] + tmp[11]*src[6] - tmp[4]*src[4] + tmp[9]*src[5] + tmp[10]*src[6];
-  dst.value(1, 0) = tmp[1]*src[1] + tmp[2]*src[2] + tmp[ 5]*src[3] - tmp[0]*src[1] + tmp[3]*src[2] + tmp[ 4]*src[3];
-  dst.value(1, 1) = tmp[0]*src[0] + tmp[7]*src[2] + tmp[ 8]*src[3] - tmp[1]*src[0] + tmp[6]*src[2] + tmp[ 9]*src[3];
-  dst.value(1, 2) = tmp[3]*src[0] + tmp[6]*src[1] + tmp[11]*src[3] - tmp[2]*src[0] + tmp[7]*src[1] + tmp[10]*src[3];
-  dst.value(1, 3) = tmp[4]*src[0] + tmp[9]*src[1] + tmp[10]*src[2] - tmp[5]*src[0] + tmp[8]*src[1] + tmp[11]*src[2];
+  dst.value(0, 0) = tmp[0]*src[5] + tmp[3]*src[6] + tmp[ 4]*src[7] - (tmp[1]*src[5] + tmp[2]*src[6] + tmp[ 5]*src[7]);
+  dst.value(0, 1) = tmp[1]*src[4] + tmp[6]*src[6] + tmp[ 9]*src[7] - (tmp[0]*src[4] + tmp[7]*src[6] + tmp[ 8]*src[7]);
+  dst.value(0, 2) = tmp[2]*src[4] + tmp[7]*src[5] + tmp[10]*src[7] - (tmp[3]*src[4] + tmp[6]*src[5] + tmp[11]*src[7]);
+  dst.value(0, 3) = tmp[5]*src[4] + tmp[8]*src[5] + tmp[11]*src[6] - (tmp[4]*src[4] + tmp[9]*src[5] + tmp[10]*src[6]);
+  dst.value(1, 0) = tmp[1]*src[1] + tmp[2]*src[2] + tmp[ 5]*src[3] - (tmp[0]*src[1] + tmp[3]*src[2] + tmp[ 4]*src[3]);
+  dst.value(1, 1) = tmp[0]*src[0] + tmp[7]*src[2] + tmp[ 8]*src[3] - (tmp[1]*src[0] + tmp[6]*src[2] + tmp[ 9]*src[3]);
+  dst.value(1, 2) = tmp[3]*src[0] + tmp[6]*src[1] + tmp[11]*src[3] - (tmp[2]*src[0] + tmp[7]*src[1] + tmp[10]*src[3]);
+  dst.value(1, 3) = tmp[4]*src[0] + tmp[9]*src[1] + tmp[10]*src[2] - (tmp[5]*src[0] + tmp[8]*src[1] + tmp[11]*src[2]);
   
   /* Calculate pairs for second 8 elements (cofactors) */
   tmp[ 0] = src[2] * src[7];
@@ -227,14 +380,14 @@ matrix matrix::operator~() const
   tmp[11] = src[1] * src[4];
   
   /* Calculate second 8 elements (cofactors) */
-  dst.value(2, 0) = tmp[ 0]*src[13] + tmp[ 3]*src[14] + tmp[ 4]*src[15] - tmp[ 1]*src[13] + tmp[ 2]*src[14] + tmp[ 5]*src[15];
-  dst.value(2, 1) = tmp[ 1]*src[12] + tmp[ 6]*src[14] + tmp[ 9]*src[15] - tmp[ 0]*src[12] + tmp[ 7]*src[14] + tmp[ 8]*src[15];
-  dst.value(2, 2) = tmp[ 2]*src[12] + tmp[ 7]*src[13] + tmp[10]*src[15] - tmp[ 3]*src[12] + tmp[ 6]*src[13] + tmp[11]*src[15];
-  dst.value(2, 3) = tmp[ 5]*src[12] + tmp[ 8]*src[13] + tmp[11]*src[14] - tmp[ 4]*src[12] + tmp[ 9]*src[13] + tmp[10]*src[14];
-  dst.value(3, 0) = tmp[ 2]*src[10] + tmp[ 5]*src[11] + tmp[ 1]*src[ 9] - tmp[ 4]*src[11] + tmp[ 0]*src[ 9] + tmp[ 3]*src[10];
-  dst.value(3, 1) = tmp[ 8]*src[11] + tmp[ 0]*src[ 8] + tmp[ 7]*src[10] - tmp[ 6]*src[10] + tmp[ 9]*src[11] + tmp[ 1]*src[ 8];
-  dst.value(3, 2) = tmp[ 6]*src[ 9] + tmp[11]*src[11] + tmp[ 3]*src[ 8] - tmp[10]*src[11] + tmp[ 2]*src[ 8] + tmp[ 7]*src[ 9];
-  dst.value(3, 3) = tmp[10]*src[10] + tmp[ 4]*src[ 8] + tmp[ 9]*src[ 9] - tmp[ 8]*src[ 9] + tmp[11]*src[10] + tmp[ 5]*src[ 8];
+  dst.value(2, 0) = tmp[ 0]*src[13] + tmp[ 3]*src[14] + tmp[ 4]*src[15] - (tmp[ 1]*src[13] + tmp[ 2]*src[14] + tmp[ 5]*src[15]);
+  dst.value(2, 1) = tmp[ 1]*src[12] + tmp[ 6]*src[14] + tmp[ 9]*src[15] - (tmp[ 0]*src[12] + tmp[ 7]*src[14] + tmp[ 8]*src[15]);
+  dst.value(2, 2) = tmp[ 2]*src[12] + tmp[ 7]*src[13] + tmp[10]*src[15] - (tmp[ 3]*src[12] + tmp[ 6]*src[13] + tmp[11]*src[15]);
+  dst.value(2, 3) = tmp[ 5]*src[12] + tmp[ 8]*src[13] + tmp[11]*src[14] - (tmp[ 4]*src[12] + tmp[ 9]*src[13] + tmp[10]*src[14]);
+  dst.value(3, 0) = tmp[ 2]*src[10] + tmp[ 5]*src[11] + tmp[ 1]*src[ 9] - (tmp[ 4]*src[11] + tmp[ 0]*src[ 9] + tmp[ 3]*src[10]);
+  dst.value(3, 1) = tmp[ 8]*src[11] + tmp[ 0]*src[ 8] + tmp[ 7]*src[10] - (tmp[ 6]*src[10] + tmp[ 9]*src[11] + tmp[ 1]*src[ 8]);
+  dst.value(3, 2) = tmp[ 6]*src[ 9] + tmp[11]*src[11] + tmp[ 3]*src[ 8] - (tmp[10]*src[11] + tmp[ 2]*src[ 8] + tmp[ 7]*src[ 9]);
+  dst.value(3, 3) = tmp[10]*src[10] + tmp[ 4]*src[ 8] + tmp[ 9]*src[ 9] - (tmp[ 8]*src[ 9] + tmp[11]*src[10] + tmp[ 5]*src[ 8]);
   
   /* Calculate determinant */
   det = 1.0 / (src[0]*dst.value(0, 0) + src[1]*dst.value(0, 1) + src[2]*dst.value(0, 2) + src[3]*dst.value(0, 3));
@@ -246,6 +399,7 @@ matrix matrix::operator~() const
     dst.value(j, 2) *= det;
     dst.value(j, 3) *= det;
   }
+#endif
   
   return dst;
 }
@@ -264,6 +418,50 @@ matrix matrix::transpose() const
   return out;
 }
 
+void matrix::transform(const float *in, float *out, std::size_t n) const
+{
+#if defined(LIBLDR_SIMD_SSE)
+  __m128 c0 = _mm_loadu_ps(m_matrix[0]);
+  __m128 c1 = _mm_loadu_ps(m_matrix[1]);
+  __m128 c2 = _mm_loadu_ps(m_matrix[2]);
+  __m128 c3 = _mm_loadu_ps(m_matrix[3]);
+  
+  _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+  
+  for (std::size_t i = 0; i < n; ++i, in += 3, out += 3) {
+    __m128 r = _mm_mul_ps(c0, _mm_set1_ps(in[0]));
+    r = _mm_add_ps(r, _mm_mul_ps(c1, _mm_set1_ps(in[1])));
+    r = _mm_add_ps(r, _mm_mul_ps(c2, _mm_set1_ps(in[2])));
+    r = _mm_add_ps(r, c3);
+    
+    // exactly three floats; a four-wide store would clobber the next input
+    // when transforming in place
+    _mm_storel_pi(reinterpret_cast<__m64 *>(out), r);
+    _mm_store_ss(out + 2, _mm_movehl_ps(r, r));
+  }
+#elif defined(LIBLDR_SIMD_NEON)
+  float32x4x4_t c = vld4q_f32(&m_matrix[0][0]);
+  
+  for (std::size_t i = 0; i < n; ++i, in += 3, out += 3) {
+    float32x4_t r = vmulq_n_f32(c.val[0], in[0]);
+    r = vaddq_f32(r, vmulq_n_f32(c.val[1], in[1]));
+    r = vaddq_f32(r, vmulq_n_f32(c.val[2], in[2]));
+    r = vaddq_f32(r, c.val[3]);
+    
+    vst1_f32(out, vget_low_f32(r));
+    out[2] = vgetq_lane_f32(r, 2);
+  }
+#else
+  for (std::size_t i = 0; i < n; ++i, in += 3, out += 3) {
+    float x = in[0], y = in[1], z = in[2];
+    
+    out[0] = value(0, 0)*x + value(0, 1)*y + value(0, 2)*z + value(0, 3);
+    out[1] = value(1, 0)*x + value(1, 1)*y + value(1, 2)*z + value(1, 3);
+    out[2] = value(2, 0)*x + value(2, 1)*y + value(2, 2)*z + value(2, 3);
+  }
+#endif
+}
+
 vector matrix::get_translation_vector() const
 {
   return vector(value(0, 3), value(1, 3), value(2, 3));
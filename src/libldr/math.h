@@ -7,6 +7,7 @@
 #ifndef _LIBLDR_MATH_H_
 #define _LIBLDR_MATH_H_
 
+#include <cstddef>
 #include <cstring>
 #include <string>
 
@@ -79,6 +80,11 @@ class LIBLDR_EXPORT matrix
   matrix operator~ () const; // Inversion
   matrix transpose() const;
   
+  // Transforms n points given as consecutive x, y, z triples (w = 1) from
+  // in to out, which may be the same array. Gives the same results as
+  // operator* one vector at a time.
+  void transform(const float *in, float *out, std::size_t n) const;
+  
   vector get_translation_vector() const;
   void set_translation_vector(const vector &v);
   void set_translation_vector(float x, float y, float z);
@@ -93,6 +99,19 @@ class LIBLDR_EXPORT matrix
   float m_matrix[4][4];
 };
 
+// Kinds of transformation, from the most to the least special. Everything
+// up to transform_orthonormal keeps lengths and angles; see
+// utils::classify_transform().
+enum transform_class
+{
+  transform_identity,
+  transform_translation,   // translation only
+  transform_axis_aligned,  // rotation by multiples of 90 degrees, maybe mirrored
+  transform_orthonormal,   // any rotation, maybe mirrored
+  transform_general,       // scaled or sheared
+  transform_singular       // flattens at least one axis
+};
+
 }
 
 #endif
@@ -15,14 +15,14 @@ namespace ldraw
 {
 
 metrics::metrics(model *m, void *arg)
-    : extension(m, arg)
+    : extension(m, arg), m_hash(0)
 {
   m_null = true;
   m_started = false;
 }
 
 metrics::metrics(const vector &min, const vector &max)
-    : extension(0L, 0L)
+    : extension(0L, 0L), m_hash(0)
 {
   m_null = false;
   m_started = false;
@@ -36,6 +36,7 @@ metrics& metrics::operator=(const metrics &rhs)
   m_null = rhs.m_null;
   m_min = rhs.m_min;
   m_max = rhs.m_max;
+  m_hash = rhs.m_hash;
   
   return *this;
 }
@@ -47,75 +48,130 @@ void metrics::update()
 
 void metrics::update(const filter *filter)
 {
-  std::stack<matrix> modelview_matrix;
-  
   m_started = true;
+  m_hash = 0;
   
   // set dimension as arbitrary initial value
   m_min = vector(0.0f, 0.0f, 0.0f);
   m_max = vector(0.0f, 0.0f, 0.0f);
   
-  // Initialize stack with identity matrix
-  modelview_matrix.push(matrix());
+  measure(m_model, filter);
+}
+
+const metrics* metrics::current(model *m)
+{
+  std::set<model *> checked;
   
-  // Recurse!
-  do_recursive(m_model, &modelview_matrix, filter);
+  return refresh(m, checked);
 }
 
-void metrics::do_recursive(const model *m, std::stack<matrix> *modelview_matrix, const filter *filter, bool orthogonal, int depth)
+metrics* metrics::refresh(model *m, std::set<model *> &checked)
 {
-  int idx = 0;
+  metrics *mt = m->custom_data<metrics>();
   
-  for (model::const_iterator it = m->elements().begin(); it != m->elements().end(); ++it) {
-    if (filter && !filter->query(m, idx, depth)) {
-      ++idx;
-      continue;
+  if (m->modeltype() == model::part || m->modeltype() == model::primitive) {
+    if (!mt) {
+      m->update_custom_data<metrics>();
+      mt = m->custom_data<metrics>();
     }
     
-    type elemtype = (*it)->get_type();
+    return mt;
+  }
+  
+  uint64_t hash = m->hash();
+  if ((mt && mt->m_hash == hash) || !checked.insert(m).second)
+    return mt;
+  
+  // measure() trusts the metrics one level down
+  const geometry_store &g = m->geometry();
+  for (std::vector<int>::const_iterator it = g.refs().begin(); it != g.refs().end(); ++it) {
+    model *lm = CAST_AS_REF(m->elements()[*it])->get_model();
     
-    if (elemtype == type_line) {
-      element_line *l = CAST_AS_LINE(*it);
-      dimension_test(modelview_matrix->top() * l->pos1());
-      dimension_test(modelview_matrix->top() * l->pos2());
-    } else if (elemtype == type_triangle) {
-      element_triangle *l = CAST_AS_TRIANGLE(*it);
-      dimension_test(modelview_matrix->top() * l->pos1());
-      dimension_test(modelview_matrix->top() * l->pos2());
-      dimension_test(modelview_matrix->top() * l->pos3());
-    } else if (elemtype == type_quadrilateral) {
-      element_quadrilateral *l = CAST_AS_QUADRILATERAL(*it);
-      dimension_test(modelview_matrix->top() * l->pos1());
-      dimension_test(modelview_matrix->top() * l->pos2());
-      dimension_test(modelview_matrix->top() * l->pos3());
-      dimension_test(modelview_matrix->top() * l->pos4());
-    } else if (elemtype == type_ref) {
-      element_ref *l = CAST_AS_REF(*it);
-      if (l->get_model()) {
-        modelview_matrix->push(modelview_matrix->top() * l->get_matrix());
-	
-        if (utils::is_stud(l)) {
-          // niche optimization: assume a stud as a line.
-          dimension_test(modelview_matrix->top() * vector(0.0f, 0.0f, 0.0f));
-          dimension_test(modelview_matrix->top() * vector(0.0f, -4.0f, 0.0f));
-        } else {
-          model *m = l->get_model();
-          
-          if (orthogonal && utils::is_orthogonal(modelview_matrix->top())) {
-            if (!m->custom_data<metrics>())
-              m->update_custom_data<metrics>();
-            
-            dimension_test(modelview_matrix->top(), *m->custom_data<metrics>());
-          } else {
-            do_recursive(m, modelview_matrix, filter, false, depth + 1);
-          }
-        }
-        
-        modelview_matrix->pop();
-      }
+    if (lm && lm != m)
+      refresh(lm, checked);
+  }
+  
+  m->update_custom_data<metrics>();
+  mt = m->custom_data<metrics>();
+  mt->m_hash = hash;
+  
+  return mt;
+}
+
+void metrics::measure(const model *m, const filter *filter)
+{
+  const geometry_store &g = m->geometry();
+  
+  // condlines do not count
+  for (int p = geometry_store::lines; p <= geometry_store::quads; ++p) {
+    const geometry_store::stream &s = g.get((geometry_store::primitive)p);
+    
+    for (int i = 0; i < s.size(); ++i) {
+      if (filter && !filter->query(m, s.indices[i], 0))
+        continue;
+      
+      for (int v = 0; v < s.vertices; ++v)
+        dimension_test(s.vertex(i, v));
     }
+  }
+  
+  for (std::vector<int>::const_iterator it = g.refs().begin(); it != g.refs().end(); ++it) {
+    if (filter && !filter->query(m, *it, 0))
+      continue;
+    
+    element_ref *l = CAST_AS_REF(m->elements()[*it]);
+    model *lm = l->get_model();
+    
+    if (!lm)
+      continue;
     
-    ++idx;
+    if (utils::is_stud(l)) {
+      // niche optimization: assume a stud as a line.
+      dimension_test(l->get_matrix() * vector(0.0f, 0.0f, 0.0f));
+      dimension_test(l->get_matrix() * vector(0.0f, -4.0f, 0.0f));
+    } else {
+      if (!lm->custom_data<metrics>())
+        lm->update_custom_data<metrics>();
+      
+      dimension_test(l->get_matrix(), l->get_transform_class(), *lm->custom_data<metrics>());
+    }
+  }
+}
+
+oriented_box metrics::oriented(const matrix &transform) const
+{
+  oriented_box b;
+  vector half = (m_max - m_min) * 0.5f;
+  
+  b.center = transform * ((m_min + m_max) * 0.5f);
+  for (int i = 0; i < 3; ++i)
+    b.axes[i] = vector(transform.value(0, i), transform.value(1, i), transform.value(2, i)) * half[i];
+  
+  return b;
+}
+
+void metrics::transformed_bounds(const matrix &transform, vector &min, vector &max) const
+{
+  const float *lo = m_min.get_pointer(), *hi = m_max.get_pointer();
+  float c[24];
+  
+  for (int i = 0; i < 8; ++i) {
+    c[i * 3] = (i & 1) ? hi[0] : lo[0];
+    c[i * 3 + 1] = (i & 2) ? hi[1] : lo[1];
+    c[i * 3 + 2] = (i & 4) ? hi[2] : lo[2];
+  }
+  
+  transform.transform(c, c, 8);
+  
+  min = vector(c[0], c[1], c[2]);
+  max = min;
+  for (int i = 1; i < 8; ++i) {
+    for (int j = 0; j < 3; ++j) {
+      if (c[i * 3 + j] < min[j])
+        min[j] = c[i * 3 + j];
+      if (c[i * 3 + j] > max[j])
+        max[j] = c[i * 3 + j];
+    }
   }
 }
 
@@ -144,13 +200,35 @@ void metrics::dimension_test(const vector &v)
     m_max.z() = v.z();
 }
 
-void metrics::dimension_test(const matrix &transformation, const metrics &m)
+// Most references turn their part by multiples of 90 degrees at most, which
+// keeps a box a box: each axis of the result is one axis of m, maybe
+// flipped, and the corners need not be transformed one by one.
+void metrics::dimension_test(const matrix &transformation, transform_class c, const metrics &m)
 {
-	vector min = transformation * m.min_();
-	vector max = transformation * m.max_();
-
-	dimension_test(min);
-	dimension_test(max);
+  vector min, max;
+  
+  if (c <= transform_axis_aligned) {
+    for (int r = 0; r < 3; ++r) {
+      float t = transformation.value(r, 3);
+      
+      for (int i = 0; i < 3; ++i) {
+        float v = transformation.value(r, i);
+        
+        if (v > 0.5f) {
+          min[r] = v * m.m_min[i] + t;
+          max[r] = v * m.m_max[i] + t;
+        } else if (v < -0.5f) {
+          min[r] = v * m.m_max[i] + t;
+          max[r] = v * m.m_min[i] + t;
+        }
+      }
+    }
+  } else {
+    m.transformed_bounds(transformation, min, max);
+  }
+  
+  dimension_test(min);
+  dimension_test(max);
 }
 
 }
@@ -7,7 +7,8 @@
 #ifndef _LIBLDR_METRICS_H_
 #define _LIBLDR_METRICS_H_
 
-#include <stack>
+#include <set>
+#include <stdint.h>
 
 #include "extension.h"
 #include "math.h"
@@ -18,6 +19,17 @@ namespace ldraw
 class filter;
 class model;
 
+// Box of any orientation, such as the bounding box of a model placed by a
+// reference: its center and the vectors from there to three of its faces.
+struct LIBLDR_EXPORT oriented_box
+{
+  vector center;
+  vector axes[3];
+};
+
+// Bounding box of a model in its own coordinates. Referenced models count
+// with their own (cached) metrics placed by the reference, so updating never
+// walks further down than one level.
 class LIBLDR_EXPORT metrics : public extension
 {
   public:
@@ -32,21 +44,33 @@ class LIBLDR_EXPORT metrics : public extension
     void update();
     void update(const filter *filter);
 
+    // The metrics of m, taken again first wherever m or a submodel below it
+    // has changed since, as told by model::hash(). Parts and primitives are
+    // measured once.
+    static const metrics* current(model *m);
+
     bool is_null() const { return m_null; }
     const vector& min_() const { return m_min; }
     const vector& max_() const { return m_max; }
 
+    // this box placed by transform
+    oriented_box oriented(const matrix &transform) const;
+    // world-aligned box around the 8 corners of this box placed by transform
+    void transformed_bounds(const matrix &transform, vector &min, vector &max) const;
+
   private:
-    void do_recursive(const model *m, std::stack<matrix> *modelview_matrix,
-        const filter *filter = 0L, bool orthogonal = true, int depth = 0);
+    static metrics* refresh(model *m, std::set<model *> &checked);
+    void measure(const model *m, const filter *filter);
     void dimension_test(const vector &vec);
-    void dimension_test(const matrix &transformation, const metrics &m);
+    // c is the class of transformation, as element_ref keeps it
+    void dimension_test(const matrix &transformation, transform_class c, const metrics &m);
 	
   protected:
     bool m_null;
     vector m_min;
     vector m_max;
     bool m_started;
+    uint64_t m_hash; // model::hash() when taken through current(), else 0
 };
 
 };
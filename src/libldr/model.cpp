@@ -5,16 +5,23 @@
  * Author: (c)2006-2008 Park "segfault" J. K. <mastermind_at_planetmono_dot_org>     */
 
 #include <algorithm>
+#include <atomic>
 
+#include "content_hash.h"
 #include "model.h"
+#include "part_library.h"
 #include "reader.h"
 #include "utils.h"
 
 namespace ldraw
 {
 
+// Bumped on every edit of any model; starts above the 0 new models carry.
+static std::atomic<unsigned long> hash_generation(1);
+
 model::model(const std::string &desc, const std::string &name, const std::string &author, model_multipart *parent)
-    : m_desc(desc), m_name(name), m_author(author), m_null(false), m_parent(parent), m_model_type(general)
+    : m_desc(desc), m_name(name), m_author(author), m_stud(atom::fold(name).is_stud()), m_null(false), m_parent(parent), m_data(), m_model_type(general), m_loader(0L), m_geometry_valid(false),
+      m_content_hash(0), m_hashes_valid(false), m_content_hash_valid(false), m_hash(0), m_hash_generation(0), m_changed(0)
 {
 }
 
@@ -22,8 +29,8 @@ model::~model()
 {
   clear();
   
-  for (std::map<std::string, extension *>::iterator it = m_data.begin(); it != m_data.end(); ++it)
-    delete (*it).second;
+  for (int i = 0; i < extension_registry::max_slots; ++i)
+    delete m_data[i];
 }
 
 bool model::is_submodel_of(const model_multipart *m) const
@@ -51,11 +58,17 @@ std::list<std::string> model::header(const std::string &key) const
 
 int model::size() const
 {
+  if (m_loader)
+    load_elements();
+  
   return m_elements.size();
 }
 
 element_base* model::at(unsigned int index)
 {
+  if (m_loader)
+    load_elements();
+  
   if (index >= m_elements.size())
     return 0L;
   
@@ -64,40 +77,242 @@ element_base* model::at(unsigned int index)
 
 element_base* model::operator[] (unsigned int index)
 {
+  if (m_loader)
+    load_elements();
+  
   if (index >= m_elements.size())
     return 0L;
   
   return m_elements[index];
 }
 
+void model::load_elements() const
+{
+  m_loader->load_geometry(const_cast<model *>(this));
+}
+
+const geometry_store& model::geometry() const
+{
+  if (m_loader)
+    load_elements();
+  
+  if (!m_geometry_valid) {
+    m_geometry.clear();
+    for (unsigned int i = 0; i < m_elements.size(); ++i)
+      m_geometry.append(m_elements[i], i);
+    m_geometry_valid = true;
+  }
+  
+  return m_geometry;
+}
+
+void model::element_changed(int pos)
+{
+  // the geometry only keeps the index of a reference
+  if (m_elements[pos]->get_type() != type_ref)
+    invalidate_geometry();
+  
+  if (m_hashes_valid) {
+    m_hashes[pos] = hash_element(m_elements[pos]);
+    m_content_hash_valid = false;
+  }
+  
+  subtree_changed();
+}
+
+void model::element_changed(const element_base *e)
+{
+  if (e->get_type() != type_ref)
+    invalidate_geometry();
+  
+  // m_hashes keeps its storage for the rebuild
+  m_hashes_valid = false;
+  m_content_hash_valid = false;
+  
+  subtree_changed();
+}
+
+uint64_t model::content_hash() const
+{
+  if (m_loader)
+    load_elements();
+  
+  if (!m_hashes_valid) {
+    m_hashes.resize(m_elements.size());
+    for (unsigned int i = 0; i < m_elements.size(); ++i)
+      m_hashes[i] = hash_element(m_elements[i]);
+    m_hashes_valid = true;
+    m_content_hash_valid = false;
+  }
+  
+  // recombining the element hashes is cheap next to hashing the elements
+  if (!m_content_hash_valid) {
+    m_content_hash = 0;
+    for (unsigned int i = 0; i < m_hashes.size(); ++i)
+      m_content_hash = hash_combine(m_content_hash, m_hashes[i]);
+    m_content_hash_valid = true;
+  }
+  
+  return m_content_hash;
+}
+
+uint64_t model::hash() const
+{
+  if (m_hash_generation != hash_generation) {
+    std::map<const model *, uint64_t> visited;
+    
+    subtree_hash(visited);
+  }
+  
+  return m_hash;
+}
+
+// The generation still moves on every edit anywhere, as a model cannot tell
+// which models refer to it; m_changed marks the model that was edited, so
+// that the others can keep their hash after a look at their submodels.
+void model::subtree_changed()
+{
+  m_changed = ++hash_generation;
+}
+
+// Every model is hashed once per call, however often it is referenced. A
+// model referencing itself sees its own content hash. Library parts are not
+// edited, and are not even in memory under header_residency, so they only
+// count as being linked.
+//
+// A model that has not changed since its hash was taken keeps it if its
+// submodels still hash the same; checking that walks the submodels only,
+// not the elements.
+uint64_t model::subtree_hash(std::map<const model *, uint64_t> &visited) const
+{
+  std::map<const model *, uint64_t>::iterator it = visited.find(this);
+  if (it != visited.end())
+    return it->second;
+  
+  unsigned long generation = hash_generation;
+  
+  if (m_hash_generation && m_changed <= m_hash_generation) {
+    bool valid = true;
+    
+    visited[this] = m_hash;
+    for (unsigned int i = 0; i < m_hash_children.size() && valid; ++i)
+      valid = m_hash_children[i].first->subtree_hash(visited) == m_hash_children[i].second;
+    
+    if (valid) {
+      m_hash_generation = generation;
+      return m_hash;
+    }
+  }
+  
+  uint64_t h = content_hash();
+  visited[this] = h;
+  m_hash_children.clear();
+  
+  for (unsigned int i = 0; i < m_elements.size(); ++i) {
+    const element_ref *r = CAST_AS_CONST_REF(m_elements[i]);
+    
+    if (!r || !r->get_model())
+      continue;
+    
+    const model *rm = r->get_model();
+    if (rm->modeltype() == part || rm->modeltype() == primitive) {
+      h = hash_combine(h, 1);
+    } else {
+      uint64_t sh = rm->subtree_hash(visited);
+      
+      h = hash_combine(h, sh);
+      m_hash_children.push_back(std::make_pair(rm, sh));
+    }
+  }
+  
+  std::sort(m_hash_children.begin(), m_hash_children.end());
+  m_hash_children.erase(std::unique(m_hash_children.begin(), m_hash_children.end()), m_hash_children.end());
+  
+  visited[this] = h;
+  m_hash = h;
+  m_hash_generation = generation;
+  
+  return h;
+}
+
 void model::insert_element(element_base *e, int pos)
 {
+  if (m_loader)
+    load_elements();
+  
   if (e->get_type() == type_ref) {
     element_ref *ref = CAST_AS_REF(e);
     ref->set_parent(this);
     ref->link();
   }
   
-  if (pos == -1)
+  if (pos == -1 || pos == (int)m_elements.size()) {
     m_elements.push_back(e);
-  else
+    
+    if (m_geometry_valid)
+      m_geometry.append(e, m_elements.size() - 1);
+    
+    if (m_hashes_valid) {
+      m_hashes.push_back(hash_element(e));
+      if (m_content_hash_valid)
+        m_content_hash = hash_combine(m_content_hash, m_hashes.back());
+    }
+  } else {
     m_elements.insert(m_elements.begin() + pos, e);
+    
+    // every index after pos shifts
+    invalidate_geometry();
+    
+    if (m_hashes_valid) {
+      m_hashes.insert(m_hashes.begin() + pos, hash_element(e));
+      m_content_hash_valid = false;
+    }
+  }
+  
+  subtree_changed();
 }
 
 bool model::delete_element(int pos)
 {
+  if (m_loader)
+    load_elements();
+  
   if (pos >= (int)m_elements.size())
     return false;
   
   if (pos == -1)
     pos = m_elements.size() - 1;
   
-  delete m_elements[pos];
+  destroy_element(m_elements[pos]);
   m_elements.erase(m_elements.begin() + pos);
+  invalidate_geometry();
+  
+  if (m_hashes_valid) {
+    m_hashes.erase(m_hashes.begin() + pos);
+    m_content_hash_valid = false;
+  }
+  
+  subtree_changed();
   
   return true;
 }
 
+// Arena elements only get their destructor run here; their memory goes back
+// in one piece when the model is cleared.
+void model::destroy_element(element_base *e)
+{
+  if (m_arena.owns(e))
+    e->~element_base();
+  else
+    delete e;
+}
+
+void model::set_name(const std::string &name)
+{
+  m_name = name;
+  m_stud = atom::fold(name).is_stud();
+}
+
 void model::set_header(const std::string &key, const std::string &value)
 {
   m_headers.insert(make_pair(key, value));
@@ -115,8 +330,11 @@ void model::clear()
   set_author("");
   
   for (model::iterator it = m_elements.begin(); it != m_elements.end(); ++it)
-    delete (*it);
+    destroy_element(*it);
   m_elements.clear();
+  m_arena.release();
+  invalidate_geometry();
+  invalidate_hashes();
   
   m_null = true;
 }
@@ -135,9 +353,15 @@ void model::clear()
     push_back(*it);
 }*/
 
+// Keys are interned when stored, so a name that was never interned is not
+// among them; the lookups below leave the atom table alone.
 bool model_multipart::contains(const model *m) const
 {
-  std::string lowercase = utils::translate_string(m->name());
+  atom key = atom::find_folded(m->name());
+  if (key.empty())
+    return false;
+  
+  const std::string &lowercase = key.str();
   
   if (m_submodel_list.find(lowercase) == m_submodel_list.end())
     if (m_external_model_list.find(lowercase) == m_external_model_list.end())
@@ -164,7 +388,7 @@ void model_multipart::link_submodel(model *m)
 
 bool model_multipart::link_submodel_element(element_ref *r)
 {
-  std::string fn = utils::translate_string(r->filename());
+  const std::string &fn = r->filename_atom().folded().str();
   
   model_multipart *p = 0L;
   
@@ -194,8 +418,11 @@ bool model_multipart::link_submodel_element(element_ref *r)
 
 model* model_multipart::find_submodel(const std::string &name)
 {
-  std::string lowercase = utils::translate_string(name);
-  std::map<std::string, model*>::iterator it = m_submodel_list.find(lowercase);
+  atom key = atom::find_folded(name);
+  if (key.empty())
+    return 0L;
+  
+  std::map<std::string, model*>::iterator it = m_submodel_list.find(key.str());
 
   if(it == m_submodel_list.end())
     return 0L;
@@ -210,7 +437,7 @@ bool model_multipart::insert_submodel(model *m)
 
 bool model_multipart::insert_submodel(model *m, const std::string &key)
 {
-  std::string fn = utils::translate_string(key);
+  const std::string &fn = atom::fold(key).str();
   
   // Search for duplicate
   if(m_submodel_list.find(fn) != m_submodel_list.end())
@@ -223,8 +450,11 @@ bool model_multipart::insert_submodel(model *m, const std::string &key)
 
 bool model_multipart::remove_submodel(const std::string &name)
 {
-  std::string lowercase = utils::translate_string(name);
-  std::map<std::string, model*>::iterator it = m_submodel_list.find(lowercase);
+  atom key = atom::find_folded(name);
+  if (key.empty())
+    return false;
+  
+  std::map<std::string, model*>::iterator it = m_submodel_list.find(key.str());
   
   if (it == m_submodel_list.end())
     return false;
@@ -253,8 +483,8 @@ bool model_multipart::rename_submodel(const std::string &name, const std::string
     return false;
   
   // rename
-  m_submodel_list.erase(utils::translate_string(name));
-  m_submodel_list[utils::translate_string(newname)] = m;
+  m_submodel_list.erase(atom::find_folded(name).str());
+  m_submodel_list[atom::fold(newname).str()] = m;
   
   // search the main model
   for (int i = 0; i < m_main_model.size(); ++i) {
@@ -278,7 +508,11 @@ bool model_multipart::rename_submodel(const std::string &name, const std::string
 
 model_multipart* model_multipart::find_external_model(const std::string &name)
 {
-  std::map<std::string, model_multipart*>::iterator it = m_external_model_list.find(utils::translate_string(name));
+  atom key = atom::find_folded(name);
+  if (key.empty())
+    return 0L;
+  
+  std::map<std::string, model_multipart*>::iterator it = m_external_model_list.find(key.str());
   
   if (it == m_external_model_list.end())
     return 0L;
@@ -298,14 +532,18 @@ model_multipart* model_multipart::load_external_model(const reader &r, const std
   
   remove_external_model(name);
   
-  m_external_model_list[utils::translate_string(name)] = m;
+  m_external_model_list[atom::fold(name).str()] = m;
   
   return m;
 }
 
 bool model_multipart::remove_external_model(const std::string &name)
 {
-  std::map<std::string, model_multipart*>::iterator it = m_external_model_list.find(utils::translate_string(name));
+  atom key = atom::find_folded(name);
+  if (key.empty())
+    return false;
+  
+  std::map<std::string, model_multipart*>::iterator it = m_external_model_list.find(key.str());
   
   if (it != m_external_model_list.end()) {
     delete (*it).second;
@@ -15,10 +15,13 @@
 #include <stack>
 #include <utility>
 #include <vector>
+#include <stdint.h>
 
+#include "arena.h"
 #include "common.h"
 #include "elements.h"
 #include "extension.h"
+#include "geometry_store.h"
 
 namespace ldraw
 {
@@ -37,7 +40,8 @@ class LIBLDR_EXPORT model
   typedef std::vector<element_base*>::const_reverse_iterator reverse_iterator;
   
   explicit model(model_multipart *parent = 0L)
-      : m_null(true), m_parent(parent), m_model_type(general) {}
+      : m_stud(false), m_null(true), m_parent(parent), m_data(), m_model_type(general), m_loader(0L), m_geometry_valid(false),
+        m_content_hash(0), m_hashes_valid(false), m_content_hash_valid(false), m_hash(0), m_hash_generation(0), m_changed(0) {}
   model(const std::string &desc, const std::string &name, const std::string &author, model_multipart *parent = 0L);
   ~model();
   
@@ -48,13 +52,47 @@ class LIBLDR_EXPORT model
   model_type modeltype() const { return m_model_type; }
   const std::string& desc() const { return m_desc; }
   const std::string& name() const { return m_name; }
+  // utils::is_stud() of the name, taken when it is set
+  bool is_stud() const { return m_stud; }
   const std::string& author() const { return m_author; }
   std::list<std::string> header(const std::string &key) const;
   const std::multimap<std::string, std::string> headers() const { return m_headers; }
   
   model_multipart* parent() { return m_parent; }
   const model_multipart* parent() const { return m_parent; }
-  const std::vector<element_base*>& elements() const { return m_elements; }
+  const std::vector<element_base*>& elements() const { if (m_loader) load_elements(); return m_elements; }
+  
+  // false while only the header and bounds of a library part are in memory;
+  // its elements are read in on first access
+  bool is_resident() const { return !m_loader; }
+  
+  // Flat per-type arrays of the lines, triangles, quads and conditional lines.
+  // Built on first use; appended elements are added as they come, any other
+  // edit through insert_element()/delete_element() has them rebuilt on the
+  // next call. Changing an element in place requires element_changed().
+  const geometry_store& geometry() const;
+  void invalidate_geometry() { m_geometry.clear(); m_geometry_valid = false; }
+  
+  // Hash of the elements of this model alone, in order; references count by
+  // filename, color and matrix. Name, description and headers are left out,
+  // so two submodels with the same contents hash the same. The per-element
+  // hashes are computed on first use and kept up to date by
+  // insert_element()/delete_element() from then on.
+  uint64_t content_hash() const;
+  // content_hash() combined with hash() of every submodel referenced from
+  // here, e.g. as a cache key for anything derived from the whole subtree;
+  // parts and primitives only count as linked or not. Kept until this model
+  // or one below it is edited or relinked.
+  uint64_t hash() const;
+  
+  // Call after changing the element at pos in place (set_color(),
+  // set_matrix() and the like); updates its hash and drops the geometry.
+  // References do so by themselves, as they know their model; lines,
+  // triangles and the rest do not and leave it to the caller. The pointer
+  // form does not look e up: it leaves every element to be rehashed on the
+  // next content_hash(), so that a run of edits stays linear.
+  void element_changed(int pos);
+  void element_changed(const element_base *e);
   
   // Edit
   int size() const;
@@ -65,33 +103,30 @@ class LIBLDR_EXPORT model
   
   void set_modeltype(model_type t) { m_model_type = t; }
   void set_desc(const std::string &desc) { m_desc = desc; }
-  void set_name(const std::string &name) { m_name = name; }
+  void set_name(const std::string &name);
   void set_author(const std::string &author) { m_author = author; }
   void set_header(const std::string &key, const std::string &value);
   void remove_header(const std::string &key);
   
   template <class T> T* init_custom_data(void *data = 0L, bool preserve = false)
   {
-    if (custom_data<T>()) {
+    extension *&slot = m_data[extension_slot<T>::index];
+    
+    if (slot) {
       if (preserve)
         return 0L;
-      delete m_data[T::identifier()];
+      delete slot;
     }
     
     T *ndata = new T(this, data);
-    m_data[T::identifier()] = ndata;
+    slot = ndata;
     
     return ndata;
   }
   
   template <class T> T* custom_data() const
   {
-    std::map<std::string, extension *>::const_iterator it = m_data.find(T::identifier());
-    
-    if (it == m_data.end())
-      return 0L;
-    
-    return dynamic_cast<T *>((*it).second);
+    return static_cast<T *>(m_data[extension_slot<T>::index]);
   }
   
   template <class T> const T* const_custom_data() const
@@ -113,21 +148,22 @@ class LIBLDR_EXPORT model
       
     }
     
-    if (!custom_data<T>())
+    extension *&slot = m_data[extension_slot<T>::index];
+    
+    if (!slot)
       init_custom_data<T>(data, preserve);
     else
-      m_data[T::identifier()]->set_data(data);
+      slot->set_data(data);
     
-    m_data[T::identifier()]->update();
+    slot->update();
   }
   
   template <class T> void delete_custom_data()
   {
-    std::map<std::string, extension *>::iterator it = m_data.find(T::identifier());
-    if (it != m_data.end()) {
-      delete (*it).second;
-      m_data.erase(it);
-    }
+    extension *&slot = m_data[extension_slot<T>::index];
+    
+    delete slot;
+    slot = 0L;
   }		
   
   void clear();
@@ -135,26 +171,61 @@ class LIBLDR_EXPORT model
  private:
   typedef std::vector<element_base*>::iterator iterator;
   
+  friend class element_ref;
   friend class model_multipart;
+  friend class part_cache;
   friend class part_library;
   friend class reader;
   
   void set_parent(model_multipart *parent) { m_parent = parent; }
+  void load_elements() const;
+  void destroy_element(element_base *e);
+  void invalidate_hashes() { std::vector<uint64_t>().swap(m_hashes); m_hashes_valid = false; m_content_hash_valid = false; subtree_changed(); }
+  uint64_t subtree_hash(std::map<const model *, uint64_t> &visited) const;
+  
+  // drops hash() of this model and of every model above it
+  void subtree_changed();
   
   std::string m_desc;
   std::string m_name;
   std::string m_author;
+  bool m_stud;
   
   std::vector<element_base*> m_elements;
   
+  // backs the elements created by reader and part_cache; elements inserted
+  // from outside are heap objects and deleted one by one
+  arena m_arena;
+  
   std::multimap<std::string, std::string> m_headers;
   
   bool m_null;
   model_multipart *m_parent;
   
-  std::map<std::string, extension *> m_data;
+  // indexed by extension_slot<T>::index
+  extension *m_data[extension_registry::max_slots];
   
   model_type m_model_type;
+  
+  part_library *m_loader;
+  
+  mutable geometry_store m_geometry;
+  mutable bool m_geometry_valid;
+  
+  // parallel to m_elements while m_hashes_valid
+  mutable std::vector<uint64_t> m_hashes;
+  mutable uint64_t m_content_hash;
+  mutable bool m_hashes_valid;
+  mutable bool m_content_hash_valid;
+  
+  // hash(), valid while m_hash_generation is the current generation; after
+  // that, while this model has not changed since and every submodel in
+  // m_hash_children still hashes as it did
+  mutable uint64_t m_hash;
+  mutable unsigned long m_hash_generation;
+  mutable std::vector<std::pair<const model *, uint64_t> > m_hash_children;
+  // generation of the last edit of this model
+  unsigned long m_changed;
 };
 
 // Multi-part model.
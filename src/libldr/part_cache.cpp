@@ -0,0 +1,423 @@
+/* libLDR: Portable and easy-to-use LDraw format abstraction & I/O reference library *
+ * To obtain more information about LDraw, visit http://www.ldraw.org.               *
+ * Distributed in terms of the GNU Lesser General Public License v3                  *
+ *                                                                                   *
+ * Author: (c)2006-2013 Park "segfault" J. K. <mastermind_at_planetmono_dot_org>     */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _MSC_VER
+#include <direct.h>
+#endif
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdint.h>
+
+#include "bfc.h"
+#include "binary_stream.h"
+#include "elements.h"
+#include "mapped_file.h"
+#include "metrics.h"
+#include "model.h"
+#include "visitor.h"
+
+#include "part_cache.h"
+
+/* Image layout (native byte order):
+ *
+ *   header   magic[8] version:u32 byte_order:u32 mtime:i64 size:u64 source:str
+ *            dependencies:u32 { path:str mtime:i64 size:u64 }
+ *   models   count:u32, then per model:
+ *            key:str name:str desc:str author:str type:u8
+ *            headers:u32 { key:str value:str }
+ *            flags:u8 [bfc cert:u8 winding:u8] [metrics min:3f max:3f]
+ *            elements:u32 { type:u8 payload }
+ *
+ * str is as written by binary_writer. The first model is the main
+ * model, which has an empty key. Metrics describe the part as it was linked
+ * when the image was written, hence the stamps of every file it was linked
+ * against. mtime is in nanoseconds where the system keeps them. */
+
+namespace ldraw
+{
+
+bool file_stamp::take(const std::string &filename, file_stamp *stamp)
+{
+  struct stat st;
+
+  if (stat(filename.c_str(), &st) != 0)
+    return false;
+
+#if defined(__linux__)
+  // a second is too coarse: a same-size edit in the second the image was
+  // written would pass for it
+  stamp->mtime = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#else
+  stamp->mtime = st.st_mtime;
+#endif
+  stamp->size = st.st_size;
+
+  return true;
+}
+
+namespace
+{
+
+const char image_magic[8] = { 'L', 'D', 'R', 'C', 'A', 'C', 'H', 'E' };
+const uint32_t image_version = 3;
+const uint32_t image_byte_order = 0x01020304;
+
+enum image_flags { has_bfc = 0x1, has_metrics = 0x2 };
+
+// element payloads; the type tag is written by write_model()
+struct element_writer
+{
+  binary_writer *w;
+
+  void operator()(const element_comment &e) { w->put(e.get_comment()); }
+  void operator()(const element_state &e) { w->put<uint8_t>(e.get_state()); }
+  void operator()(const element_print &e) { w->put(e.get_string()); }
+  void operator()(const element_bfc &e) { w->put<uint8_t>(e.get_command()); }
+
+  void operator()(const element_ref &e)
+  {
+    w->put<uint32_t>(e.get_color().get_id());
+    for (int i = 0; i < 16; ++i)
+      w->put<float>(e.get_matrix().get_pointer()[i]);
+    w->put(e.filename());
+  }
+
+  void operator()(const element_line &e)
+  {
+    w->put<uint32_t>(e.get_color().get_id());
+    w->put(e.pos1());
+    w->put(e.pos2());
+  }
+
+  void operator()(const element_triangle &e)
+  {
+    w->put<uint32_t>(e.get_color().get_id());
+    w->put(e.pos1());
+    w->put(e.pos2());
+    w->put(e.pos3());
+  }
+
+  void operator()(const element_quadrilateral &e)
+  {
+    w->put<uint32_t>(e.get_color().get_id());
+    w->put(e.pos1());
+    w->put(e.pos2());
+    w->put(e.pos3());
+    w->put(e.pos4());
+  }
+
+  void operator()(const element_condline &e)
+  {
+    w->put<uint32_t>(e.get_color().get_id());
+    w->put(e.pos1());
+    w->put(e.pos2());
+    w->put(e.pos3());
+    w->put(e.pos4());
+  }
+};
+
+void write_model(binary_writer &w, const std::string &key, const model *m)
+{
+  w.put(key);
+  w.put(m->name());
+  w.put(m->desc());
+  w.put(m->author());
+  w.put<uint8_t>(m->modeltype());
+
+  const std::multimap<std::string, std::string> headers = m->headers();
+  w.put<uint32_t>(headers.size());
+  for (std::multimap<std::string, std::string>::const_iterator it = headers.begin(); it != headers.end(); ++it) {
+    w.put((*it).first);
+    w.put((*it).second);
+  }
+
+  const bfc_certification *cert = m->custom_data<bfc_certification>();
+  const metrics *metric = m->custom_data<metrics>();
+  uint8_t flags = 0;
+
+  if (cert)
+    flags |= has_bfc;
+  if (metric)
+    flags |= has_metrics;
+
+  w.put<uint8_t>(flags);
+  if (flags & has_bfc) {
+    w.put<uint8_t>(cert->certification());
+    w.put<uint8_t>(cert->orientation());
+  }
+  if (flags & has_metrics) {
+    w.put(metric->min_());
+    w.put(metric->max_());
+  }
+
+  element_writer ew = { &w };
+  
+  w.put<uint32_t>(m->size());
+  for (model::const_iterator it = m->elements().begin(); it != m->elements().end(); ++it) {
+    const element_base *e = *it;
+
+    w.put<uint8_t>(e->get_type());
+    visit(e, ew);
+  }
+}
+
+element_base* read_element(binary_reader &r, arena *pool)
+{
+  uint8_t t = r.get<uint8_t>();
+
+  switch (t) {
+    case type_comment:
+      return arena_new<element_comment>(pool, r.get_string());
+    case type_state:
+      return arena_new<element_state>(pool, (element_state::state)r.get<uint8_t>());
+    case type_print:
+      return arena_new<element_print>(pool, r.get_string());
+    case type_bfc:
+      return arena_new<element_bfc>(pool, (element_bfc::command)r.get<uint8_t>());
+    case type_ref: {
+      color c(r.get<uint32_t>());
+      float m[16];
+      for (int i = 0; i < 16; ++i)
+        m[i] = r.get<float>();
+      return arena_new<element_ref>(pool, c, matrix(m), r.get_string());
+    }
+    case type_line: {
+      color c(r.get<uint32_t>());
+      vector p1 = r.get_vector();
+      vector p2 = r.get_vector();
+      return arena_new<element_line>(pool, c, p1, p2);
+    }
+    case type_triangle: {
+      color c(r.get<uint32_t>());
+      vector p1 = r.get_vector();
+      vector p2 = r.get_vector();
+      vector p3 = r.get_vector();
+      return arena_new<element_triangle>(pool, c, p1, p2, p3);
+    }
+    case type_quadrilateral: {
+      color c(r.get<uint32_t>());
+      vector p1 = r.get_vector();
+      vector p2 = r.get_vector();
+      vector p3 = r.get_vector();
+      vector p4 = r.get_vector();
+      return arena_new<element_quadrilateral>(pool, c, p1, p2, p3, p4);
+    }
+    case type_condline: {
+      color c(r.get<uint32_t>());
+      vector p1 = r.get_vector();
+      vector p2 = r.get_vector();
+      vector p3 = r.get_vector();
+      vector p4 = r.get_vector();
+      return arena_new<element_condline>(pool, c, p1, p2, p3, p4);
+    }
+  }
+
+  // whatever follows cannot be made sense of either
+  r.fail();
+
+  return 0L;
+}
+
+}
+
+part_cache::part_cache(const std::string &path)
+    : m_path(path)
+{
+  if (!m_path.empty() && *(m_path.rbegin()) != '/' && *(m_path.rbegin()) != '\\')
+    m_path += DIRECTORY_SEPARATOR;
+
+#ifdef _MSC_VER
+  _mkdir(m_path.c_str());
+#else
+  mkdir(m_path.c_str(), 0755);
+#endif
+}
+
+std::string part_cache::image_filename(const std::string &filename) const
+{
+  // FNV-1a; collisions are caught by the source path stored in the image
+  uint64_t hash = 14695981039346656037ULL;
+  for (std::string::const_iterator it = filename.begin(); it != filename.end(); ++it) {
+    hash ^= (unsigned char) *it;
+    hash *= 1099511628211ULL;
+  }
+
+  char buf[24];
+  std::sprintf(buf, "%016llx", (unsigned long long) hash);
+
+  return m_path + buf + ".bin";
+}
+
+model_multipart* part_cache::load(const std::string &filename, bool geometry, file_stamp *stamp, stamp_map *dependencies) const
+{
+  file_stamp current;
+
+  if (!file_stamp::take(filename, &current))
+    return 0L;
+
+  mapped_file file;
+  if (!file.open(image_filename(filename)))
+    return 0L;
+
+  binary_reader r(file.data(), file.size());
+
+  char magic[sizeof(image_magic)];
+  for (unsigned int i = 0; i < sizeof(magic); ++i)
+    magic[i] = r.get<char>();
+
+  if (std::memcmp(magic, image_magic, sizeof(magic)) != 0 || r.get<uint32_t>() != image_version ||
+      r.get<uint32_t>() != image_byte_order || r.get<int64_t>() != current.mtime || r.get<uint64_t>() != current.size ||
+      r.get_string() != filename || !r.ok())
+    return 0L;
+
+  uint32_t ndeps = r.get<uint32_t>();
+  stamp_map deps;
+
+  for (uint32_t i = 0; i < ndeps && r.ok(); ++i) {
+    std::string path = r.get_string();
+    file_stamp written, now;
+
+    written.mtime = r.get<int64_t>();
+    written.size = r.get<uint64_t>();
+
+    if (!file_stamp::take(path, &now) || now != written)
+      return 0L;
+
+    deps[path] = written;
+  }
+
+  if (!r.ok())
+    return 0L;
+
+  if (stamp)
+    *stamp = current;
+  if (dependencies)
+    dependencies->swap(deps);
+
+  model_multipart *nm = new model_multipart;
+  uint32_t count = r.get<uint32_t>();
+
+  for (uint32_t i = 0; i < count && r.ok(); ++i) {
+    std::string key = r.get_string();
+    model *m;
+
+    if (i == 0) {
+      m = nm->main_model();
+    } else {
+      m = new model;
+      m->set_parent(nm);
+    }
+
+    m->set_name(r.get_string());
+    m->set_desc(r.get_string());
+    m->set_author(r.get_string());
+    m->set_modeltype((model::model_type)r.get<uint8_t>());
+
+    uint32_t headers = r.get<uint32_t>();
+    for (uint32_t j = 0; j < headers && r.ok(); ++j) {
+      std::string hkey = r.get_string();
+      m->set_header(hkey, r.get_string());
+    }
+
+    uint8_t flags = r.get<uint8_t>();
+    if (flags & has_bfc) {
+      bfc_certification *c = m->init_custom_data<bfc_certification>();
+      c->set_certification((bfc_certification::cert_status)r.get<uint8_t>());
+      c->set_orientation((bfc_certification::winding)r.get<uint8_t>());
+    }
+    if (flags & has_metrics) {
+      vector min = r.get_vector();
+      vector max = r.get_vector();
+      *m->init_custom_data<metrics>() = metrics(min, max);
+    }
+    
+    if (!geometry) {
+      if (count == 1 && (flags & has_metrics) && r.ok())
+        return nm;
+      
+      delete nm;
+      return 0L;
+    }
+
+    uint32_t elements = r.get<uint32_t>();
+    for (uint32_t j = 0; j < elements && r.ok(); ++j) {
+      element_base *e = read_element(r, &m->m_arena);
+      if (e)
+        m->insert_element(e);
+    }
+
+    if (i > 0 && (!r.ok() || !nm->insert_submodel(m, key)))
+      delete m;
+  }
+
+  if (!r.ok()) {
+    delete nm;
+    return 0L;
+  }
+
+  if (count > 1)
+    nm->link_submodels();
+
+  return nm;
+}
+
+bool part_cache::store(const std::string &filename, const file_stamp &stamp, const model_multipart *m, const stamp_map &dependencies) const
+{
+  binary_writer w;
+
+  for (unsigned int i = 0; i < sizeof(image_magic); ++i)
+    w.put<char>(image_magic[i]);
+  w.put<uint32_t>(image_version);
+  w.put<uint32_t>(image_byte_order);
+  w.put<int64_t>(stamp.mtime);
+  w.put<uint64_t>(stamp.size);
+  w.put(filename);
+
+  w.put<uint32_t>(dependencies.size());
+  for (stamp_map::const_iterator it = dependencies.begin(); it != dependencies.end(); ++it) {
+    w.put((*it).first);
+    w.put<int64_t>((*it).second.mtime);
+    w.put<uint64_t>((*it).second.size);
+  }
+
+  w.put<uint32_t>(1 + m->submodel_list().size());
+  write_model(w, std::string(), m->main_model());
+  for (model_multipart::submodel_const_iterator it = m->submodel_list().begin(); it != m->submodel_list().end(); ++it)
+    write_model(w, (*it).first, (*it).second);
+
+  // write aside and rename, so that readers never see a partial image
+  std::string target = image_filename(filename);
+  std::string temp = target + ".tmp";
+
+  std::ofstream file(temp.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!file.is_open())
+    return false;
+
+  file.write(w.buffer().data(), w.buffer().length());
+  file.close();
+
+  if (!file) {
+    std::remove(temp.c_str());
+    return false;
+  }
+
+#ifdef _MSC_VER
+  std::remove(target.c_str());
+#endif
+  if (std::rename(temp.c_str(), target.c_str()) != 0) {
+    std::remove(temp.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+}
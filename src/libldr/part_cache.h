@@ -0,0 +1,70 @@
+/* libLDR: Portable and easy-to-use LDraw format abstraction & I/O reference library *
+ * To obtain more information about LDraw, visit http://www.ldraw.org.               *
+ * Distributed in terms of the GNU Lesser General Public License v3                  *
+ *                                                                                   *
+ * Author: (c)2006-2013 Park "segfault" J. K. <mastermind_at_planetmono_dot_org>     */
+
+#ifndef _LIBLDR_PART_CACHE_H_
+#define _LIBLDR_PART_CACHE_H_
+
+#include <map>
+#include <string>
+#include <stdint.h>
+
+#include "common.h"
+
+namespace ldraw
+{
+
+class model;
+class model_multipart;
+
+// Modification time (to the nanosecond where the system keeps it) and size
+// of a file as it was read.
+struct LIBLDR_EXPORT file_stamp
+{
+  int64_t mtime;
+  uint64_t size;
+  
+  bool operator==(const file_stamp &rhs) const { return mtime == rhs.mtime && size == rhs.size; }
+  bool operator!=(const file_stamp &rhs) const { return !(*this == rhs); }
+  
+  // false if the file is not there
+  static bool take(const std::string &filename, file_stamp *stamp);
+};
+
+// path -> stamp
+typedef std::map<std::string, file_stamp> stamp_map;
+
+// On-disk cache of parsed part files. Each source file is stored as a
+// binary image (elements, headers, BFC certification and metrics) keyed by
+// its path, modification time and size; images are loaded through mmap.
+// The metrics depend on the subparts and primitives as well, so an image
+// also goes out of date when any of the files it lists as dependencies does.
+class LIBLDR_EXPORT part_cache
+{
+ public:
+  part_cache(const std::string &path);
+  ~part_cache() {}
+
+  const std::string& path() const { return m_path; }
+
+  // Returns 0L when there is no image for the file or it is out of date.
+  // Without geometry only the header and bounds of a single-part image are
+  // read, and 0L is returned if the image carries no bounds. stamp and
+  // dependencies, if given, receive what the image was checked against.
+  model_multipart* load(const std::string &filename, bool geometry = true, file_stamp *stamp = 0L, stamp_map *dependencies = 0L) const;
+  // stamp is that of the file, and dependencies those of the library files
+  // the linked model draws on at any depth, all taken before they were
+  // read; a file changed while being parsed thus fails the next load().
+  bool store(const std::string &filename, const file_stamp &stamp, const model_multipart *m, const stamp_map &dependencies) const;
+
+ private:
+  std::string image_filename(const std::string &filename) const;
+
+  std::string m_path;
+};
+
+}
+
+#endif
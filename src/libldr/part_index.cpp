@@ -0,0 +1,251 @@
+/* libLDR: Portable and easy-to-use LDraw format abstraction & I/O reference library *
+ * To obtain more information about LDraw, visit http://www.ldraw.org.               *
+ * Distributed in terms of the GNU Lesser General Public License v3                  *
+ *                                                                                   *
+ * Author: (c)2006-2013 Park "segfault" J. K. <mastermind_at_planetmono_dot_org>     */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <cstdio>
+#include <fstream>
+
+#include "binary_stream.h"
+#include "mapped_file.h"
+#include "utils.h"
+
+#include "part_index.h"
+
+/* Index layout (native byte order):
+ *
+ *   magic[8] version:u32 byte_order:u32
+ *   directories:u32 { path:str mtime:i64 files:u32 { key:str name:str } subdirs:u32 { name:str } }
+ */
+
+namespace ldraw
+{
+
+namespace
+{
+
+const char index_magic[8] = { 'L', 'D', 'R', 'I', 'N', 'D', 'E', 'X' };
+const uint32_t index_version = 2;
+const uint32_t index_byte_order = 0x01020304;
+
+// guards against symlink loops
+const int max_depth = 16;
+
+bool directory_mtime(const std::string &path, int64_t *mtime)
+{
+  struct stat st;
+
+  if (stat(path.c_str(), &st) != 0)
+    return false;
+
+#if defined(__linux__)
+  // a second is too coarse to notice a file added right after a scan
+  *mtime = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#else
+  *mtime = st.st_mtime;
+#endif
+
+  return true;
+}
+
+}
+
+part_index::part_index()
+    : m_notify(-1)
+{
+}
+
+part_index::~part_index()
+{
+  unwatch();
+}
+
+bool part_index::load(const std::string &filename)
+{
+  mapped_file file;
+  if (!file.open(filename))
+    return false;
+
+  binary_reader r(file.data(), file.size());
+
+  char magic[sizeof(index_magic)];
+  for (unsigned int i = 0; i < sizeof(magic); ++i)
+    magic[i] = r.get<char>();
+
+  if (std::memcmp(magic, index_magic, sizeof(magic)) != 0 || r.get<uint32_t>() != index_version ||
+      r.get<uint32_t>() != index_byte_order || !r.ok())
+    return false;
+
+  std::map<std::string, directory> dirs;
+  uint32_t count = r.get<uint32_t>();
+
+  for (uint32_t i = 0; i < count && r.ok(); ++i) {
+    directory &d = dirs[r.get_string()];
+
+    d.mtime = r.get<int64_t>();
+
+    uint32_t files = r.get<uint32_t>();
+    for (uint32_t j = 0; j < files && r.ok(); ++j) {
+      std::string key = r.get_string();
+      d.files.push_back(std::make_pair(key, r.get_string()));
+    }
+
+    uint32_t subdirs = r.get<uint32_t>();
+    for (uint32_t j = 0; j < subdirs && r.ok(); ++j)
+      d.subdirs.push_back(r.get_string());
+  }
+
+  if (!r.ok())
+    return false;
+
+  m_dirs.swap(dirs);
+
+  return true;
+}
+
+bool part_index::save(const std::string &filename) const
+{
+  binary_writer w;
+
+  for (unsigned int i = 0; i < sizeof(index_magic); ++i)
+    w.put<char>(index_magic[i]);
+  w.put<uint32_t>(index_version);
+  w.put<uint32_t>(index_byte_order);
+
+  w.put<uint32_t>(m_dirs.size());
+  for (std::map<std::string, directory>::const_iterator it = m_dirs.begin(); it != m_dirs.end(); ++it) {
+    const directory &d = (*it).second;
+
+    w.put((*it).first);
+    w.put<int64_t>(d.mtime);
+
+    w.put<uint32_t>(d.files.size());
+    for (file_list::const_iterator fit = d.files.begin(); fit != d.files.end(); ++fit) {
+      w.put((*fit).first);
+      w.put((*fit).second);
+    }
+
+    w.put<uint32_t>(d.subdirs.size());
+    for (std::vector<std::string>::const_iterator sit = d.subdirs.begin(); sit != d.subdirs.end(); ++sit)
+      w.put(*sit);
+  }
+
+  // write aside and rename, as the part cache does
+  std::string temp = filename + ".tmp";
+  std::ofstream file(temp.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!file.is_open())
+    return false;
+
+  file.write(w.buffer().data(), w.buffer().length());
+  file.close();
+
+  if (!file) {
+    std::remove(temp.c_str());
+    return false;
+  }
+
+#ifdef _MSC_VER
+  std::remove(filename.c_str());
+#endif
+  if (std::rename(temp.c_str(), filename.c_str()) != 0) {
+    std::remove(temp.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+bool part_index::update(const std::vector<std::string> &roots)
+{
+  std::set<std::string> visited;
+  bool changed = false;
+
+  for (std::vector<std::string>::const_iterator it = roots.begin(); it != roots.end(); ++it)
+    changed |= update_directory(*it, 0, &visited);
+
+  // forget directories that disappeared
+  std::map<std::string, directory>::iterator it = m_dirs.begin();
+  while (it != m_dirs.end()) {
+    if (visited.find((*it).first) == visited.end()) {
+      m_dirs.erase(it++);
+      changed = true;
+    } else {
+      ++it;
+    }
+  }
+
+  return changed;
+}
+
+bool part_index::update_directory(const std::string &path, int depth, std::set<std::string> *visited)
+{
+  int64_t mtime;
+
+  if (depth > max_depth || !visited->insert(path).second || !directory_mtime(path, &mtime))
+    return false;
+
+  bool changed = false;
+  std::map<std::string, directory>::iterator it = m_dirs.find(path);
+
+  if (it == m_dirs.end() || (*it).second.mtime != mtime) {
+    std::vector<std::string> names, subdirs;
+
+    if (!read_directory(path, &names, &subdirs)) {
+      visited->erase(path);
+      return false;
+    }
+
+    directory &d = m_dirs[path];
+    d.mtime = mtime;
+    d.files.clear();
+    d.subdirs.swap(subdirs);
+
+    for (std::vector<std::string>::iterator nit = names.begin(); nit != names.end(); ++nit) {
+      std::string key = utils::translate_string(*nit);
+
+      // compressed parts are known by their uncompressed name
+      if (key.length() > 7 && key.compare(key.length() - 7, 7, ".dat.gz") == 0)
+        key.erase(key.length() - 3);
+      else if (key.length() <= 4 || key.compare(key.length() - 4, 4, ".dat") != 0)
+        continue;
+
+      d.files.push_back(std::make_pair(key, *nit));
+    }
+
+    changed = true;
+    it = m_dirs.find(path);
+  }
+
+  const std::vector<std::string> &subdirs = (*it).second.subdirs;
+  for (std::vector<std::string>::const_iterator sit = subdirs.begin(); sit != subdirs.end(); ++sit)
+    changed |= update_directory(path + DIRECTORY_SEPARATOR + *sit, depth + 1, visited);
+
+  return changed;
+}
+
+void part_index::files(const std::string &root, file_list *list) const
+{
+  files(root, std::string(), std::string(), 0, list);
+}
+
+void part_index::files(const std::string &path, const std::string &prefix, const std::string &keyprefix, int depth, file_list *list) const
+{
+  std::map<std::string, directory>::const_iterator it = m_dirs.find(path);
+
+  if (depth > max_depth || it == m_dirs.end())
+    return;
+
+  const directory &d = (*it).second;
+
+  for (file_list::const_iterator fit = d.files.begin(); fit != d.files.end(); ++fit)
+    list->push_back(std::make_pair(keyprefix + (*fit).first, prefix + (*fit).second));
+
+  for (std::vector<std::string>::const_iterator sit = d.subdirs.begin(); sit != d.subdirs.end(); ++sit)
+    files(path + DIRECTORY_SEPARATOR + *sit, prefix + *sit + DIRECTORY_SEPARATOR, keyprefix + utils::translate_string(*sit) + "/", depth + 1, list);
+}
+
+}
@@ -0,0 +1,72 @@
+/* libLDR: Portable and easy-to-use LDraw format abstraction & I/O reference library *
+ * To obtain more information about LDraw, visit http://www.ldraw.org.               *
+ * Distributed in terms of the GNU Lesser General Public License v3                  *
+ *                                                                                   *
+ * Author: (c)2006-2013 Park "segfault" J. K. <mastermind_at_planetmono_dot_org>     */
+
+#ifndef _LIBLDR_PART_INDEX_H_
+#define _LIBLDR_PART_INDEX_H_
+
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+#include <stdint.h>
+
+#include "common.h"
+
+namespace ldraw
+{
+
+// Recursive listing of the .dat (or .dat.gz) files below a set of library directories.
+// The listing can be saved and loaded again; update() then only re-reads the
+// directories whose modification time changed since.
+class LIBLDR_EXPORT part_index
+{
+ public:
+  // (case-folded key, path as on disk), both relative to the root
+  typedef std::vector<std::pair<std::string, std::string> > file_list;
+
+  part_index();
+  ~part_index();
+
+  bool load(const std::string &filename);
+  bool save(const std::string &filename) const;
+
+  // Brings the listing of the given roots up to date and drops everything
+  // else. Returns true if anything changed.
+  bool update(const std::vector<std::string> &roots);
+
+  void files(const std::string &root, file_list *list) const;
+
+  // Watches the indexed directories (inotify on Linux). pending() tells
+  // whether update() could find anything new; without a watch it always can.
+  void watch();
+  bool pending();
+
+ private:
+  struct directory
+  {
+    int64_t mtime;
+    file_list files;
+    std::vector<std::string> subdirs;
+  };
+
+  bool update_directory(const std::string &path, int depth, std::set<std::string> *visited);
+  void files(const std::string &path, const std::string &prefix, const std::string &keyprefix, int depth, file_list *list) const;
+  void unwatch();
+
+  // platform-specific
+  static bool read_directory(const std::string &path, std::vector<std::string> *files, std::vector<std::string> *dirs);
+
+  std::map<std::string, directory> m_dirs;
+
+  // platform-specific watch state
+  int m_notify;
+  std::map<int, std::string> m_watches;
+};
+
+}
+
+#endif
@@ -0,0 +1,119 @@
+/* libLDR: Portable and easy-to-use LDraw format abstraction & I/O reference library *
+ * To obtain more information about LDraw, visit http://www.ldraw.org.               *
+ * Distributed in terms of the GNU Lesser General Public License v3                  *
+ *                                                                                   *
+ * Author: (c)2006-2013 Park "segfault" J. K. <mastermind_at_planetmono_dot_org>     */
+
+#ifndef _MSC_VER
+
+/* platform-specific directory listing and change notification for POSIX compatible systems */
+
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/inotify.h>
+#endif
+
+#include "part_index.h"
+
+namespace ldraw
+{
+
+bool part_index::read_directory(const std::string &path, std::vector<std::string> *files, std::vector<std::string> *dirs)
+{
+  DIR *de;
+  struct dirent *ep;
+  struct stat st;
+
+  if ((de = opendir(path.c_str())) == 0L)
+    return false;
+
+  while ((ep = readdir(de))) {
+    std::string name = ep->d_name;
+
+    if (name.empty() || name[0] == '.')
+      continue;
+
+    bool isdir;
+#ifdef _DIRENT_HAVE_D_TYPE
+    if (ep->d_type != DT_UNKNOWN && ep->d_type != DT_LNK)
+      isdir = ep->d_type == DT_DIR;
+    else
+#endif
+      isdir = stat((path + DIRECTORY_SEPARATOR + name).c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+
+    if (isdir)
+      dirs->push_back(name);
+    else
+      files->push_back(name);
+  }
+  closedir(de);
+
+  return true;
+}
+
+#if defined(__linux__)
+
+void part_index::watch()
+{
+  unwatch();
+
+  if ((m_notify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0)
+    return;
+
+  for (std::map<std::string, directory>::const_iterator it = m_dirs.begin(); it != m_dirs.end(); ++it) {
+    int wd = inotify_add_watch(m_notify, (*it).first.c_str(), IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF);
+
+    if (wd >= 0)
+      m_watches[wd] = (*it).first;
+  }
+}
+
+void part_index::unwatch()
+{
+  if (m_notify >= 0)
+    close(m_notify);
+
+  m_notify = -1;
+  m_watches.clear();
+}
+
+bool part_index::pending()
+{
+  if (m_notify < 0)
+    return true;
+
+  // drain the queue; the events themselves are not needed as update()
+  // finds the changed directories by their mtime
+  char buf[4096];
+  bool changed = false;
+
+  while (read(m_notify, buf, sizeof(buf)) > 0)
+    changed = true;
+
+  return changed;
+}
+
+#else
+
+void part_index::watch()
+{
+}
+
+void part_index::unwatch()
+{
+}
+
+bool part_index::pending()
+{
+  return true;
+}
+
+#endif
+
+}
+
+#endif
@@ -0,0 +1,59 @@
+/* libLDR: Portable and easy-to-use LDraw format abstraction & I/O reference library *
+ * To obtain more information about LDraw, visit http://www.ldraw.org.               *
+ * Distributed in terms of the GNU Lesser General Public License v3                  *
+ *                                                                                   *
+ * Author: (c)2006-2013 Park "segfault" J. K. <mastermind_at_planetmono_dot_org>     */
+
+#ifdef _MSC_VER
+
+/* platform-specific directory listing for MSVC compiler */
+
+#include <Windows.h>
+
+#include "part_index.h"
+
+namespace ldraw
+{
+
+bool part_index::read_directory(const std::string &path, std::vector<std::string> *files, std::vector<std::string> *dirs)
+{
+  WIN32_FIND_DATA ffd;
+  HANDLE hFind = FindFirstFile((path + "\\*").c_str(), &ffd);
+
+  if (hFind == INVALID_HANDLE_VALUE)
+    return false;
+
+  do {
+    std::string name = ffd.cFileName;
+
+    if (name.empty() || name[0] == '.')
+      continue;
+
+    if (ffd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+      dirs->push_back(name);
+    else
+      files->push_back(name);
+  } while (FindNextFile(hFind, &ffd) != 0);
+  FindClose(hFind);
+
+  return true;
+}
+
+// no change notification; refreshing falls back to comparing mtimes
+
+void part_index::watch()
+{
+}
+
+void part_index::unwatch()
+{
+}
+
+bool part_index::pending()
+{
+  return true;
+}
+
+}
+
+#endif
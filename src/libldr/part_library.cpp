@@ -7,10 +7,20 @@
 #include <sys/types.h>
 
 #include <algorithm>
+#include <condition_variable>
 #include <cstdlib>
+#include <deque>
+#include <exception>
 #include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
 
+#include "elements.h"
+#include "metrics.h"
 #include "model.h"
+#include "part_cache.h"
+#include "part_index.h"
 #include "reader.h"
 #include "utils.h"
 
@@ -41,6 +51,147 @@ static const std::string predefined_path[] = {
 };
 #endif
 
+/* Breadth-first prefetch of everything a model depends on. Worker threads
+ * parse the files; newly discovered references are queued as each one
+ * finishes. Nothing here touches m_data, so results are merged afterwards.
+ * A file that fails to load is left to link_element(); any other error
+ * stops the prefetch and is rethrown by prefetch() on the calling thread. */
+struct part_library::prefetch_state
+{
+  struct item
+  {
+    atom key;
+    std::string path;
+    model::model_type type;
+    model_multipart *result;
+    load_source source;
+    file_stamp stamp;
+    stamp_map dependencies;
+  };
+  
+  prefetch_state(const part_library *l) : lib(l), busy(0) {}
+  ~prefetch_state();
+  
+  void scan(model_multipart *m);
+  void scan_model(model *m, model_multipart *mp);
+  void run();
+  
+  const part_library *lib;
+  std::mutex mutex;
+  std::condition_variable cond;
+  std::set<atom> seen;
+  std::deque<item *> pending;
+  std::vector<item *> done;
+  int busy;
+  // first error that was not the file's fault, for prefetch() to rethrow
+  std::exception_ptr failure;
+};
+
+part_library::prefetch_state::~prefetch_state()
+{
+  for (std::deque<item *>::iterator it = pending.begin(); it != pending.end(); ++it)
+    delete *it;
+  for (std::vector<item *>::iterator it = done.begin(); it != done.end(); ++it)
+    delete *it;
+}
+
+// must be called with the mutex held
+void part_library::prefetch_state::scan(model_multipart *m)
+{
+  if (!m->main_model()->is_resident())
+    return;
+  
+  scan_model(m->main_model(), m);
+  
+  std::map<std::string, model*> &list = m->submodel_list();
+  for (std::map<std::string, model*>::iterator it = list.begin(); it != list.end(); ++it)
+    scan_model((*it).second, m);
+}
+
+void part_library::prefetch_state::scan_model(model *m, model_multipart *mp)
+{
+  for (int i = 0; i < m->size(); ++i) {
+    if (m->at(i)->get_type() != type_ref)
+      continue;
+    
+    element_ref *r = CAST_AS_REF(m->at(i));
+    if (r->get_model())
+      continue;
+    
+    // same lookup order as link_element()
+    atom fn = r->filename_atom().folded();
+    if (seen.find(fn) != seen.end() || mp->find_submodel(fn.str()) || lib->m_data.find(fn) != lib->m_data.end())
+      continue;
+    
+    seen.insert(fn);
+    
+    item *n;
+    std::map<std::string, std::string>::const_iterator it;
+    if ((it = lib->m_primlist.find(fn.str())) != lib->m_primlist.end()) {
+      n = new item;
+      n->path = lib->m_ldrawpath + DIRECTORY_SEPARATOR + lib->m_primdir + DIRECTORY_SEPARATOR + (*it).second;
+      n->type = model::primitive;
+    } else if ((it = lib->m_partlist.find(fn.str())) != lib->m_partlist.end()) {
+      n = new item;
+      n->path = lib->m_ldrawpath + DIRECTORY_SEPARATOR + lib->m_partsdir + DIRECTORY_SEPARATOR + (*it).second;
+      n->type = model::part;
+    } else {
+      continue;
+    }
+    
+    n->key = fn;
+    n->result = 0L;
+    n->source = load_parsed;
+    pending.push_back(n);
+  }
+}
+
+void part_library::prefetch_state::run()
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  
+  for (;;) {
+    while (pending.empty() && busy > 0)
+      cond.wait(lock);
+    
+    if (pending.empty())
+      break;
+    
+    item *n = pending.front();
+    pending.pop_front();
+    ++busy;
+    
+    std::exception_ptr error;
+    
+    lock.unlock();
+    try {
+      n->result = lib->load_file(n->path, &n->source, &n->stamp, &n->dependencies);
+    } catch (const exception &) {
+      // left to link_element(), which reports the failure as usual
+      n->result = 0L;
+    } catch (...) {
+      n->result = 0L;
+      error = std::current_exception();
+    }
+    lock.lock();
+    
+    if (error && !failure) {
+      // hand out no more work; the workers still busy finish their file
+      failure = error;
+      for (std::deque<item *>::iterator it = pending.begin(); it != pending.end(); ++it)
+        delete *it;
+      pending.clear();
+    }
+    
+    if (n->result && !failure)
+      scan(n->result);
+    done.push_back(n);
+    --busy;
+    
+    cond.notify_all();
+  }
+}
+
 item_refcount::item_refcount()
 {
   first = 0L, second = 0;
@@ -57,9 +208,25 @@ item_refcount::~item_refcount()
     delete first;
 }
 
-part_library::part_library()
+part_library::part_library(const std::string &path, const std::string &cache_path)
 {
   m_unlink_policy = parts | primitives;
+  m_worker_threads = std::max(1, (int)std::thread::hardware_concurrency());
+  m_residency_policy = full_residency;
+  m_cache = 0L;
+  m_index = new part_index();
+  
+  // the index is kept next to the part images
+  set_cache_path(cache_path);
+  
+  if (!path.empty()) {
+    if (read_fs(path))
+      return;
+    
+    delete m_cache;
+    delete m_index;
+    throw exception(__func__, exception::fatal, "Couldn't find LDraw part library.");
+  }
   
   char *tmp = getenv("LDRAWDIR");
   
@@ -77,27 +244,52 @@ part_library::part_library()
     }
   }
   
+  delete m_cache;
+  delete m_index;
   throw exception(__func__, exception::fatal, "Couldn't find LDraw part library. Please install valid LDraw part library and make sure that \"LDRAWDIR\" environment variable is set!");
 }
 
-part_library::part_library(const std::string &path)
-{
-  m_unlink_policy = parts | primitives;
-  
-  if(!read_fs(path))
-    throw exception(__func__, exception::fatal, "Couldn't find LDraw part library.");
-}
-
 part_library::~part_library()
 {
+  delete m_cache;
+  delete m_index;
+  
   // FIXME Apparently not working.
   
 #if 0
-  for (std::map<std::string, item_refcount*>::iterator it = m_data.begin(); it != m_data.end(); ++it)
+  for (std::map<atom, item_refcount*>::iterator it = m_data.begin(); it != m_data.end(); ++it)
     delete (*it).second;
 #endif
 }
 
+std::string part_library::cache_path() const
+{
+  if (!m_cache)
+    return std::string();
+  
+  return m_cache->path();
+}
+
+void part_library::set_cache_path(const std::string &path)
+{
+  delete m_cache;
+  
+  if (path.empty())
+    m_cache = 0L;
+  else
+    m_cache = new part_cache(path);
+}
+
+bool part_library::refresh()
+{
+  if (!m_index->pending() || !update_index())
+    return false;
+  
+  update_lists();
+  
+  return true;
+}
+
 std::string part_library::ldrawpath(path_type path_type) const
 {
   switch (path_type) {
@@ -119,7 +311,9 @@ std::string part_library::ldrawpath(const std::string &filename, path_type path_
 
 bool part_library::find(const std::string &name) const
 {
-  std::string lowercase = utils::translate_string(name);
+  // the lists are not interned, and a lookup should not grow the atom table
+  atom key = atom::find_folded(name);
+  const std::string lowercase = key.empty() ? utils::translate_string(name) : key.str();
   
   if (m_partlist.find(lowercase) != m_partlist.end())
     return true;
@@ -129,8 +323,98 @@ bool part_library::find(const std::string &name) const
   return false;
 }	
 
+bool part_library::read_index()
+{
+  std::string path = index_path();
+  
+  if (!path.empty())
+    m_index->load(path);
+  
+  update_index();
+  update_lists();
+  
+  // a failed scan of parts/ leaves nothing to link against
+  if (m_partlist.empty()) {
+    std::cerr << "[libLDR] Couldn't open parts/." << std::endl;
+    return false;
+  }
+  
+  return true;
+}
+
+// The index is only saved next to a part cache; without one it lives in
+// memory and the next start scans the library again.
+bool part_library::update_index()
+{
+  if (!m_index->update(index_roots()))
+    return false;
+  
+  if (m_cache && !m_index->save(index_path()))
+    std::cerr << "[libLDR] Couldn't write part index." << std::endl;
+  
+  return true;
+}
+
+void part_library::update_lists()
+{
+  std::vector<std::string> roots = index_roots();
+  
+  m_primlist.clear();
+  m_partlist.clear();
+  
+  // official parts first, so that they win over unofficial ones of the same
+  // name. Unofficial entries are made relative to the official directory, as
+  // lookups prepend ldrawpath(ldraw_parts_path) and friends.
+  merge_list(m_primlist, roots[0], std::string());
+  merge_list(m_partlist, roots[1], std::string());
+  
+  std::string up = std::string("..") + DIRECTORY_SEPARATOR + m_unofficialdir + DIRECTORY_SEPARATOR;
+  std::vector<std::string>::const_iterator it = roots.begin() + 2;
+  if (!m_unofficial_primdir.empty())
+    merge_list(m_primlist, *it++, up + m_unofficial_primdir + DIRECTORY_SEPARATOR);
+  if (!m_unofficial_partsdir.empty())
+    merge_list(m_partlist, *it++, up + m_unofficial_partsdir + DIRECTORY_SEPARATOR);
+  
+  m_index->watch();
+}
+
+void part_library::merge_list(std::map<std::string, std::string> &list, const std::string &root, const std::string &prefix) const
+{
+  part_index::file_list files;
+  m_index->files(root, &files);
+  
+  for (part_index::file_list::iterator it = files.begin(); it != files.end(); ++it)
+    list.insert(std::make_pair((*it).first, prefix + (*it).second));
+}
+
+std::vector<std::string> part_library::index_roots() const
+{
+  std::vector<std::string> roots;
+  std::string udir = m_ldrawpath + DIRECTORY_SEPARATOR + m_unofficialdir + DIRECTORY_SEPARATOR;
+  
+  roots.push_back(ldrawpath(ldraw_primitives_path));
+  roots.push_back(ldrawpath(ldraw_parts_path));
+  if (!m_unofficial_primdir.empty())
+    roots.push_back(udir + m_unofficial_primdir);
+  if (!m_unofficial_partsdir.empty())
+    roots.push_back(udir + m_unofficial_partsdir);
+  
+  return roots;
+}
+
+std::string part_library::index_path() const
+{
+  if (!m_cache)
+    return std::string();
+  
+  return m_cache->path() + "library.idx";
+}
+
 void part_library::link(model_multipart *m)
 {
+  if (m_worker_threads > 1)
+    prefetch(m);
+  
   link_model(m->main_model());
   
   std::map<std::string, model*> &list = m->submodel_list();
@@ -140,7 +424,7 @@ void part_library::link(model_multipart *m)
 
 bool part_library::link_element(element_ref *r)
 {
-  reader nil;
+  load_source source;
   
   if (r->get_model())
     return true;
@@ -148,7 +432,7 @@ bool part_library::link_element(element_ref *r)
   if (r->linkpoint())
     r->linkpoint()->unlink_element(r);
   
-  std::string fn = utils::translate_string(r->filename());
+  atom fn = r->filename_atom().folded();
   
   // 1. find the submodel if multipart
   if (r->parent() && r->parent()->parent())
@@ -156,7 +440,7 @@ bool part_library::link_element(element_ref *r)
       return true;
   
   // 2. find the model pool.
-  std::map<std::string, item_refcount*>::iterator it1 = m_data.find(fn);
+  std::map<atom, item_refcount*>::iterator it1 = m_data.find(fn);
   if (it1 != m_data.end()) {
     (*it1).second->acquire();
     r->set_model((*it1).second->model()->main_model());
@@ -165,27 +449,45 @@ bool part_library::link_element(element_ref *r)
   }
   
   // 3. find the primitive list
-  std::map<std::string, std::string>::iterator it2 = m_primlist.find(fn);
+  std::map<std::string, std::string>::iterator it2 = m_primlist.find(fn.str());
   if (it2 != m_primlist.end()) {
-    model_multipart *n = nil.load_from_file(m_ldrawpath + DIRECTORY_SEPARATOR + m_primdir + DIRECTORY_SEPARATOR + (*it2).second);
+    std::string path = m_ldrawpath + DIRECTORY_SEPARATOR + m_primdir + DIRECTORY_SEPARATOR + (*it2).second;
+    file_stamp stamp;
+    stamp_map deps;
+    model_multipart *n = load_file(path, &source, &stamp, &deps);
+    if (m_cache)
+      m_stamps[path] = stamp;
+    if (source == load_deferred)
+      defer_geometry(n->main_model(), path, deps);
     link(n);
     r->set_model(n->main_model());
     n->main_model()->set_modeltype(model::primitive);
-    m_data[(*it2).first] = new item_refcount(n);
-    m_data[(*it2).first]->acquire();
+    if (source == load_parsed)
+      store_file(path, stamp, n);
+    m_data[fn] = new item_refcount(n);
+    m_data[fn]->acquire();
     r->resolve(this);
     return true;
   }
   
   // 4. find the parts list
-  std::map<std::string, std::string>::iterator it3 = m_partlist.find(fn);
+  std::map<std::string, std::string>::iterator it3 = m_partlist.find(fn.str());
   if (it3 != m_partlist.end()) {
-    model_multipart *n = nil.load_from_file(m_ldrawpath + DIRECTORY_SEPARATOR + m_partsdir + DIRECTORY_SEPARATOR + (*it3).second);
+    std::string path = m_ldrawpath + DIRECTORY_SEPARATOR + m_partsdir + DIRECTORY_SEPARATOR + (*it3).second;
+    file_stamp stamp;
+    stamp_map deps;
+    model_multipart *n = load_file(path, &source, &stamp, &deps);
+    if (m_cache)
+      m_stamps[path] = stamp;
+    if (source == load_deferred)
+      defer_geometry(n->main_model(), path, deps);
     link(n);
     r->set_model(n->main_model());
     n->main_model()->set_modeltype(model::part);
-    m_data[(*it3).first] = new item_refcount(n);
-    m_data[(*it3).first]->acquire();
+    if (source == load_parsed)
+      store_file(path, stamp, n);
+    m_data[fn] = new item_refcount(n);
+    m_data[fn]->acquire();
     r->resolve(this);
     return true;
   }
@@ -233,17 +535,19 @@ void part_library::unlink_element(element_ref *r)
   if (r->linkpoint() != this)
     return;
   
-  std::string fn = utils::translate_string(r->filename());
+  atom fn = r->filename_atom().folded();
   
   if (r->get_model() && (r->get_model()->modeltype() == model::submodel || r->get_model()->modeltype() == model::external_file))
     return;
   
-  std::map<std::string, item_refcount*>::iterator it = m_data.find(fn);
+  std::map<atom, item_refcount*>::iterator it = m_data.find(fn);
   if (r->get_model() && it != m_data.end()) {
     (*it).second->release();
     if (!(*it).second->refcount()) {
       if (((*it).second->model()->main_model()->modeltype() == model::part && m_unlink_policy & parts) ||
           ((*it).second->model()->main_model()->modeltype() == model::primitive && m_unlink_policy & primitives)) {
+        m_deferred.erase((*it).second->model()->main_model());
+        m_deferred_dependencies.erase((*it).second->model()->main_model());
         delete (*it).second;
         m_data.erase(it);
       }
@@ -254,8 +558,204 @@ void part_library::unlink_element(element_ref *r)
   r->resolve(0L);
 }
 
+void part_library::prefetch(model_multipart *m)
+{
+  prefetch_state state(this);
+  
+  state.scan(m);
+  if (state.pending.empty())
+    return;
+  
+  std::vector<std::thread> workers;
+  for (int i = 0; i < m_worker_threads; ++i)
+    workers.push_back(std::thread(&prefetch_state::run, &state));
+  for (std::vector<std::thread>::iterator it = workers.begin(); it != workers.end(); ++it)
+    (*it).join();
+  
+  if (state.failure) {
+    for (std::vector<prefetch_state::item *>::iterator it = state.done.begin(); it != state.done.end(); ++it)
+      delete (*it)->result;
+    std::rethrow_exception(state.failure);
+  }
+  
+  // Merge into the pool first so that linking the prefetched models below
+  // finds their dependencies there instead of loading them again.
+  std::vector<prefetch_state::item *>::iterator it;
+  for (it = state.done.begin(); it != state.done.end(); ++it) {
+    if ((*it)->result) {
+      (*it)->result->main_model()->set_modeltype((*it)->type);
+      if (m_cache)
+        m_stamps[(*it)->path] = (*it)->stamp;
+      if ((*it)->source == load_deferred)
+        defer_geometry((*it)->result->main_model(), (*it)->path, (*it)->dependencies);
+      m_data[(*it)->key] = new item_refcount((*it)->result);
+    }
+  }
+  
+  for (it = state.done.begin(); it != state.done.end(); ++it) {
+    if ((*it)->result) {
+      link((*it)->result);
+      if ((*it)->source == load_parsed)
+        store_file((*it)->path, (*it)->stamp, (*it)->result);
+    }
+  }
+}
+
+// Path of a part or primitive, looked up in the same order as link_element()
+// does; empty if there is no such file.
+std::string part_library::library_path(const atom &fn) const
+{
+  std::map<std::string, std::string>::const_iterator it;
+  
+  if ((it = m_primlist.find(fn.str())) != m_primlist.end())
+    return m_ldrawpath + DIRECTORY_SEPARATOR + m_primdir + DIRECTORY_SEPARATOR + (*it).second;
+  else if ((it = m_partlist.find(fn.str())) != m_partlist.end())
+    return m_ldrawpath + DIRECTORY_SEPARATOR + m_partsdir + DIRECTORY_SEPARATOR + (*it).second;
+  
+  return std::string();
+}
+
+// Called from the prefetch workers too, so nothing may be recorded here;
+// the stamps go back to the caller. With a cache, the stamp of a parsed file
+// is taken before it is opened.
+model_multipart* part_library::load_file(const std::string &path, load_source *source, file_stamp *stamp, stamp_map *dependencies) const
+{
+  reader nil;
+  model_multipart *n = 0L;
+  
+  if (m_cache) {
+    if (m_residency_policy == header_residency && (n = m_cache->load(path, false, stamp, dependencies))) {
+      *source = load_deferred;
+      return n;
+    }
+    
+    n = m_cache->load(path, true, stamp, dependencies);
+  }
+  
+  *source = n ? load_cached : load_parsed;
+  if (!n) {
+    if (m_cache && !file_stamp::take(path, stamp))
+      stamp->mtime = -1;
+    n = nil.load_from_file(path);
+  }
+  
+  return n;
+}
+
+// Writes a freshly parsed and linked file back to the cache.
+void part_library::store_file(const std::string &path, const file_stamp &stamp, model_multipart *m) const
+{
+  if (!m_cache || stamp.mtime < 0)
+    return;
+  
+  std::set<const model *> visited;
+  stamp_map dependencies;
+  
+  // a file below whose stamp is unknown cannot be vouched for
+  if (!collect_dependencies(m->main_model(), visited, dependencies))
+    return;
+  dependencies.erase(path);
+  
+  m->main_model()->update_custom_data<metrics>();
+  if (!m_cache->store(path, stamp, m, dependencies))
+    std::cerr << "[libLDR] could not write part cache image for " << path << std::endl;
+}
+
+// Stamps of the parts and primitives below m, at any depth, as they were
+// loaded. A deferred part is not read for this; the list its image came
+// with stands in for it. False if any stamp is missing.
+bool part_library::collect_dependencies(const model *m, std::set<const model *> &visited, stamp_map &dependencies) const
+{
+  if (!visited.insert(m).second)
+    return true;
+  
+  if (!m->is_resident()) {
+    std::map<const model*, stamp_map>::const_iterator it = m_deferred_dependencies.find(m);
+    
+    if (it == m_deferred_dependencies.end())
+      return false;
+    
+    dependencies.insert((*it).second.begin(), (*it).second.end());
+    return true;
+  }
+  
+  for (model::const_iterator it = m->elements().begin(); it != m->elements().end(); ++it) {
+    if ((*it)->get_type() != type_ref)
+      continue;
+    
+    const element_ref *r = CAST_AS_CONST_REF(*it);
+    const model *rm = r->get_model();
+    
+    if (!rm)
+      continue;
+    
+    if (rm->modeltype() == model::part || rm->modeltype() == model::primitive) {
+      std::string path = library_path(r->filename_atom().folded());
+      
+      if (!path.empty()) {
+        stamp_map::const_iterator st = m_stamps.find(path);
+        
+        if (st == m_stamps.end() || (*st).second.mtime < 0)
+          return false;
+        dependencies.insert(*st);
+      }
+    }
+    
+    if (!collect_dependencies(rm, visited, dependencies))
+      return false;
+  }
+  
+  return true;
+}
+
+void part_library::defer_geometry(model *m, const std::string &path, const stamp_map &dependencies)
+{
+  m->m_loader = this;
+  m_deferred[m] = path;
+  m_deferred_dependencies[m] = dependencies;
+}
+
+// Faults in the geometry of a part loaded under header_residency.
+void part_library::load_geometry(model *m)
+{
+  std::map<const model*, std::string>::iterator it = m_deferred.find(m);
+  
+  m->m_loader = 0L;
+  if (it == m_deferred.end())
+    return;
+  
+  std::string path = (*it).second;
+  m_deferred.erase(it);
+  m_deferred_dependencies.erase(m);
+  
+  model_multipart *n = 0L;
+  if (m_cache)
+    n = m_cache->load(path);
+  
+  if (!n) {
+    try {
+      n = reader().load_from_file(path);
+    } catch (const exception &) {
+      std::cerr << "[libLDR] could not load geometry of " << path << std::endl;
+      return;
+    }
+  }
+  
+  model *src = n->main_model();
+  m->m_arena.adopt(src->m_arena);
+  for (std::vector<element_base *>::iterator eit = src->m_elements.begin(); eit != src->m_elements.end(); ++eit)
+    m->insert_element(*eit);
+  src->m_elements.clear();
+  delete n;
+  
+  link_model(m);
+}
+
 void part_library::link_model(model *m)
 {
+  if (!m->is_resident())
+    return;
+  
   for (int i = 0; i < m->size(); ++i) {
     if (m->at(i)->get_type() == type_ref) {
       element_ref *r = CAST_AS_REF(m->at(i));
@@ -11,8 +11,11 @@
 #include <set>
 #include <string>
 #include <utility>
+#include <vector>
 
+#include "atom.h"
 #include "common.h"
+#include "part_cache.h"
 
 namespace ldraw
 {
@@ -20,6 +23,7 @@ namespace ldraw
 class element_ref;
 class model;
 class model_multipart;
+class part_index;
 
 class item_refcount : public std::pair<model_multipart *, int>
 {
@@ -42,9 +46,12 @@ class LIBLDR_EXPORT part_library
  public:
   enum path_type { ldraw_path, ldraw_parts_path, ldraw_primitives_path };
   enum unlink_policy { parts = 0x1, primitives = 0x2 };
+  enum residency_policy { full_residency, header_residency };
   
-  part_library();
-  part_library(const std::string &path);
+  // An empty path searches LDRAWDIR and the usual install locations. The
+  // directory listing is kept in the cache directory, if one is given, and
+  // revalidated on the next start instead of scanning everything again.
+  part_library(const std::string &path = std::string(), const std::string &cache_path = std::string());
   ~part_library();
   
   const std::map<std::string, std::string>& part_list() const { return m_partlist; }
@@ -53,6 +60,26 @@ class LIBLDR_EXPORT part_library
   int get_unlink_policy() const { return m_unlink_policy; }
   void set_unlink_policy(int u) { m_unlink_policy = u; }
   
+  // header_residency loads only the header and bounds of a part from the
+  // cache; its geometry is read when the elements are first accessed
+  residency_policy get_residency_policy() const { return m_residency_policy; }
+  void set_residency_policy(residency_policy r) { m_residency_policy = r; }
+  
+  // number of threads used to prefetch parts in link(); 1 links serially
+  int worker_threads() const { return m_worker_threads; }
+  void set_worker_threads(int n) { m_worker_threads = n; }
+  
+  // directory holding pre-parsed part images and the part index; empty
+  // disables both, and the library is then scanned afresh on every start
+  std::string cache_path() const;
+  void set_cache_path(const std::string &path);
+  
+  // picks up parts added to or removed from the library since the last
+  // scan; returns true if the part lists changed. Cheap while the directory
+  // watch has seen nothing, so it may be called whenever the user could
+  // have installed parts, e.g. when the application regains focus.
+  bool refresh();
+  
   std::string ldrawpath(path_type path_type = ldraw_path) const;
   std::string ldrawpath(const std::string &filename, path_type path_type = ldraw_parts_path) const;
   
@@ -65,16 +92,45 @@ class LIBLDR_EXPORT part_library
   void unlink_element(element_ref *r);
   
  private:
+  friend class model;
+  struct prefetch_state;
+  enum load_source { load_parsed, load_cached, load_deferred };
+  
   bool read_fs(const std::string &path);
+  bool read_index();
+  bool update_index();
+  void update_lists();
+  void merge_list(std::map<std::string, std::string> &list, const std::string &root, const std::string &prefix) const;
+  std::vector<std::string> index_roots() const;
+  std::string index_path() const;
   void link_model(model *m);
+  void prefetch(model_multipart *m);
+  std::string library_path(const atom &fn) const;
+  model_multipart* load_file(const std::string &path, load_source *source, file_stamp *stamp, stamp_map *dependencies) const;
+  void store_file(const std::string &path, const file_stamp &stamp, model_multipart *m) const;
+  bool collect_dependencies(const model *m, std::set<const model *> &visited, stamp_map &dependencies) const;
+  void defer_geometry(model *m, const std::string &path, const stamp_map &dependencies);
+  void load_geometry(model *m);
   
   std::map<std::string, std::string> m_partlist;
   std::map<std::string, std::string> m_primlist;
-  std::map<std::string, item_refcount*> m_data;
+  std::map<atom, item_refcount*> m_data;
+  std::map<const model*, std::string> m_deferred;
+  // library files a deferred part depends on, as its image says
+  std::map<const model*, stamp_map> m_deferred_dependencies;
+  // every library file loaded, as it was before being read
+  stamp_map m_stamps;
   std::string m_ldrawpath;
   std::string m_partsdir;
   std::string m_primdir;
+  std::string m_unofficialdir;
+  std::string m_unofficial_partsdir;
+  std::string m_unofficial_primdir;
   int m_unlink_policy;
+  residency_policy m_residency_policy;
+  int m_worker_threads;
+  part_cache *m_cache;
+  part_index *m_index;
 };
 
 }
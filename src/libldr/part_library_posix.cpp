@@ -18,27 +18,32 @@
 namespace ldraw
 {
 
-bool part_library::read_fs(const std::string &path)
+static std::string find_subdirectory(const std::string &path, const std::string &name)
 {
-  // TODO recursive subdirectory handling
   DIR *de;
   struct dirent *ep;
-  std::string dn1, dn2;
-  std::string pdir, partsdir;
+  std::string result;
   
-  // 1. find subdirectories
   if ((de = opendir(path.c_str())) == 0L)
-    return false;
+    return result;
   
   while ((ep = readdir(de))) {
-    dn1 = ep->d_name;
-    dn2 = utils::translate_string(dn1);
-    
-    if (dn2 == "p") pdir = dn1;
-    else if (dn2 == "parts") partsdir = dn1;
+    if (utils::translate_string(ep->d_name) == name) {
+      result = ep->d_name;
+      break;
+    }
   }
   closedir(de);
   
+  return result;
+}
+
+bool part_library::read_fs(const std::string &path)
+{
+  // 1. find subdirectories
+  std::string pdir = find_subdirectory(path, "p");
+  std::string partsdir = find_subdirectory(path, "parts");
+  
   if (pdir.empty() || partsdir.empty()) {
     std::cerr << "[libLDR] No p/ or parts/ found." << std::endl;
     return false;
@@ -48,72 +53,20 @@ bool part_library::read_fs(const std::string &path)
   m_primdir = pdir;
   m_partsdir = partsdir;
   
-  // 2. look into p/ directory
-  if ((de = opendir((m_ldrawpath + DIRECTORY_SEPARATOR + pdir).c_str())) == 0L) {
-    std::cerr << "[libLDR] Couldn't open p/." << std::endl;
-    return false;
-  }
-  while ((ep = readdir(de))) {
-    dn1 = ep->d_name;
-    dn2 = utils::translate_string(dn1);
-    
-    if (dn2.length() > 4 && dn2.substr(dn1.length()-4, 4) == ".dat")
-      m_primlist[dn2] = dn1;
-  }
-  closedir(de);
+  // 2. unofficial parts, if installed
+  m_unofficialdir = find_subdirectory(path, "unofficial");
+  m_unofficial_primdir.clear();
+  m_unofficial_partsdir.clear();
   
-  // 3. look into p/48 directory
-  if ((de = opendir((m_ldrawpath + DIRECTORY_SEPARATOR + pdir + DIRECTORY_SEPARATOR + "48").c_str())) == 0L)
-    std::cerr << "[libLDR] Couldn't open p/48/." << std::endl;
-  else {
-    while((ep = readdir(de))) {
-      dn1 = std::string("48") + DIRECTORY_SEPARATOR + ep->d_name;
-      dn2 = utils::translate_string(dn1);
-      
-      if (dn2.length() > 4 && dn2.substr(dn2.length()-4, 4) == ".dat")
-        m_primlist[dn2] = dn1;
-    }
-    closedir(de);
-  }
-  
-  // 4. look into parts/ directory
-  if ((de = opendir((m_ldrawpath + DIRECTORY_SEPARATOR + m_partsdir).c_str())) == 0L) {
-    std::cerr << "[libLDR] Couldn't open parts/." << std::endl;
-    return false;
-  }
-  while((ep = readdir(de))) {
-    dn1 = ep->d_name;
-    dn2 = utils::translate_string(dn1);
+  if (!m_unofficialdir.empty()) {
+    std::string udir = path + DIRECTORY_SEPARATOR + m_unofficialdir;
     
-    if (dn2.length() > 4 && dn2.substr(dn2.length() - 4, 4) == ".dat")
-      m_partlist[dn2] = dn1;
-  }
-  closedir(de);
-  
-  // 5. look into parts/s directory
-  std::string s;
-  de = opendir((m_ldrawpath + DIRECTORY_SEPARATOR + m_partsdir + DIRECTORY_SEPARATOR + "s").c_str());
-  s = "s";
-  
-  if(!de) {
-    de = opendir((m_ldrawpath + DIRECTORY_SEPARATOR + m_partsdir + DIRECTORY_SEPARATOR + "S").c_str());
-    s = "S";
-  }
-  
-  if(!de)
-    std::cerr << "[libLDR] Couldn't open parts/s/." << std::endl;
-  else {
-    while((ep = readdir(de))) {
-      dn1 = s + DIRECTORY_SEPARATOR + ep->d_name;
-      dn2 = utils::translate_string(dn1);
-      
-      if (dn2.length() > 4 && dn2.substr(dn2.length() - 4, 4) == ".dat")
-        m_partlist[dn2] = dn1;
-    }
-    closedir(de);
+    m_unofficial_primdir = find_subdirectory(udir, "p");
+    m_unofficial_partsdir = find_subdirectory(udir, "parts");
   }
   
-  return true;
+  // 3. scan (or revalidate) everything below
+  return read_index();
 }
 
 }
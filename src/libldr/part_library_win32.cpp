@@ -30,9 +30,6 @@ int dirsep(int c)
 
 bool part_library::read_fs(const std::string &path)
 {
-  // TODO recursive subdirectory handling
-  std::string dn1, dn2;
-  
   // 1. find subdirectories  
   m_ldrawpath = path;
   std::transform(path.begin(), path.end(), m_ldrawpath.begin(), dirsep);
@@ -47,68 +44,22 @@ bool part_library::read_fs(const std::string &path)
     return false;
   }
 
-  WIN32_FIND_DATA ffd;
-  HANDLE hFind = INVALID_HANDLE_VALUE;
+  // 2. unofficial parts, if installed
+  m_unofficialdir.clear();
+  m_unofficial_primdir.clear();
+  m_unofficial_partsdir.clear();
 
-  // 2. look into p/ directory
-  hFind = FindFirstFile((ldrawpath(path_type::ldraw_primitives_path) + "\\*.dat").c_str(), &ffd);
-  if (hFind == INVALID_HANDLE_VALUE) {
-    std::cerr << "[libLDR] Couldn't open p/." << std::endl;
-    return false;
+  std::string udir = m_ldrawpath + DIRECTORY_SEPARATOR + "unofficial";
+  if (FILE_EXISTS(GetFileAttributes(udir.c_str()))) {
+    m_unofficialdir = "unofficial";
+    if (FILE_EXISTS(GetFileAttributes((udir + DIRECTORY_SEPARATOR + "p").c_str())))
+      m_unofficial_primdir = "p";
+    if (FILE_EXISTS(GetFileAttributes((udir + DIRECTORY_SEPARATOR + "parts").c_str())))
+      m_unofficial_partsdir = "parts";
   }
-  do {
-    dn1 = ffd.cFileName;
-    dn2 = utils::translate_string(dn1);
 
-    std::cerr << dn2 << std::endl;
-    
-    m_primlist[dn2] = dn1;
-  } while (FindNextFile(hFind, &ffd) != 0);
-  FindClose(hFind);
-  
-  // 3. look into p/48 directory
-  hFind = FindFirstFile((ldrawpath(path_type::ldraw_primitives_path) + DIRECTORY_SEPARATOR + "48" + "\\*.dat").c_str(), &ffd);
-  if (hFind == INVALID_HANDLE_VALUE) {
-    std::cerr << "[libLDR] Couldn't open p/48/." << std::endl;
-    return false;
-  }
-  do {
-    dn1 = std::string("48/") + ffd.cFileName;
-    dn2 = utils::translate_string(dn1);
-    
-    m_primlist[dn2] = dn1;
-  } while (FindNextFile(hFind, &ffd) != 0);
-  FindClose(hFind);
-  
-  // 4. look into parts/ directory
-  hFind = FindFirstFile((ldrawpath(path_type::ldraw_parts_path) + "\\*.dat").c_str(), &ffd);
-  if (hFind == INVALID_HANDLE_VALUE) {
-    std::cerr << "[libLDR] Couldn't open parts/." << std::endl;
-    return false;
-  }
-  do {
-    dn1 = ffd.cFileName;
-    dn2 = utils::translate_string(dn1);
-    
-    m_partlist[dn2] = dn1;
-  } while (FindNextFile(hFind, &ffd) != 0);
-  FindClose(hFind);
-  
-  // 5. look into parts/s directory
-  hFind = FindFirstFile((ldrawpath(path_type::ldraw_parts_path) + DIRECTORY_SEPARATOR + "s" + "\\*.dat").c_str(), &ffd);
-  if (hFind == INVALID_HANDLE_VALUE) {
-    std::cerr << "[libLDR] Couldn't open parts/s/." << std::endl;
-    return false;
-  }
-  do {
-    dn1 = std::string("s/") + ffd.cFileName;
-    dn2 = utils::translate_string(dn1);
-    
-    m_partlist[dn2] = dn1;
-  } while (FindNextFile(hFind, &ffd) != 0);
-  FindClose(hFind);
-  
-  return true;
+  // 3. scan (or revalidate) everything below
+  return read_index();
 }
 
 }
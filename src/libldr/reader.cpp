@@ -6,16 +6,20 @@
 
 #include <sys/stat.h>
 
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <iostream>
-#include <sstream>
 
 #include <algorithm>
-#include <set>
+#include <vector>
 
 #include "bfc.h"
+#include "compressed_stream.h"
 #include "elements.h"
+#include "mapped_file.h"
 #include "model.h"
+#include "scan_handler.h"
 #include "utils.h"
 
 #include "reader.h"
@@ -23,11 +27,597 @@
 namespace ldraw
 {
 
+/* In-place line scanner shared by every input path. Follows the semantics of
+ * utils::trim_string(), utils::translate_string() and the istream extractors
+ * the reader used to rely on, without allocating per line. */
+namespace
+{
+
+inline bool is_space(char c)
+{
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' || c == '\f';
+}
+
+inline char lower(char c)
+{
+  if (c >= 'A' && c <= 'Z')
+    return c - 'A' + 'a';
+  else if (c == '\\')
+    return '/';
+  
+  return c;
+}
+
+// trim_string() equivalent
+inline void trim(const char **begin, const char **end)
+{
+  const char *b = *begin, *e = *end;
+  
+  while (b < e && (*b == ' ' || *b == '\t'))
+    ++b;
+  while (e > b && (e[-1] == '\r' || e[-1] == '\n' || e[-1] == ' ' || e[-1] == '\t'))
+    --e;
+  
+  *begin = b, *end = e;
+}
+
+// case-insensitive prefix test (translate_string() semantics)
+inline bool starts_with(const char *begin, const char *end, const char *prefix)
+{
+  for (; *prefix; ++prefix, ++begin) {
+    if (begin == end || lower(*begin) != *prefix)
+      return false;
+  }
+  
+  return true;
+}
+
+inline bool equals(const char *begin, const char *end, const char *str)
+{
+  std::size_t len = std::strlen(str);
+  
+  return (std::size_t)(end - begin) == len && starts_with(begin, end, str);
+}
+
+inline const char* skip_space(const char *p, const char *end)
+{
+  while (p < end && is_space(*p))
+    ++p;
+  
+  return p;
+}
+
+inline const char* token_end(const char *p, const char *end)
+{
+  while (p < end && !is_space(*p))
+    ++p;
+  
+  return p;
+}
+
+// Emulates std::stoi(token, 0L, 0) over a whitespace-delimited token.
+int scan_color_auto(const char **cursor, const char *end)
+{
+  const char *p = skip_space(*cursor, end);
+  const char *e = token_end(p, end);
+  bool negative = false;
+  unsigned long v = 0;
+  int base = 10;
+  
+  *cursor = e;
+  
+  if (p < e && (*p == '+' || *p == '-'))
+    negative = *(p++) == '-';
+  
+  if (p < e && *p == '0') {
+    if (p + 1 < e && (p[1] == 'x' || p[1] == 'X'))
+      base = 16, p += 2;
+    else
+      base = 8;
+  }
+  
+  for (; p < e; ++p) {
+    int d;
+    
+    if (*p >= '0' && *p <= '9')
+      d = *p - '0';
+    else if (*p >= 'a' && *p <= 'f')
+      d = *p - 'a' + 10;
+    else if (*p >= 'A' && *p <= 'F')
+      d = *p - 'A' + 10;
+    else
+      break;
+    
+    if (d >= base)
+      break;
+    
+    v = v * base + d;
+  }
+  
+  return negative ? -(int)v : (int)v;
+}
+
+// Emulates istream >> int (decimal).
+int scan_int(const char **cursor, const char *end)
+{
+  const char *p = skip_space(*cursor, end);
+  bool negative = false;
+  int v = 0;
+  
+  if (p < end && (*p == '+' || *p == '-'))
+    negative = *(p++) == '-';
+  
+  while (p < end && *p >= '0' && *p <= '9')
+    v = v * 10 + (*(p++) - '0');
+  
+  *cursor = p;
+  
+  return negative ? -v : v;
+}
+
+// Emulates istream >> float. Plain decimals with a mantissa of at most 2^24
+// and up to 10 fractional digits are exact in single precision, so a single
+// division rounds identically to strtof(); everything else falls back to it.
+float scan_float(const char **cursor, const char *end)
+{
+  static const float pow10[] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+  
+  const char *start = skip_space(*cursor, end);
+  const char *p = start;
+  bool negative = false;
+  unsigned long mantissa = 0;
+  int digits = 0, fraction = 0;
+  bool exact = true;
+  
+  if (p < end && (*p == '+' || *p == '-'))
+    negative = *(p++) == '-';
+  
+  for (; p < end && *p >= '0' && *p <= '9'; ++p, ++digits) {
+    mantissa = mantissa * 10 + (*p - '0');
+    if (mantissa > 16777216UL)
+      exact = false;
+  }
+  
+  if (p < end && *p == '.') {
+    for (++p; p < end && *p >= '0' && *p <= '9'; ++p, ++digits, ++fraction) {
+      mantissa = mantissa * 10 + (*p - '0');
+      if (mantissa > 16777216UL || fraction >= 10)
+        exact = false;
+    }
+  }
+  
+  if (p < end && (*p == 'e' || *p == 'E'))
+    exact = false;
+  
+  if (exact || !digits) {
+    *cursor = p;
+    
+    float v = (float)mantissa / pow10[fraction];
+    return negative ? -v : v;
+  }
+  
+  char buf[64];
+  const char *e = token_end(start, end);
+  std::size_t len = std::min<std::size_t>(e - start, sizeof(buf) - 1);
+  char *conv;
+  
+  std::memcpy(buf, start, len);
+  buf[len] = 0;
+  
+  float v = std::strtof(buf, &conv);
+  *cursor = start + (conv - buf);
+  
+  return v;
+}
+
+vector scan_vector(const char **cursor, const char *end)
+{
+  float x = scan_float(cursor, end);
+  float y = scan_float(cursor, end);
+  float z = scan_float(cursor, end);
+  
+  return vector(x, y, z);
+}
+
+// What a line means to the file it is part of; see classify_line().
+enum line_kind { line_blank, line_main_file, line_file, line_name, line_author, line_desc, line_element };
+
+/* Tells model metadata from elements, keeping track of the header state in
+ * ctx. [*begin, *end) is trimmed on the way; [*vb, *ve) receives the value of
+ * metadata lines. "0 FILE" anywhere but on the first line opens the next
+ * submodel. */
+template <class Context> line_kind classify_line(Context &ctx, const char **begin, const char **end, const char **vb, const char **ve)
+{
+  const char *lb = *begin, *le = *end;
+  
+  trim(&lb, &le);
+  *begin = lb, *end = le;
+  
+  long llen = le - lb;
+  ++ctx.lines;
+  if (llen == 0)
+    return line_blank;
+  
+  line_kind file = line_blank;
+  if (llen > 7 && std::memcmp(lb, "0 FILE", 6) == 0) {
+    file = ctx.lines == 1 ? line_main_file : line_file;
+    *vb = lb + 7, *ve = le;
+    
+    if (file == line_file) {
+      ctx.lines = 1;
+      ctx.zerocnt = 0;
+      ctx.founddesc = false;
+    }
+  }
+  
+  if (*lb != '0')
+    return line_element;
+  
+  // parse line type 0
+  ++ctx.zerocnt;
+  
+  const char *cb = lb + 1, *ce = le;
+  trim(&cb, &ce);
+  long clen = ce - cb;
+  
+  // Parse header data
+  if (clen > 4 && starts_with(cb, ce, "file")) // Skip
+    return file;
+  else if (clen > 6 && starts_with(cb, ce, "name:")) // Filename
+    *vb = cb + 6, *ve = ce;
+  else if (clen > 5 && starts_with(cb, ce, "name")) // Filename without ':'
+    *vb = cb + 5, *ve = ce;
+  else if (clen > 8 && starts_with(cb, ce, "author:")) // Author
+    *vb = cb + 8, *ve = ce;
+  else if (clen > 7 && starts_with(cb, ce, "author")) // Author without ':'
+    *vb = cb + 7, *ve = ce;
+  else if (ctx.zerocnt < 3 && !ctx.founddesc) { // Partname
+    ctx.founddesc = true;
+    *vb = cb, *ve = ce;
+    return line_desc;
+  } else
+    return line_element;
+  
+  return starts_with(cb, ce, "name") ? line_name : line_author;
+}
+
+/* Splits an element line into its fields and passes them on to the sink,
+ * which either builds elements (element_factory) or reports them to a
+ * scan_handler (handler_sink). */
+template <class Sink> typename Sink::result_type dispatch_element(const char *begin, const char *end, Sink &sink)
+{
+  if (begin == end)
+    return sink.none();
+  
+  char type = *begin;
+  
+  if (type == '0') {
+    // parse line type 0
+    const char *cb = begin + 1, *ce = end;
+    trim(&cb, &ce);
+    long clen = ce - cb;
+    
+    if (clen == 0)
+      return sink.none();
+    
+    if (*cb == '!') {
+      // header data
+      const char *sp = static_cast<const char *>(std::memchr(cb, ' ', clen));
+      if (sp)
+        return sink.header(cb + 1, sp, sp + 1, ce);
+    } else if (equals(cb, ce, "step")) {
+      return sink.state(element_state::state_step);
+    } else if (equals(cb, ce, "pause")) {
+      return sink.state(element_state::state_pause);
+    } else if (equals(cb, ce, "clear")) {
+      return sink.state(element_state::state_clear);
+    } else if (equals(cb, ce, "save")) {
+      return sink.state(element_state::state_save);
+    } else if (clen > 6 && (starts_with(cb, ce, "print") || starts_with(cb, ce, "write"))) {
+      return sink.print(cb + 6, ce);
+    } else if (clen > 3 && starts_with(cb, ce, "bfc")) {
+      // Handle BFC statements
+      const char *sb = std::min(cb + 4, ce);
+      
+      if (equals(sb, ce, "ccw"))
+        return sink.bfc(element_bfc::ccw);
+      else if (equals(sb, ce, "cw"))
+        return sink.bfc(element_bfc::cw);
+      else if (equals(sb, ce, "clip"))
+        return sink.bfc(element_bfc::clip);
+      else if (equals(sb, ce, "clip cw") || equals(sb, ce, "cw clip"))
+        return sink.bfc(element_bfc::clip_cw);
+      else if (equals(sb, ce, "clip ccw") || equals(sb, ce, "ccw clip"))
+        return sink.bfc(element_bfc::clip_ccw);
+      else if (equals(sb, ce, "noclip"))
+        return sink.bfc(element_bfc::noclip);
+      else if (equals(sb, ce, "invertnext"))
+        return sink.bfc(element_bfc::invertnext);
+      else if (equals(sb, ce, "certify") || equals(sb, ce, "certify ccw"))
+        return sink.certification(bfc_certification::certified, bfc_certification::ccw);
+      else if (equals(sb, ce, "certify cw"))
+        return sink.certification(bfc_certification::certified, bfc_certification::cw);
+      else if (equals(sb, ce, "nocertify"))
+        return sink.certification(bfc_certification::uncertified, -1);
+    } else {
+      return sink.comment(cb, ce);
+    }
+    
+    return sink.none();
+  }
+  
+  if (type < '1' || type > '5')
+    return sink.none();
+  
+  // the stream path skips the separator following the line type
+  const char *p = std::min(begin + 2, end);
+  
+  if (type == '1') {
+    // File reference
+    int col = scan_color_auto(&p, end);
+    vector pos = scan_vector(&p, end);
+    float a = scan_float(&p, end), b = scan_float(&p, end), c = scan_float(&p, end);
+    float d = scan_float(&p, end), e = scan_float(&p, end), f = scan_float(&p, end);
+    float g = scan_float(&p, end), h = scan_float(&p, end), i = scan_float(&p, end);
+    
+    // istream::getline() into a 255-byte buffer
+    const char *fb = p, *fe = std::min(end, p + 254);
+    trim(&fb, &fe);
+    
+    return sink.ref(color(col), matrix(a, b, c, d, e, f, g, h, i, pos.x(), pos.y(), pos.z()), fb, fe);
+  }
+  
+  int col = scan_int(&p, end);
+  
+  if (type == '2') {
+    // Line
+    vector p1 = scan_vector(&p, end);
+    vector p2 = scan_vector(&p, end);
+    
+    return sink.line(color(col), p1, p2);
+  } else if (type == '3') {
+    // Triangle
+    vector p1 = scan_vector(&p, end);
+    vector p2 = scan_vector(&p, end);
+    vector p3 = scan_vector(&p, end);
+    
+    return sink.triangle(color(col), p1, p2, p3);
+  }
+  
+  vector p1 = scan_vector(&p, end);
+  vector p2 = scan_vector(&p, end);
+  vector p3 = scan_vector(&p, end);
+  vector p4 = scan_vector(&p, end);
+  
+  if (type == '4')
+    return sink.quadrilateral(color(col), p1, p2, p3, p4);
+  else
+    return sink.condline(color(col), p1, p2, p3, p4);
+}
+
+struct element_factory
+{
+  typedef element_base* result_type;
+  
+  model *m;
+  arena *pool;
+  
+  element_base* none() { return 0L; }
+  
+  element_base* header(const char *kb, const char *ke, const char *vb, const char *ve)
+  {
+    if (m)
+      m->set_header(std::string(kb, ke), std::string(vb, ve));
+    
+    return 0L;
+  }
+  
+  element_base* certification(bfc_certification::cert_status cert, int winding)
+  {
+    if (m) {
+      bfc_certification *c = m->init_custom_data<bfc_certification>();
+      c->set_certification(cert);
+      if (winding != -1)
+        c->set_orientation((bfc_certification::winding)winding);
+    }
+    
+    return 0L;
+  }
+  
+  element_base* state(element_state::state s) { return arena_new<element_state>(pool, s); }
+  element_base* print(const char *b, const char *e) { return arena_new<element_print>(pool, std::string(b, e)); }
+  element_base* bfc(element_bfc::command c) { return arena_new<element_bfc>(pool, c); }
+  element_base* comment(const char *b, const char *e) { return arena_new<element_comment>(pool, std::string(b, e)); }
+  
+  element_base* ref(const color &c, const matrix &mat, const char *fb, const char *fe)
+  {
+    return arena_new<element_ref>(pool, c, mat, std::string(fb, fe));
+  }
+  
+  element_base* line(const color &c, const vector &p1, const vector &p2)
+  {
+    return arena_new<element_line>(pool, c, p1, p2);
+  }
+  
+  element_base* triangle(const color &c, const vector &p1, const vector &p2, const vector &p3)
+  {
+    return arena_new<element_triangle>(pool, c, p1, p2, p3);
+  }
+  
+  element_base* quadrilateral(const color &c, const vector &p1, const vector &p2, const vector &p3, const vector &p4)
+  {
+    return arena_new<element_quadrilateral>(pool, c, p1, p2, p3, p4);
+  }
+  
+  element_base* condline(const color &c, const vector &p1, const vector &p2, const vector &p3, const vector &p4)
+  {
+    return arena_new<element_condline>(pool, c, p1, p2, p3, p4);
+  }
+};
+
+struct handler_sink
+{
+  typedef void result_type;
+  
+  scan_handler *h;
+  
+  static text_ref ref_of(const char *b, const char *e) { text_ref t = { b, e }; return t; }
+  
+  void none() {}
+  void header(const char *kb, const char *ke, const char *vb, const char *ve) { h->header(ref_of(kb, ke), ref_of(vb, ve)); }
+  
+  void certification(bfc_certification::cert_status cert, int winding)
+  {
+    h->certification(cert, winding == -1 ? bfc_certification::ccw : (bfc_certification::winding)winding);
+  }
+  
+  void state(element_state::state s) { h->state(s); }
+  void print(const char *b, const char *e) { h->print(ref_of(b, e)); }
+  void bfc(element_bfc::command c) { h->bfc(c); }
+  void comment(const char *b, const char *e) { h->comment(ref_of(b, e)); }
+  void ref(const color &c, const matrix &m, const char *fb, const char *fe) { h->ref(c, m, ref_of(fb, fe)); }
+  void line(const color &c, const vector &p1, const vector &p2) { h->line(c, p1, p2); }
+  void triangle(const color &c, const vector &p1, const vector &p2, const vector &p3) { h->triangle(c, p1, p2, p3); }
+  
+  void quadrilateral(const color &c, const vector &p1, const vector &p2, const vector &p3, const vector &p4)
+  {
+    h->quadrilateral(c, p1, p2, p3, p4);
+  }
+  
+  void condline(const color &c, const vector &p1, const vector &p2, const vector &p3, const vector &p4)
+  {
+    h->condline(c, p1, p2, p3, p4);
+  }
+};
+
+// Reports whole lines to a scan_handler; the scanning counterpart of parse_model_line().
+struct line_scanner
+{
+  handler_sink sink;
+  int lines;
+  int zerocnt;
+  bool founddesc;
+  
+  void operator()(const char *lb, const char *le)
+  {
+    const char *vb = 0L, *ve = 0L;
+    scan_handler *h = sink.h;
+    
+    switch (classify_line(*this, &lb, &le, &vb, &ve)) {
+      case line_main_file:
+      case line_file:
+        h->file(handler_sink::ref_of(vb, ve));
+        break;
+      case line_name:
+        h->name(handler_sink::ref_of(vb, ve));
+        break;
+      case line_author:
+        h->author(handler_sink::ref_of(vb, ve));
+        break;
+      case line_desc:
+        h->description(handler_sink::ref_of(vb, ve));
+        break;
+      case line_element:
+        dispatch_element(lb, le, sink);
+        break;
+      default:
+        break;
+    }
+  }
+};
+
+/* Input splitting shared by loading and scanning. Each calls f(begin, end)
+ * for every line; gzip-compressed input is inflated on the fly, a chunk at a
+ * time, with the incomplete last line carried over to the next round. */
+template <class F> void split_lines(gzip_reader &source, F &f)
+{
+  std::vector<char> buffer(262144);
+  std::size_t fill = 0;
+  
+  for (;;) {
+    // a line longer than the buffer
+    if (fill == buffer.size())
+      buffer.resize(buffer.size() * 2);
+    
+    std::size_t n = source.read(&buffer[fill], buffer.size() - fill);
+    const char *p = &buffer[0];
+    const char *end = p + fill + n;
+    
+    if (n == 0) {
+      if (fill)
+        f(p, end);
+      break;
+    }
+    
+    // lines cannot end inside the carried-over part
+    const char *le = static_cast<const char *>(std::memchr(p + fill, '\n', n));
+    while (le) {
+      f(p, le);
+      p = le + 1;
+      le = static_cast<const char *>(std::memchr(p, '\n', end - p));
+    }
+    
+    fill = end - p;
+    std::memmove(&buffer[0], p, fill);
+  }
+}
+
+template <class F> void split_lines(const char *data, std::size_t length, const std::string &name, F &f)
+{
+  switch (detect_compression(data, length)) {
+    case compression_gzip: {
+      gzip_reader gz(data, length);
+      
+      split_lines(gz, f);
+      return;
+    }
+    case compression_zstd:
+      throw exception(__func__, exception::user_error, std::string("zstd-compressed files are not supported: ") + name);
+    default:
+      break;
+  }
+  
+  const char *p = data;
+  const char *end = data + length;
+  
+  while (p < end) {
+    const char *lb = p;
+    const char *le = static_cast<const char *>(std::memchr(p, '\n', end - p));
+    
+    if (le)
+      p = le + 1;
+    else
+      le = p = end;
+    
+    f(lb, le);
+  }
+}
+
+template <class F> void split_lines(std::istream &stream, F &f)
+{
+  // no LDraw line starts with the first byte of the gzip magic
+  if (stream.peek() == 0x1f) {
+    gzip_reader gz(stream);
+    
+    split_lines(gz, f);
+    return;
+  }
+  
+  // Single forward pass; the stream is never rewound, so pipes work too
+  std::string line;
+  while (std::getline(stream, line))
+    f(line.data(), line.data() + line.length());
+}
+
+}
+
 reader::reader()
+    : m_io_method(io_mmap)
 {
 }
 
 reader::reader(const std::string &basepath)
+    : m_io_method(io_mmap)
 {
   m_basepath = basepath;
   
@@ -35,17 +625,35 @@ reader::reader(const std::string &basepath)
     m_basepath += "/";
 }
 
-model_multipart* reader::load_from_file(const std::string &name) const
+// Feeds lines to parse_model_line().
+struct reader::line_parser
 {
-  std::ifstream file;
+  parse_context *ctx;
+  
+  void operator()(const char *lb, const char *le) { parse_model_line(*ctx, lb, le); }
+};
 
+model_multipart* reader::load_from_file(const std::string &name) const
+{
   std::string filename = m_basepath + name;
 
+  if (m_io_method == io_mmap) {
+    mapped_file file;
+    
+    if (!file.open(filename))
+      throw exception(__func__, exception::user_error, std::string("Could not open file for reading: ") + name);
+    
+    return load_from_memory(file.data(), file.size(), name);
+  }
+  
+  std::ifstream file;
+
   struct stat buffer;
   if (stat(filename.c_str(), &buffer) != 0)
     throw exception(__func__, exception::user_error, std::string("Could not open file for reading: ") + name);
 
-  file.open(filename.c_str(), std::ios::in);
+  // binary, as it may be compressed; the parser copes with CR LF by itself
+  file.open(filename.c_str(), std::ios::in | std::ios::binary);
   model_multipart *model = load_from_stream(file, name);
   file.close();
 
@@ -55,54 +663,91 @@ model_multipart* reader::load_from_file(const std::string &name) const
 model_multipart* reader::load_from_stream(std::istream &stream, std::string name)
 {
   model_multipart *nm = new model_multipart;
+  parse_context ctx;
+  line_parser lp = { &ctx };
   
-  // Search for submodel names
-  std::set<std::string> m_submodel_names;
-  std::string line;
-  while (!stream.eof()) {
-    getline(stream, line);
-    line = utils::trim_string(line);
-    if (line.length() > 7 && line.substr(0, 6) == "0 FILE") {
-      std::string filename = utils::translate_string(line.substr(7, line.length() - 7));
-      m_submodel_names.insert(filename);
-    }
+  parse_begin(ctx, nm, name);
+  try {
+    split_lines(stream, lp);
+  } catch (...) {
+    parse_abort(ctx);
+    throw;
   }
-
-  std::string keyname;
   
-  // Rewind the stream to the beginning
-  stream.clear();
-  stream.seekg(0, std::ios::beg);
+  return parse_end(ctx);
+}
+
+model_multipart* reader::load_from_memory(const char *data, std::size_t length, std::string name)
+{
+  model_multipart *nm = new model_multipart;
+  parse_context ctx;
+  line_parser lp = { &ctx };
   
-  bool tmp = parse_stream(nm->main_model(), stream, true, &keyname);
-  if (nm->main_model()->name().empty()) {
-    std::string nfp;
-    size_t o = name.find_last_of("/");
-    if (o == std::string::npos)
-      nfp = name;
-    else
-      nfp = name.substr(o + 1, name.length() - o);
-    
-    nm->main_model()->set_name(nfp);
+  parse_begin(ctx, nm, name);
+  try {
+    split_lines(data, length, name, lp);
+  } catch (...) {
+    parse_abort(ctx);
+    throw;
   }
-  if (!tmp)
-    return nm;
   
-  bool loop = true;
-  while (loop) {
-    std::string fn;
-    model *m = new model;
+  return parse_end(ctx);
+}
+
+void reader::scan_file(const std::string &name, scan_handler &handler) const
+{
+  std::string filename = m_basepath + name;
+  
+  if (m_io_method == io_mmap) {
+    mapped_file file;
     
-    m->set_parent(nm);
-    m->set_modeltype(model::submodel);
-    loop = parse_stream(m, stream, true, &fn);
-    m->set_name(keyname);
+    if (!file.open(filename))
+      throw exception(__func__, exception::user_error, std::string("Could not open file for reading: ") + name);
     
-    nm->insert_submodel(m, keyname);
-
-    keyname = fn;
+    scan(file.data(), file.size(), handler);
+    return;
   }
   
+  std::ifstream file(filename.c_str(), std::ios::in | std::ios::binary);
+  if (!file.is_open())
+    throw exception(__func__, exception::user_error, std::string("Could not open file for reading: ") + name);
+  
+  scan(file, handler);
+}
+
+void reader::scan(std::istream &stream, scan_handler &handler)
+{
+  line_scanner ls = { { &handler }, 0, 0, false };
+  
+  split_lines(stream, ls);
+  handler.end();
+}
+
+void reader::scan(const char *data, std::size_t length, scan_handler &handler)
+{
+  line_scanner ls = { { &handler }, 0, 0, false };
+  
+  split_lines(data, length, std::string(), ls);
+  handler.end();
+}
+
+void reader::set_default_name(model_multipart *nm, const std::string &name)
+{
+  if (!nm->main_model()->name().empty())
+    return;
+  
+  std::string nfp;
+  size_t o = name.find_last_of("/");
+  if (o == std::string::npos)
+    nfp = name;
+  else
+    nfp = name.substr(o + 1, name.length() - o);
+  
+  nm->main_model()->set_name(nfp);
+}
+
+void reader::finalize(model_multipart *nm)
+{
   nm->link_submodels();
   
   if (utils::cyclic_reference_test(nm->main_model()))
@@ -111,192 +756,106 @@ model_multipart* reader::load_from_stream(std::istream &stream, std::string name
     if (utils::cyclic_reference_test((*it).second))
       throw exception(__func__, exception::fatal, "Cyclic reference detected. This model file may be corrupted.");
   }
+}
+
+void reader::parse_begin(parse_context &ctx, model_multipart *nm, const std::string &name)
+{
+  ctx.multipart = nm;
+  ctx.current = nm->main_model();
+  ctx.name = name;
+  ctx.lines = 0;
+  ctx.zerocnt = 0;
+  ctx.founddesc = false;
+}
+
+// Closes the model being parsed. Submodels are keyed by their "0 FILE" name;
+// references between them are resolved afterwards by link_submodels().
+void reader::parse_close_model(parse_context &ctx)
+{
+  model *m = ctx.current;
   
-  return nm;
+  if (m == ctx.multipart->main_model()) {
+    set_default_name(ctx.multipart, ctx.name);
+    return;
+  }
+  
+  m->set_name(ctx.keyname);
+  if (!ctx.multipart->insert_submodel(m, ctx.keyname))
+    delete m;
 }
 
-bool reader::parse_stream(model *m, std::istream &stream, bool multipart, std::string *keyname)
+void reader::parse_model_line(parse_context &ctx, const char *lb, const char *le)
 {
-  std::string line;
-  int lines = 0;
-  int zerocnt = 0;
-  bool founddesc = false;
-  bool foundheader;
-  
-  while(!stream.eof()) {
-    getline(stream, line);
-    line = utils::trim_string(line);
-    long llen = line.length();
-    ++lines;
-    if (llen == 0)
-      continue;
-    // Returns true when more subpart(s) available. returns false otherwise.
-    if (multipart && llen > 7 && line.substr(0, 6) == "0 FILE") {
-      if (keyname)
-        *keyname = line.substr(7, llen - 7);
-      if (lines != 1) {
-        stream.seekg((long)stream.tellg() - llen - 1);
-        return true;
-      }
-    }
-    
-    foundheader = false;
-    
-    if (line[0] == '0') {
-      // parse line type 0
-      foundheader = true;
-      ++zerocnt;
+  const char *vb = 0L, *ve = 0L;
+  model *m = ctx.current;
+  
+  switch (classify_line(ctx, &lb, &le, &vb, &ve)) {
+    case line_file:
+      parse_close_model(ctx);
       
-      std::string cont = utils::trim_string(line.substr(1, line.length()-1));
-      std::string contlc = utils::translate_string(cont);
+      m = new model;
+      m->set_parent(ctx.multipart);
+      m->set_modeltype(model::submodel);
       
-      // Parse header data
-      if (contlc.length() > 4 && contlc.substr(0, 4) == "file"); // Skip
-      else if (contlc.length() > 6 && contlc.substr(0, 5) == "name:") { // Filename
-        m->set_name(cont.substr(6, cont.length() - 6));
-      } else if (contlc.length() > 5 && contlc.substr(0, 4) == "name") { // Filename without ':'
-        m->set_name(cont.substr(5, cont.length() - 5));
-      } else if (contlc.length() > 8 && contlc.substr(0, 7) == "author:") { // Author
-        m->set_author(cont.substr(8, cont.length() - 8));
-      } else if (contlc.length() > 7 && contlc.substr(0, 6) == "author") { // Author without ':'
-        m->set_author(cont.substr(7, cont.length() - 7));
-      } else if (zerocnt < 3 && !founddesc) { // Partname
-        m->set_desc(cont);
-        founddesc = true;
-      } else {
-        foundheader = false;
-      }
-    }
-    
-    if (!foundheader) {
-      element_base *el = parse_line(line, m);
+      ctx.current = m;
+      ctx.keyname.assign(vb, ve);
+      break;
+    case line_name:
+      m->set_name(std::string(vb, ve));
+      break;
+    case line_author:
+      m->set_author(std::string(vb, ve));
+      break;
+    case line_desc:
+      m->set_desc(std::string(vb, ve));
+      break;
+    case line_element: {
+      element_base *el = parse_buffer_line(lb, le, m, &m->m_arena);
       if (el)
         m->insert_element(el);
+      break;
     }
+    default:
+      break;
   }
+}
+
+model_multipart* reader::parse_end(parse_context &ctx)
+{
+  model_multipart *nm = ctx.multipart;
+  bool multipart = ctx.current != nm->main_model();
   
-  return false;
+  parse_close_model(ctx);
+  if (multipart)
+    finalize(nm);
+  
+  return nm;
+}
+
+// Throws away whatever was parsed so far.
+void reader::parse_abort(parse_context &ctx)
+{
+  if (ctx.current != ctx.multipart->main_model())
+    delete ctx.current;
+  delete ctx.multipart;
 }
 
 element_base* reader::parse_line(const std::string &command, model *m)
 {
-  std::string line = utils::trim_string(command);
+  const char *begin = command.data(), *end = command.data() + command.length();
   
-  if (line.length() == 0)
-    return 0;
-  if (line[0] == '0') {
-    // parse line type 0
-    
-    std::string cont = utils::trim_string(line.substr(1, line.length()-1));
-    std::string contlc = utils::translate_string(cont);
-    if (cont.length() == 0)
-      return 0;
-    
-    if (cont[0] == '!') {
-      // header data
-      size_t pos = cont.find_first_of(" ");
-      if (m && pos != std::string::npos)
-        m->set_header(cont.substr(1, pos - 1), cont.substr(pos + 1));
-    } else if (contlc == "step") {
-      return new element_state(element_state::state_step);
-    } else if (contlc == "pause") {
-      return new element_state(element_state::state_pause);
-    } else if (contlc == "clear") {
-      return new element_state(element_state::state_clear);
-    } else if (contlc == "save") {
-      return new element_state(element_state::state_save);
-    } else if (contlc.length() > 6 && (contlc.substr(0, 5) == "print" || contlc.substr(0, 5) == "write")) {
-      return new element_print(cont.substr(6, line.length()-6));
-    } else if (contlc.length() > 3 && contlc.substr(0, 3) == "bfc") {
-      // Handle BFC statements
-      std::string subs = contlc.substr(4, line.length() - 4);
-      int cert = -1, winding = -1;
-      
-      if (subs == "ccw")
-        return new element_bfc(element_bfc::ccw);
-      else if (subs == "cw")
-        return new element_bfc(element_bfc::cw);
-      else if (subs == "clip")
-        return new element_bfc(element_bfc::clip);
-      else if (subs == "clip cw" || subs == "cw clip")
-        return new element_bfc(element_bfc::clip_cw);
-      else if (subs == "clip ccw" || subs == "ccw clip")
-        return new element_bfc(element_bfc::clip_ccw);
-      else if (subs == "noclip")
-        return new element_bfc(element_bfc::noclip);
-      else if (subs == "invertnext")
-        return new element_bfc(element_bfc::invertnext);
-      else if (subs == "certify" || subs == "certify ccw")
-        cert = bfc_certification::certified, winding = bfc_certification::ccw;
-      else if (subs == "certify cw")
-        cert = bfc_certification::certified, winding = bfc_certification::cw;
-      
-      else if (subs == "nocertify")
-        cert = bfc_certification::uncertified;
-      
-      if (m && cert != -1) {
-        bfc_certification *c = m->init_custom_data<bfc_certification>();
-        c->set_certification((bfc_certification::cert_status)cert);
-        if (winding != -1)
-          c->set_orientation((bfc_certification::winding)winding);
-      }
-      
-      return 0L;
-    } else if (contlc.length() > 0) {
-      return new element_comment(cont);
-    }
-  } else if (line[0] == '1') {
-    // File reference
-    std::istringstream s(line.substr(2, line.length()-2));
-    std::string col;
-    float x, y, z, a, b, c, d, e, f, g, h, i;
-    char fnbuf[255];
-    
-    s >> col >> x >> y >> z >> a >> b >> c >> d >> e >> f >> g >> h >> i;
-    s.getline(fnbuf, 255);
-    
-    std::string fn = utils::trim_string(std::string(fnbuf));
+  trim(&begin, &end);
+  
+  return parse_buffer_line(begin, end, m);
+}
 
-    return new element_ref(color(std::stoi(col, nullptr, 0)), matrix(a, b, c, d, e, f, g, h, i, x, y, z), fn);
-  } else if (line[0] == '2') {
-    // Line
-    std::istringstream s(line.substr(2, line.length()-2));
-    int col;
-    float x1, y1, z1, x2, y2, z2;
-    
-    s >> col >> x1 >> y1 >> z1 >> x2 >> y2 >> z2;
-    
-    return new element_line(color(col), vector(x1, y1, z1), vector(x2, y2, z2));
-  } else if (line[0] == '3') {
-    // Triangle
-    std::istringstream s(line.substr(2, line.length()-2));
-    int col;
-    float x1, y1, z1, x2, y2, z2, x3, y3, z3;
-    
-    s >> col >> x1 >> y1 >> z1 >> x2 >> y2 >> z2 >> x3 >> y3 >> z3;
-    
-    return new element_triangle(color(col), vector(x1, y1, z1), vector(x2, y2, z2), vector(x3, y3, z3));
-  } else if (line[0] == '4') {
-    // Quadrilateral
-    std::istringstream s(line.substr(2, line.length()-2));
-    int col;
-    float x1, y1, z1, x2, y2, z2, x3, y3, z3, x4, y4, z4;
-    
-    s >> col >> x1 >> y1 >> z1 >> x2 >> y2 >> z2 >> x3 >> y3 >> z3 >> x4 >> y4 >> z4;
-    
-    return new element_quadrilateral(color(col), vector(x1, y1, z1), vector(x2, y2, z2), vector(x3, y3, z3), vector(x4, y4, z4));
-  } else if (line[0] == '5') {
-    // Conditional line
-    std::istringstream s(line.substr(2, line.length()-2));
-    int col;
-    float x1, y1, z1, x2, y2, z2, x3, y3, z3, x4, y4, z4;
-    
-    s >> col >> x1 >> y1 >> z1 >> x2 >> y2 >> z2 >> x3 >> y3 >> z3 >> x4 >> y4 >> z4;
-    
-    return new element_condline(color(col), vector(x1, y1, z1), vector(x2, y2, z2), vector(x3, y3, z3), vector(x4, y4, z4));
-  }
+// Parses a single trimmed line. The element is constructed in pool if one is
+// given; parse_line() hands out plain heap objects the caller may delete.
+element_base* reader::parse_buffer_line(const char *begin, const char *end, model *m, arena *pool)
+{
+  element_factory f = { m, pool };
   
-  return 0L;
+  return dispatch_element(begin, end, f);
 }
 
 }
@@ -7,6 +7,8 @@
 #ifndef _LIBLDR_READER_H_
 #define _LIBLDR_READER_H_
 
+#include <cstddef>
+#include <iosfwd>
 #include <string>
 
 #include "common.h"
@@ -14,27 +16,65 @@
 namespace ldraw
 {
 
+class arena;
 class element_base;
 class model;
 class model_multipart;
+class scan_handler;
 
 class LIBLDR_EXPORT reader
 {
   public:
+	// io_mmap maps the file and tokenizes it in place; io_stream goes through std::ifstream.
+	// Either way gzip-compressed files are recognized and decompressed on the fly.
+	enum io_method { io_stream, io_mmap };
+	
 	reader();
 	reader(const std::string &basepath);
 	
 	model_multipart* load_from_file(const std::string &name) const;
 	static model_multipart* load_from_stream(std::istream &stream, std::string name = "");
+	static model_multipart* load_from_memory(const char *data, std::size_t length, std::string name = "");
 	static element_base* parse_line(const std::string &command, model *m = 0L);
 	
+	// Walks through a file without building a model, reporting each line to
+	// handler. Memory use does not depend on the size of the file.
+	void scan_file(const std::string &name, scan_handler &handler) const;
+	static void scan(std::istream &stream, scan_handler &handler);
+	static void scan(const char *data, std::size_t length, scan_handler &handler);
+	
 	const std::string& basepath() const { return m_basepath; }
 	void set_basepath(const std::string &path) { m_basepath = path; }
 	
+	io_method get_io_method() const { return m_io_method; }
+	void set_io_method(io_method method) { m_io_method = method; }
+	
   private:
-	static bool parse_stream(model *m, std::istream &stream, bool multipart, std::string *keyname = 0L);
+	// state carried between lines while a file is parsed in a single pass
+	struct parse_context
+	{
+		model_multipart *multipart;
+		model *current;
+		std::string name;
+		std::string keyname;
+		int lines;
+		int zerocnt;
+		bool founddesc;
+	};
+	
+	struct line_parser;
+	
+	static void parse_begin(parse_context &ctx, model_multipart *nm, const std::string &name);
+	static void parse_model_line(parse_context &ctx, const char *begin, const char *end);
+	static void parse_close_model(parse_context &ctx);
+	static model_multipart* parse_end(parse_context &ctx);
+	static void parse_abort(parse_context &ctx);
+	static element_base* parse_buffer_line(const char *begin, const char *end, model *m, arena *pool = 0L);
+	static void set_default_name(model_multipart *nm, const std::string &name);
+	static void finalize(model_multipart *nm);
 	
 	std::string m_basepath;
+	io_method m_io_method;
 };
 
 }
@@ -0,0 +1,72 @@
+/* libLDR: Portable and easy-to-use LDraw format abstraction & I/O reference library *
+ * To obtain more information about LDraw, visit http://www.ldraw.org.               *
+ * Distributed in terms of the GNU Lesser General Public License v3                  *
+ *                                                                                   *
+ * Author: (c)2006-2013 Park "segfault" J. K. <mastermind_at_planetmono_dot_org>     */
+
+#ifndef _LIBLDR_SCAN_HANDLER_H_
+#define _LIBLDR_SCAN_HANDLER_H_
+
+#include <cstddef>
+#include <string>
+
+#include "bfc.h"
+#include "color.h"
+#include "common.h"
+#include "elements.h"
+#include "math.h"
+
+namespace ldraw
+{
+
+// Characters of the line being scanned; only valid during the callback.
+struct text_ref
+{
+  const char *begin;
+  const char *end;
+
+  std::size_t size() const { return end - begin; }
+  bool empty() const { return begin == end; }
+  std::string str() const { return std::string(begin, end); }
+};
+
+/* Receives the contents of a file from reader::scan() line by line, in the
+ * order they appear, without a model being built. Lines are classified just
+ * like the reader does when loading; override whatever is of interest.
+ *
+ *   struct part_counter : public scan_handler {
+ *     std::map<std::string, int> counts;
+ *     void ref(const color &, const matrix &, const text_ref &filename) { ++counts[filename.str()]; }
+ *   };
+ */
+class LIBLDR_EXPORT scan_handler
+{
+ public:
+  virtual ~scan_handler() {}
+
+  // "0 FILE" line; the one on the very first line names the main model
+  virtual void file(const text_ref &/*name*/) {}
+  virtual void description(const text_ref &/*desc*/) {}
+  virtual void name(const text_ref &/*name*/) {}
+  virtual void author(const text_ref &/*author*/) {}
+  // "0 !KEY value"
+  virtual void header(const text_ref &/*key*/, const text_ref &/*value*/) {}
+  virtual void certification(bfc_certification::cert_status /*cert*/, bfc_certification::winding /*orientation*/) {}
+
+  virtual void comment(const text_ref &/*text*/) {}
+  virtual void print(const text_ref &/*text*/) {}
+  virtual void state(element_state::state /*state*/) {}
+  virtual void bfc(element_bfc::command /*command*/) {}
+  virtual void ref(const color &/*c*/, const matrix &/*m*/, const text_ref &/*filename*/) {}
+  virtual void line(const color &/*c*/, const vector &/*p1*/, const vector &/*p2*/) {}
+  virtual void triangle(const color &/*c*/, const vector &/*p1*/, const vector &/*p2*/, const vector &/*p3*/) {}
+  virtual void quadrilateral(const color &/*c*/, const vector &/*p1*/, const vector &/*p2*/, const vector &/*p3*/, const vector &/*p4*/) {}
+  virtual void condline(const color &/*c*/, const vector &/*p1*/, const vector &/*p2*/, const vector &/*p3*/, const vector &/*p4*/) {}
+
+  // end of input
+  virtual void end() {}
+};
+
+}
+
+#endif
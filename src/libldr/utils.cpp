@@ -22,9 +22,9 @@ namespace ldraw
 namespace utils
 {
 
-bool _cyclic_reference_test(std::set<std::string> &sets, const model *m, const model *insert = 0L)
+bool _cyclic_reference_test(std::set<atom> &sets, const model *m, const model *insert = 0L)
 {
-	std::string mname = translate_string(m->name());
+	atom mname = atom::fold(m->name());
 
 	if (sets.find(mname) != sets.end())
 		return true;
@@ -35,7 +35,8 @@ bool _cyclic_reference_test(std::set<std::string> &sets, const model *m, const m
 		ldraw::type elemtype = (*it)->get_type();
 		if (elemtype == ldraw::type_ref) {
 			const ldraw::element_ref *l = CAST_AS_CONST_REF(*it);
-			if (l->get_model()) {
+			// parts whose geometry is not loaded yet cannot close a cycle
+			if (l->get_model() && l->get_model()->is_resident()) {
 				if (_cyclic_reference_test(sets, l->get_model()))
 					return true;
 			}
@@ -54,14 +55,14 @@ bool _cyclic_reference_test(std::set<std::string> &sets, const model *m, const m
 
 bool cyclic_reference_test(const model *m)
 {
-	std::set<std::string> names;
+	std::set<atom> names;
 
 	return _cyclic_reference_test(names, m);
 }
 
 bool cyclic_reference_test(const model *m, const model *insert)
 {
-	std::set<std::string> names;
+	std::set<atom> names;
 
 	return _cyclic_reference_test(names, m, insert);
 }
@@ -199,12 +200,12 @@ std::string trim_string(const std::string &str)
 
 bool is_stud(const model *model)
 {
-	return translate_string(model->name()).find("stu") != std::string::npos;
+	return model->is_stud();
 }
 
 bool is_stud(const element_ref *ref)
 {
-	return translate_string(ref->filename()).find("stu") != std::string::npos;
+	return ref->filename_atom().is_stud();
 }
 
 // Determinant.
@@ -243,6 +244,62 @@ bool is_orthogonal(const matrix &m)
 	return std::abs(std::floor(det) - det) < LDR_EPSILON;
 }
 
+// Zeroes and ones come out of the files exactly, so the special cases are
+// matched tightly; rotations by other angles are written down to only five
+// or six digits.
+transform_class classify_transform(const matrix &m)
+{
+	const float exact = 1e-6f;
+	const float approximate = 1e-3f;
+	
+	if (std::fabs(det3(m)) < exact)
+		return transform_singular;
+	
+	bool unit = true, axis_aligned = true;
+	
+	for (int r = 0; r < 3; ++r) {
+		int ones = 0;
+		
+		for (int c = 0; c < 3; ++c) {
+			float v = m.value(r, c);
+			
+			if (std::fabs(v - (r == c ? 1.0f : 0.0f)) >= exact)
+				unit = false;
+			
+			if (std::fabs(std::fabs(v) - 1.0f) < exact)
+				++ones;
+			else if (std::fabs(v) >= exact)
+				axis_aligned = false;
+		}
+		
+		if (ones != 1)
+			axis_aligned = false;
+	}
+	
+	if (unit) {
+		vector t = m.get_translation_vector();
+		
+		if (std::fabs(t.x()) < exact && std::fabs(t.y()) < exact && std::fabs(t.z()) < exact)
+			return transform_identity;
+		
+		return transform_translation;
+	} else if (axis_aligned) {
+		// one unit entry per row and not singular: a signed permutation
+		return transform_axis_aligned;
+	}
+	
+	for (int i = 0; i < 3; ++i) {
+		for (int j = i; j < 3; ++j) {
+			float dot = m.value(i, 0)*m.value(j, 0) + m.value(i, 1)*m.value(j, 1) + m.value(i, 2)*m.value(j, 2);
+			
+			if (std::fabs(dot - (i == j ? 1.0f : 0.0f)) >= approximate)
+				return transform_general;
+		}
+	}
+	
+	return transform_orthonormal;
+}
+
 }
 
 }
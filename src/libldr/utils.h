@@ -52,6 +52,7 @@ LIBLDR_EXPORT bool is_stud(const element_ref *ref);
 LIBLDR_EXPORT float det3(const matrix &m);
 LIBLDR_EXPORT bool is_singular_matrix(const matrix &m);
 LIBLDR_EXPORT bool is_orthogonal(const matrix &m);
+LIBLDR_EXPORT transform_class classify_transform(const matrix &m);
 
 }
 
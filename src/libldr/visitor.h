@@ -0,0 +1,114 @@
+/* libLDR: Portable and easy-to-use LDraw format abstraction & I/O reference library *
+ * To obtain more information about LDraw, visit http://www.ldraw.org.               *
+ * Distributed in terms of the GNU Lesser General Public License v3                  *
+ *                                                                                   *
+ * Author: (c)2006-2013 Park "segfault" J. K. <mastermind_at_planetmono_dot_org>     */
+
+#ifndef _LIBLDR_VISITOR_H_
+#define _LIBLDR_VISITOR_H_
+
+#include "bfc.h"
+#include "elements.h"
+#include "model.h"
+
+namespace ldraw
+{
+
+/* Type dispatch without RTTI. visit() switches on the type tag once and calls
+ * the visitor with the element downcast to its concrete class, so the
+ * matching operator() overload is picked at compile time:
+ *
+ *   struct counter {
+ *     int n;
+ *     void operator()(const element_triangle &) { ++n; }
+ *     void operator()(const element_base &) {}     // everything else
+ *   };
+ *
+ * Visiting a non-const element (or model) passes non-const references. */
+
+template <class Visitor> void visit(element_base *e, Visitor &v)
+{
+  switch (e->get_type()) {
+    case type_comment:
+      v(*static_cast<element_comment *>(e));
+      break;
+    case type_state:
+      v(*static_cast<element_state *>(e));
+      break;
+    case type_print:
+      v(*static_cast<element_print *>(e));
+      break;
+    case type_ref:
+      v(*static_cast<element_ref *>(e));
+      break;
+    case type_line:
+      v(*static_cast<element_line *>(e));
+      break;
+    case type_triangle:
+      v(*static_cast<element_triangle *>(e));
+      break;
+    case type_quadrilateral:
+      v(*static_cast<element_quadrilateral *>(e));
+      break;
+    case type_condline:
+      v(*static_cast<element_condline *>(e));
+      break;
+    case type_bfc:
+      v(*static_cast<element_bfc *>(e));
+      break;
+  }
+}
+
+template <class Visitor> void visit(const element_base *e, Visitor &v)
+{
+  switch (e->get_type()) {
+    case type_comment:
+      v(*static_cast<const element_comment *>(e));
+      break;
+    case type_state:
+      v(*static_cast<const element_state *>(e));
+      break;
+    case type_print:
+      v(*static_cast<const element_print *>(e));
+      break;
+    case type_ref:
+      v(*static_cast<const element_ref *>(e));
+      break;
+    case type_line:
+      v(*static_cast<const element_line *>(e));
+      break;
+    case type_triangle:
+      v(*static_cast<const element_triangle *>(e));
+      break;
+    case type_quadrilateral:
+      v(*static_cast<const element_quadrilateral *>(e));
+      break;
+    case type_condline:
+      v(*static_cast<const element_condline *>(e));
+      break;
+    case type_bfc:
+      v(*static_cast<const element_bfc *>(e));
+      break;
+  }
+}
+
+// Visits every element of m in order.
+template <class Visitor> void visit(model *m, Visitor &v)
+{
+  const std::vector<element_base *> &elements = m->elements();
+
+  for (model::const_iterator it = elements.begin(); it != elements.end(); ++it)
+    visit(*it, v);
+}
+
+template <class Visitor> void visit(const model *m, Visitor &v)
+{
+  const std::vector<element_base *> &elements = m->elements();
+
+  for (model::const_iterator it = elements.begin(); it != elements.end(); ++it)
+    visit(static_cast<const element_base *>(*it), v);
+}
+
+}
+
+#endif
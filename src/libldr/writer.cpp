@@ -4,245 +4,461 @@
  *                                                                                   *
  * Author: (c)2006-2008 Park "segfault" J. K. <mastermind_at_planetmono_dot_org>     */
 
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <ios>
 
+#if __cplusplus >= 201703L && defined(__has_include)
+#if __has_include(<charconv>)
+#include <charconv>
+#endif
+#endif
+
 #include "bfc.h"
+#include "compressed_stream.h"
 #include "elements.h"
 #include "model.h"
+#include "visitor.h"
 
 #include "writer.h"
 
 namespace ldraw
 {
 
+namespace
+{
+
+// output is handed to the stream whenever this much has piled up
+const std::size_t chunk_size = 65536;
+
+/* Writes the shortest digits that read back as f (which is finite and not
+ * negative) and returns their count; *exponent is the decimal exponent of the
+ * first digit. */
+int shortest_digits(float f, char *digits, int *exponent)
+{
+	char buf[32];
+
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+	*std::to_chars(buf, buf + sizeof(buf) - 1, f, std::chars_format::scientific).ptr = '\0';
+#else
+	for (int p = 1; p <= 9; ++p) {
+		std::snprintf(buf, sizeof(buf), "%.*e", p - 1, (double) f);
+		if (std::strtof(buf, 0L) == f)
+			break;
+	}
+#endif
+
+	// buf is d[.ddd]e<sign>xx
+	int n = 0;
+	const char *p = buf;
+	for (; *p != 'e'; ++p) {
+		if (*p != '.')
+			digits[n++] = *p;
+	}
+	*exponent = std::atoi(p + 1);
+
+	// the printf path may leave trailing zeros behind
+	while (n > 1 && digits[n - 1] == '0')
+		--n;
+
+	return n;
+}
+
+/* Formats f the way printf's %g does, but with as many significant digits
+ * as it takes to read back the same float, and never fewer than the six %g
+ * uses by default. Values that went through the default formatting once
+ * before therefore come out unchanged. Returns the length of the output. */
+int format_float(float f, char *out)
+{
+	if (!std::isfinite(f))
+		return std::snprintf(out, 32, "%g", (double) f);
+
+	char *o = out;
+	if (std::signbit(f)) {
+		*o++ = '-';
+		f = -f;
+	}
+
+	char digits[16] = { 0 };
+	int exponent;
+	int n = shortest_digits(f, digits, &exponent);
+	int precision = n > 6 ? n : 6;
+
+	if (exponent < -4 || exponent >= precision) {
+		*o++ = digits[0];
+		if (n > 1) {
+			*o++ = '.';
+			std::memcpy(o, digits + 1, n - 1);
+			o += n - 1;
+		}
+
+		*o++ = 'e';
+		*o++ = exponent < 0 ? '-' : '+';
+		if (exponent < 0)
+			exponent = -exponent;
+		if (exponent >= 100)
+			*o++ = '0' + exponent / 100;
+		*o++ = '0' + exponent / 10 % 10;
+		*o++ = '0' + exponent % 10;
+	} else if (exponent < 0) {
+		*o++ = '0';
+		*o++ = '.';
+		for (int i = -1; i > exponent; --i)
+			*o++ = '0';
+		std::memcpy(o, digits, n);
+		o += n;
+	} else {
+		for (int i = 0; i <= exponent; ++i)
+			*o++ = i < n ? digits[i] : '0';
+		if (n > exponent + 1) {
+			*o++ = '.';
+			std::memcpy(o, digits + exponent + 1, n - exponent - 1);
+			o += n - exponent - 1;
+		}
+	}
+
+	return o - out;
+}
+
+struct serializer
+{
+	writer *w;
+	
+	void operator()(const element_comment &e) { w->serialize_comment(&e); }
+	void operator()(const element_state &e) { w->serialize_state(&e); }
+	void operator()(const element_print &e) { w->serialize_print(&e); }
+	void operator()(const element_ref &e) { w->serialize_ref(&e); }
+	void operator()(const element_line &e) { w->serialize_line(&e); }
+	void operator()(const element_triangle &e) { w->serialize_triangle(&e); }
+	void operator()(const element_quadrilateral &e) { w->serialize_quadrilateral(&e); }
+	void operator()(const element_condline &e) { w->serialize_condline(&e); }
+	void operator()(const element_bfc &e) { w->serialize_bfc(&e); }
+};
+
+}
+
 writer::writer(const std::string &filename)
-	: m_filestream(new std::ofstream), m_stream(*m_filestream)
+	: m_filestream(new std::ofstream), m_gzip(0L), m_gzstream(0L), m_stream(open(filename))
 {
-	m_filestream->open(filename.c_str(), std::ios::out);
 	if (!m_filestream->is_open())
 		throw exception(__func__, exception::user_error, std::string("Could not open file for writing: ") + filename);
+
+	m_buffer.reserve(chunk_size);
 }
 
 writer::writer(std::ostream &stream)
-	: m_stream(stream)
+	: m_gzip(0L), m_gzstream(0L), m_stream(stream)
 {
 	m_filestream = 0L;
+	m_buffer.reserve(chunk_size);
 }
 
 writer::~writer()
 {
+	flush();
+
+	if (m_gzip) {
+		m_gzip->finish();
+		delete m_gzstream;
+		delete m_gzip;
+	}
+
 	if (m_filestream) {
 		m_filestream->close();
 		delete m_filestream;
 	}
 }
 
+// Opens the output file; called from the initializer list, so that m_stream
+// can refer to the compressing stream if there is one.
+std::ostream& writer::open(const std::string &filename)
+{
+	bool gzip = filename.length() > 3 && filename.compare(filename.length() - 3, 3, ".gz") == 0;
+
+	m_filestream->open(filename.c_str(), gzip ? std::ios::out | std::ios::binary : std::ios::out);
+	if (!gzip || !m_filestream->is_open())
+		return *m_filestream;
+
+	m_gzip = new gzip_streambuf(*m_filestream);
+	m_gzstream = new std::ostream(m_gzip);
+
+	return *m_gzstream;
+}
+
 void writer::write(const model *model)
 {
-	m_stream << "0 " << model->desc() << std::endl;
-	if (!model->name().empty())
-		m_stream << "0 Name: " << model->name() << std::endl;
-	if (!model->author().empty())
-		m_stream << "0 Author: " << model->author() << std::endl << std::endl;
+	put("0 ", 2);
+	put(model->desc());
+	end_line();
+	if (!model->name().empty()) {
+		put("0 Name: ", 8);
+		put(model->name());
+		end_line();
+	}
+	if (!model->author().empty()) {
+		put("0 Author: ", 10);
+		put(model->author());
+		end_line();
+		end_line();
+	}
 
 	if (model->custom_data<bfc_certification>()) {
 		bfc_certification *c = model->custom_data<bfc_certification>();
 		if (c->certification() == bfc_certification::certified) {
-			m_stream << "0 BFC";
+			put("0 BFC", 5);
 			
 			if (c->orientation() == bfc_certification::cw)
-				m_stream << " CW";
+				put(" CW", 3);
 
-			m_stream << std::endl << std::endl;;
+			end_line();
+			end_line();
 		} else if (c->certification() == bfc_certification::uncertified) {
-			m_stream << "0 BFC NOCERTIFY" << std::endl << std::endl;
+			put("0 BFC NOCERTIFY", 15);
+			end_line();
+			end_line();
 		}
 	}
 	
 	const std::multimap<std::string, std::string> &headers = model->headers();
-	for (std::multimap<std::string, std::string>::const_iterator it = headers.begin(); it != headers.end(); ++it)
-		m_stream << "0 !" << (*it).first << " " << (*it).second << std::endl;
-	m_stream << std::endl;
+	for (std::multimap<std::string, std::string>::const_iterator it = headers.begin(); it != headers.end(); ++it) {
+		put("0 !", 3);
+		put((*it).first);
+		put(' ');
+		put((*it).second);
+		end_line();
+	}
+	end_line();
 	
+	serializer s = { this };
 	for (model::const_iterator it = model->elements().begin(); it != model->elements().end(); ++it)
-		write(*it);
+		visit(*it, s);
+
+	flush();
 }
 	
 void writer::write(const model_multipart *mpmodel)
 {
-	m_stream << "0 FILE " << mpmodel->main_model()->name() << std::endl;
+	put("0 FILE ", 7);
+	put(mpmodel->main_model()->name());
+	end_line();
 
 	write(mpmodel->main_model());
 
 	for (std::map<std::string, model *>::const_iterator it = mpmodel->submodel_list().begin(); it != mpmodel->submodel_list().end(); ++it) {
-		m_stream << std::endl << "0 FILE " << (*it).second->name() << std::endl;
+		end_line();
+		put("0 FILE ", 7);
+		put((*it).second->name());
+		end_line();
 		write((*it).second);
 	}
 }
 
 void writer::write(const element_base *elem)
 {
-	switch (elem->get_type()) {
-		case type_comment:
-			serialize_comment(CAST_AS_CONST_COMMENT(elem));
-			break;
-		case type_state:
-			serialize_state(CAST_AS_CONST_STATE(elem));
-			break;
-		case type_print:
-			serialize_print(CAST_AS_CONST_PRINT(elem));
-			break;
-		case type_ref:
-			serialize_ref(CAST_AS_CONST_REF(elem));
-			break;
-		case type_line:
-			serialize_line(CAST_AS_CONST_LINE(elem));
-			break;
-		case type_triangle:
-			serialize_triangle(CAST_AS_CONST_TRIANGLE(elem));
-			break;
-		case type_quadrilateral:
-			serialize_quadrilateral(CAST_AS_CONST_QUADRILATERAL(elem));
-			break;
-		case type_condline:
-			serialize_condline(CAST_AS_CONST_CONDLINE(elem));
-			break;
-		case type_bfc:
-			serialize_bfc(CAST_AS_CONST_BFC(elem));
-			break;
-		default:
-			break;
-	}
+	serializer s = { this };
+	
+	visit(elem, s);
+	flush();
 }
 
 void writer::serialize_comment(const element_comment *e)
 {
-	m_stream << "0 " << e->get_comment() << std::endl;
+	put("0 ", 2);
+	put(e->get_comment());
+	end_line();
 }
 
 void writer::serialize_state(const element_state *e)
 {
-	m_stream << "0 ";
+	put("0 ", 2);
 
 	switch (e->get_state()) {
 		case element_state::state_step:
-			m_stream << "STEP";
+			put("STEP", 4);
 			break;
 		case element_state::state_pause:
-			m_stream << "PAUSE";
+			put("PAUSE", 5);
 			break;
 		case element_state::state_clear:
-			m_stream << "CLEAR";
+			put("CLEAR", 5);
 			break;
 		case element_state::state_save:
-			m_stream << "SAVE";
+			put("SAVE", 4);
 			break;
 	}
 
-	m_stream << std::endl;
+	end_line();
 }
 
 void writer::serialize_print(const element_print *e)
 {
-	m_stream << "0 PRINT " << e->get_string() << std::endl;
+	put("0 PRINT ", 8);
+	put(e->get_string());
+	end_line();
 }
 
 void writer::serialize_ref(const element_ref *e)
 {
-	m_stream << "1 " << e->get_color().get_id() << " ";
+	put("1 ", 2);
+	put_int(e->get_color().get_id());
+	put(' ');
 	serialize_matrix(e->get_matrix());
-	m_stream << " " << e->filename() << std::endl;
+	put(' ');
+	put(e->filename());
+	end_line();
 }
 
 void writer::serialize_line(const element_line *e)
 {
-	m_stream << "2 " << e->get_color().get_id() << " ";
+	put("2 ", 2);
+	put_int(e->get_color().get_id());
+	put(' ');
 	serialize_vector(e->pos1());
-	m_stream << " ";
+	put(' ');
 	serialize_vector(e->pos2());
-	m_stream << std::endl;
+	end_line();
 }
 
 void writer::serialize_triangle(const element_triangle *e)
 {
-	m_stream << "3 " << e->get_color().get_id() << " ";
+	put("3 ", 2);
+	put_int(e->get_color().get_id());
+	put(' ');
 	serialize_vector(e->pos1());
-	m_stream << " ";
+	put(' ');
 	serialize_vector(e->pos2());
-	m_stream << " ";
+	put(' ');
 	serialize_vector(e->pos3());
-	m_stream << std::endl;
+	end_line();
 }
 	
 void writer::serialize_quadrilateral(const element_quadrilateral *e)
 {
-	m_stream << "4 " << e->get_color().get_id() << " ";
+	put("4 ", 2);
+	put_int(e->get_color().get_id());
+	put(' ');
 	serialize_vector(e->pos1());
-	m_stream << " ";
+	put(' ');
 	serialize_vector(e->pos2());
-	m_stream << " ";
+	put(' ');
 	serialize_vector(e->pos3());
-	m_stream << " ";
+	put(' ');
 	serialize_vector(e->pos4());
-	m_stream << std::endl;
+	end_line();
 }
 
 void writer::serialize_condline(const element_condline *e)
 {
-	m_stream << "5 " << e->get_color().get_id() << " ";
+	put("5 ", 2);
+	put_int(e->get_color().get_id());
+	put(' ');
 	serialize_vector(e->pos1());
-	m_stream << " ";
+	put(' ');
 	serialize_vector(e->pos2());
-	m_stream << " ";
+	put(' ');
 	serialize_vector(e->pos3());
-	m_stream << " ";
+	put(' ');
 	serialize_vector(e->pos4());
-	m_stream << std::endl;
+	end_line();
 }
 
 void writer::serialize_bfc(const element_bfc *e)
 {
-	m_stream << "0 BFC ";
+	put("0 BFC ", 6);
 	
 	switch (e->get_command()) {
 		case element_bfc::cw:
-			m_stream << "CW";
+			put("CW", 2);
 			break;
 		case element_bfc::ccw:
-			m_stream << "CCW";
+			put("CCW", 3);
 			break;
 		case element_bfc::clip:
-			m_stream << "CLIP";
+			put("CLIP", 4);
 			break;
 		case element_bfc::clip_cw:
-			m_stream << "CLIP CW";
+			put("CLIP CW", 7);
 			break;
 		case element_bfc::clip_ccw:
-			m_stream << "CLIP CCW";
+			put("CLIP CCW", 8);
 			break;
 		case element_bfc::noclip:
-			m_stream << "NOCLIP";
+			put("NOCLIP", 6);
 			break;
 		case element_bfc::invertnext:
-			m_stream << "INVERTNEXT";
+			put("INVERTNEXT", 10);
 			break;
 	}
 
-	m_stream << std::endl;
+	end_line();
 }
 
 void writer::serialize_matrix(const matrix &m)
 {
-	m_stream << m.value(0, 3) << " " << m.value(1, 3) << " " << m.value(2, 3) <<
-		" " << m.value(0, 0) << " " << m.value(0, 1) << " " << m.value(0, 2) <<
-		" " << m.value(1, 0) << " " << m.value(1, 1) << " " << m.value(1, 2) <<
-		" " << m.value(2, 0) << " " << m.value(2, 1) << " " << m.value(2, 2);
+	static const int order[][2] = {
+		{0, 3}, {1, 3}, {2, 3},
+		{0, 0}, {0, 1}, {0, 2},
+		{1, 0}, {1, 1}, {1, 2},
+		{2, 0}, {2, 1}, {2, 2}
+	};
+
+	for (int i = 0; i < 12; ++i) {
+		if (i)
+			put(' ');
+		put_float(m.value(order[i][0], order[i][1]));
+	}
 }
 
 void writer::serialize_vector(const vector &v)
 {
-	m_stream << v.x() << " " << v.y() << " " << v.z();
+	put_float(v.x());
+	put(' ');
+	put_float(v.y());
+	put(' ');
+	put_float(v.z());
+}
+
+void writer::flush()
+{
+	if (!m_buffer.empty()) {
+		m_stream.write(m_buffer.data(), m_buffer.size());
+		m_buffer.clear();
+	}
+
+	m_stream.flush();
+}
+
+void writer::put_int(unsigned int i)
+{
+	char buf[16];
+	char *p = buf + sizeof(buf);
+
+	do {
+		*--p = '0' + i % 10;
+		i /= 10;
+	} while (i);
+
+	put(p, buf + sizeof(buf) - p);
+}
+
+void writer::put_float(float f)
+{
+	char buf[32];
+
+	put(buf, format_float(f, buf));
+}
+
+void writer::end_line()
+{
+	m_buffer.push_back('\n');
+
+	if (m_buffer.size() >= chunk_size) {
+		m_stream.write(m_buffer.data(), m_buffer.size());
+		m_buffer.clear();
+	}
 }
 
 }
@@ -7,6 +7,7 @@
 #ifndef _LIBLDR_WRITER_H_
 #define _LIBLDR_WRITER_H_
 
+#include <cstddef>
 #include <ostream>
 #include <string>
 
@@ -29,7 +30,11 @@ class element_condline;
 class element_bfc;
 class matrix;
 class vector;
+class gzip_streambuf;
 
+// Writes models in LDraw format. Output is collected in a buffer and handed
+// to the stream in large chunks; every write() leaves the stream up to date.
+// Files whose name ends in .gz are written gzip-compressed.
 class LIBLDR_EXPORT writer
 {
   public:
@@ -52,10 +57,24 @@ class LIBLDR_EXPORT writer
 	void serialize_bfc(const element_bfc *e);
 	void serialize_matrix(const matrix &m);
 	void serialize_vector(const vector &v);
+
+	// hands the buffered output of the serialize_*() calls to the stream
+	void flush();
 	
   private:
+	void put(const char *s, std::size_t len) { m_buffer.append(s, len); }
+	void put(const std::string &s) { m_buffer.append(s); }
+	void put(char c) { m_buffer.push_back(c); }
+	void put_int(unsigned int i);
+	void put_float(float f);
+	void end_line();
+	std::ostream& open(const std::string &filename);
+	
 	std::ofstream *m_filestream;
+	gzip_streambuf *m_gzip;
+	std::ostream *m_gzstream;
 	std::ostream &m_stream;
+	std::string m_buffer;
 };
 
 }
@@ -0,0 +1,307 @@
+/* LDRrenderer: LDraw model rendering library which based on libLDR                  *
+ * To obtain more information about LDraw, visit http://www.ldraw.org                *
+ * Distributed in terms of the General Public License v2                             *
+ *                                                                                   *
+ * Author: (c)2006-2013 Park "segfault" J. K. <mastermind_at_planetmono_dot_org>     */
+
+#include <algorithm>
+#include <set>
+
+#include <libldr/elements.h>
+#include <libldr/geometry_store.h>
+#include <libldr/model.h>
+#include <libldr/utils.h>
+
+#include "lod_extension.h"
+
+namespace ldraw_renderer
+{
+
+namespace
+{
+
+// cells along the longest side of the part, and whether edges are kept, for
+// levels 1 and up
+const struct { int cells; bool edges; } level_setup[lod_extension::level_count - 1] = {
+	{ 16, true },
+	{ 4, false }
+};
+
+// vertices merged into a cell, as sorted cell numbers plus the color
+struct cluster_key
+{
+	int cells[3];
+	unsigned int color;
+
+	bool operator<(const cluster_key &rhs) const
+	{
+		for (int i = 0; i < 3; ++i) {
+			if (cells[i] != rhs.cells[i])
+				return cells[i] < rhs.cells[i];
+		}
+
+		return color < rhs.color;
+	}
+};
+
+}
+
+lod_extension::lod_extension(ldraw::model *m, void *arg)
+	: extension(m, arg), m_params(static_cast<const parameters *>(arg)), m_stud(parameters::stud_regular), m_hash(0)
+{
+	for (int i = 0; i < level_count - 1; ++i)
+		m_levels[i] = 0L;
+}
+
+lod_extension::~lod_extension()
+{
+	clear();
+}
+
+void lod_extension::clear()
+{
+	for (int i = 0; i < level_count - 1; ++i) {
+		delete m_levels[i];
+		m_levels[i] = 0L;
+	}
+}
+
+void lod_extension::update()
+{
+	clear();
+
+	m_hash = m_model->content_hash();
+	m_stud = m_params->get_stud_rendering_mode();
+
+	std::stack<ldraw::color> colorstack;
+	colorstack.push(ldraw::color(16));
+
+	gather(colorstack, m_model, ldraw::matrix());
+
+	for (int i = 0; i < level_count - 1; ++i)
+		m_levels[i] = simplify(level_setup[i].cells, level_setup[i].edges);
+
+	m_faces.clear();
+	m_edges.clear();
+}
+
+bool lod_extension::is_update_required() const
+{
+	return m_hash != m_model->content_hash() || m_stud != m_params->get_stud_rendering_mode();
+}
+
+ldraw::model* lod_extension::level(int l) const
+{
+	if (l <= 0 || l >= level_count || !m_levels[l - 1])
+		return m_model;
+
+	return m_levels[l - 1];
+}
+
+int lod_extension::select(float radius, float threshold)
+{
+	if (radius >= threshold)
+		return 0;
+	else if (radius >= threshold * 0.25f)
+		return 1;
+	else
+		return 2;
+}
+
+// Flattens m the way vbuffer_extension collapses a part, with colors
+// resolved as far as the part decides them.
+void lod_extension::gather(std::stack<ldraw::color> &colorstack, const ldraw::model *m, const ldraw::matrix &transform)
+{
+	const ldraw::geometry_store &g = m->geometry();
+	const ldraw::color &top = colorstack.top();
+
+	for (int p = ldraw::geometry_store::lines; p <= ldraw::geometry_store::quads; ++p) {
+		const ldraw::geometry_store::stream &s = g.get((ldraw::geometry_store::primitive)p);
+
+		for (int i = 0; i < s.size(); ++i) {
+			ldraw::vector v[4];
+			unsigned int color = s.colors[i];
+
+			for (int j = 0; j < s.vertices; ++j)
+				v[j] = transform * s.vertex(i, j);
+
+			if (color == 16) {
+				color = top.get_id();
+			} else if (color == 24 && !top.is_null()) {
+				// the complement of a known color has no id; use it directly
+				const unsigned char *c = top.get_entity()->complement;
+				color = 0x02000000 | (c[0] << 16) | (c[1] << 8) | c[2];
+			}
+
+			if (p == ldraw::geometry_store::lines) {
+				edge e;
+				for (int j = 0; j < 2; ++j) {
+					for (int k = 0; k < 3; ++k)
+						e.v[j][k] = v[j][k];
+				}
+				e.color = color;
+				m_edges.push_back(e);
+				continue;
+			}
+
+			// quads as (0, 1, 2) and (0, 2, 3)
+			for (int t = 0; t < s.vertices - 2; ++t) {
+				const int corners[3] = { 0, t + 1, t + 2 };
+				face f;
+
+				for (int j = 0; j < 3; ++j) {
+					for (int k = 0; k < 3; ++k)
+						f.v[j][k] = v[corners[j]][k];
+				}
+				f.color = color;
+				m_faces.push_back(f);
+			}
+		}
+	}
+
+	for (std::vector<int>::const_iterator it = g.refs().begin(); it != g.refs().end(); ++it) {
+		const ldraw::element_ref *l = CAST_AS_CONST_REF(m->elements()[*it]);
+		const ldraw::model *rm = l->get_model();
+
+		if (!rm || rm == m)
+			continue;
+
+		// studs other than regular ones are not worth keeping from afar
+		if (ldraw::utils::is_stud(rm) && m_stud != parameters::stud_regular)
+			continue;
+
+		const ldraw::color &c = l->get_color();
+
+		if (c.is_null())
+			colorstack.push(colorstack.top());
+		else
+			colorstack.push(c);
+
+		gather(colorstack, rm, transform * l->get_matrix());
+
+		colorstack.pop();
+	}
+}
+
+// Merges all vertices falling into the same cube of a grid, cells cubes
+// along the longest side, into their mean. Faces and edges whose corners no
+// longer lie in distinct cells are dropped, as are the duplicates left over.
+ldraw::model* lod_extension::simplify(int cells, bool edges) const
+{
+	ldraw::model *result = new ldraw::model(m_model->desc(), m_model->name(), m_model->author());
+	result->set_modeltype(m_model->modeltype());
+
+	if (m_faces.empty() && (!edges || m_edges.empty()))
+		return result;
+
+	float min[3], max[3];
+
+	for (int k = 0; k < 3; ++k) {
+		min[k] = m_faces.empty() ? m_edges[0].v[0][k] : m_faces[0].v[0][k];
+		max[k] = min[k];
+	}
+
+	for (std::vector<face>::const_iterator it = m_faces.begin(); it != m_faces.end(); ++it) {
+		for (int j = 0; j < 3; ++j) {
+			for (int k = 0; k < 3; ++k) {
+				min[k] = std::min(min[k], it->v[j][k]);
+				max[k] = std::max(max[k], it->v[j][k]);
+			}
+		}
+	}
+
+	if (edges) {
+		for (std::vector<edge>::const_iterator it = m_edges.begin(); it != m_edges.end(); ++it) {
+			for (int j = 0; j < 2; ++j) {
+				for (int k = 0; k < 3; ++k) {
+					min[k] = std::min(min[k], it->v[j][k]);
+					max[k] = std::max(max[k], it->v[j][k]);
+				}
+			}
+		}
+	}
+
+	float size = std::max(max[0] - min[0], std::max(max[1] - min[1], max[2] - min[2])) / cells;
+	if (size <= 0.0f)
+		return result;
+
+	// one more than cells, for the far sides of the box
+	const int n = cells + 1;
+	std::vector<float> sums(n * n * n * 3, 0.0f);
+	std::vector<int> counts(n * n * n, 0);
+
+	std::vector<int> face_cells(m_faces.size() * 3);
+	std::vector<int> edge_cells(edges ? m_edges.size() * 2 : 0);
+
+	for (int i = 0; i < (int)(face_cells.size() + edge_cells.size()); ++i) {
+		const float *v;
+		int *cell;
+
+		if (i < (int)face_cells.size()) {
+			v = m_faces[i / 3].v[i % 3];
+			cell = &face_cells[i];
+		} else {
+			int e = i - (int)face_cells.size();
+
+			v = m_edges[e / 2].v[e % 2];
+			cell = &edge_cells[e];
+		}
+
+		int c[3];
+		for (int k = 0; k < 3; ++k)
+			c[k] = std::min((int)((v[k] - min[k]) / size), cells);
+
+		*cell = (c[0] * n + c[1]) * n + c[2];
+
+		for (int k = 0; k < 3; ++k)
+			sums[*cell * 3 + k] += v[k];
+		++counts[*cell];
+	}
+
+	std::vector<ldraw::vector> centers(n * n * n);
+
+	for (int i = 0; i < n * n * n; ++i) {
+		if (counts[i]) {
+			float w = 1.0f / counts[i];
+
+			centers[i] = ldraw::vector(sums[i * 3] * w, sums[i * 3 + 1] * w, sums[i * 3 + 2] * w);
+		}
+	}
+
+	std::set<cluster_key> seen;
+
+	for (int i = 0; i < (int)m_faces.size(); ++i) {
+		const int *c = &face_cells[i * 3];
+
+		if (c[0] == c[1] || c[1] == c[2] || c[0] == c[2])
+			continue;
+
+		cluster_key key = { { c[0], c[1], c[2] }, m_faces[i].color };
+		std::sort(key.cells, key.cells + 3);
+
+		if (!seen.insert(key).second)
+			continue;
+
+		result->insert_element(new ldraw::element_triangle(ldraw::color(m_faces[i].color), centers[c[0]], centers[c[1]], centers[c[2]]));
+	}
+
+	seen.clear();
+
+	for (int i = 0; i < (int)m_edges.size() && edges; ++i) {
+		const int *c = &edge_cells[i * 2];
+
+		if (c[0] == c[1])
+			continue;
+
+		cluster_key key = { { std::min(c[0], c[1]), std::max(c[0], c[1]), -1 }, m_edges[i].color };
+
+		if (!seen.insert(key).second)
+			continue;
+
+		result->insert_element(new ldraw::element_line(ldraw::color(m_edges[i].color), centers[c[0]], centers[c[1]]));
+	}
+
+	return result;
+}
+
+}
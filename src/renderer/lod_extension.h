@@ -0,0 +1,87 @@
+/* LDRrenderer: LDraw model rendering library which based on libLDR                  *
+ * To obtain more information about LDraw, visit http://www.ldraw.org                *
+ * Distributed in terms of the General Public License v2                             *
+ *                                                                                   *
+ * Author: (c)2006-2013 Park "segfault" J. K. <mastermind_at_planetmono_dot_org>     */
+
+#ifndef _RENDERER_LOD_EXTENSION_H_
+#define _RENDERER_LOD_EXTENSION_H_
+
+#include <stdint.h>
+#include <stack>
+#include <vector>
+
+#include <libldr/color.h>
+#include <libldr/extension.h>
+#include <libldr/math.h>
+
+#include <renderer/parameters.h>
+
+namespace ldraw
+{
+	class model;
+}
+
+namespace ldraw_renderer
+{
+
+/* Coarser stand-ins of a part for drawing it small on screen. The part is
+ * flattened once and its vertices are merged on a grid laid over its bounding
+ * box (vertex clustering); each level is an ordinary model of triangles and
+ * lines, so it is drawn through its own vbuffer_extension like anything else.
+ * Colors 16 and 24 are kept wherever the part leaves them to the reference. */
+class LIBLDRAWRENDERER_EXPORT lod_extension : public ldraw::extension
+{
+  public:
+	// level 0 is the model itself
+	static const int level_count = 3;
+
+	// arg is the const parameters * to follow
+	lod_extension(ldraw::model *m, void *arg);
+	~lod_extension();
+
+	static const std::string identifier() { return "lod_extension"; }
+
+	void update();
+
+	// Only the part itself is watched; edits further down go unnoticed.
+	bool is_update_required() const;
+
+	// The model to draw at level l, the part itself for level 0.
+	ldraw::model* level(int l) const;
+
+	// Level for a model whose bounding sphere is radius pixels across on
+	// screen, given the radius below which detail starts to drop.
+	static int select(float radius, float threshold);
+
+  private:
+	struct face
+	{
+		float v[3][3];
+		unsigned int color;
+	};
+
+	struct edge
+	{
+		float v[2][3];
+		unsigned int color;
+	};
+
+	void clear();
+	void gather(std::stack<ldraw::color> &colorstack, const ldraw::model *m, const ldraw::matrix &transform);
+	ldraw::model* simplify(int cells, bool edges) const;
+
+	const parameters *m_params;
+	parameters::stud_rendering_mode m_stud;
+	uint64_t m_hash;
+
+	ldraw::model *m_levels[level_count - 1];
+
+	// flattened part, only kept while updating
+	std::vector<face> m_faces;
+	std::vector<edge> m_edges;
+};
+
+}
+
+#endif
@@ -25,33 +25,16 @@ normal_extension::~normal_extension()
 
 void normal_extension::update()
 {
-	int i = 0;
+	const ldraw::geometry_store &g = m_model->geometry();
+	const ldraw::geometry_store::primitive faces[] = { ldraw::geometry_store::triangles, ldraw::geometry_store::quads };
 
 	m_normals.clear();
-	
-	for (ldraw::model::const_iterator it = m_model->elements().begin(); it != m_model->elements().end(); ++it) {
-		ldraw::vector v1, v2, v3;
-		ldraw::vector nvec;
-
-		switch ((*it)->get_type()) {
-			case ldraw::type_triangle:
-			{
-				const ldraw::element_triangle *t = CAST_AS_CONST_TRIANGLE(*it);
-				nvec = calculate_normal(t->pos1(), t->pos2(), t->pos3());
-				break;
-			}
-			case ldraw::type_quadrilateral:
-			{
-				const ldraw::element_quadrilateral *t = CAST_AS_CONST_QUADRILATERAL(*it);
-				nvec = calculate_normal(t->pos1(), t->pos2(), t->pos3());
-				break;
-			}
-			default:
-				++i;
-				continue;
-		}
-
-		m_normals[i++] = nvec;
+
+	for (int f = 0; f < 2; ++f) {
+		const ldraw::geometry_store::stream &s = g.get(faces[f]);
+
+		for (int i = 0; i < s.size(); ++i)
+			m_normals[s.indices[i]] = calculate_normal(s.vertex(i, 0), s.vertex(i, 1), s.vertex(i, 2));
 	}
 }
 
@@ -14,9 +14,13 @@ parameters::parameters()
 	m_stud_mode = stud_square;
 	m_mode = model_full;
 	m_vbuffer_criteria = vbuffer_parts;
+	m_vbuffer_indexed = true;
 	m_shading = true;
 	m_debug = false;
 	m_culling = false; /* disabled for a while */
+	m_frustum_culling = true;
+	m_level_of_detail = true;
+	m_lod_threshold = 24.0f;
 	m_shader = true;
 }
 
@@ -25,9 +29,13 @@ parameters::parameters(const parameters &rhs)
 	m_stud_mode = rhs.get_stud_rendering_mode();
 	m_mode = rhs.get_rendering_mode();
 	m_vbuffer_criteria = rhs.get_vbuffer_criteria();
+	m_vbuffer_indexed = rhs.get_vbuffer_indexed();
 	m_shading = rhs.get_shading();
 	m_debug = rhs.get_debug();
 	m_culling = rhs.get_culling();
+	m_frustum_culling = rhs.get_frustum_culling();
+	m_level_of_detail = rhs.get_level_of_detail();
+	m_lod_threshold = rhs.get_lod_threshold();
 	m_shader = rhs.get_shader();
 }
 
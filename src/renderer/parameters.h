@@ -26,26 +26,40 @@ class LIBLDRAWRENDERER_EXPORT parameters
 	stud_rendering_mode get_stud_rendering_mode() const { return m_stud_mode; }
 	render_method get_rendering_mode() const { return m_mode; }
 	vbuffer_criteria get_vbuffer_criteria() const { return m_vbuffer_criteria; }
+	bool get_vbuffer_indexed() const { return m_vbuffer_indexed; }
 	bool get_shading() const { return m_shading; }
 	bool get_debug() const { return m_debug; }
 	bool get_culling() const { return m_culling; }
+	bool get_frustum_culling() const { return m_frustum_culling; }
+	bool get_level_of_detail() const { return m_level_of_detail; }
+	float get_lod_threshold() const { return m_lod_threshold; }
 	bool get_shader() const { return m_shader; }
 
 	void set_stud_rendering_mode(stud_rendering_mode s) { m_stud_mode = s; }
 	void set_rendering_mode(render_method m) { m_mode = m; }
 	void set_vbuffer_criteria(vbuffer_criteria v) { m_vbuffer_criteria = v; }
+	// share identical vertices in vertex buffers, drawn through indices
+	void set_vbuffer_indexed(bool b) { m_vbuffer_indexed = b; }
 	void set_shading(bool b) { m_shading = b; }
 	void set_debug(bool b) { m_debug = b; }
 	void set_culling(bool b) { m_culling = b; }
+	void set_frustum_culling(bool b) { m_frustum_culling = b; }
+	void set_level_of_detail(bool b) { m_level_of_detail = b; }
+	// radius in pixels below which parts are drawn simplified
+	void set_lod_threshold(float r) { m_lod_threshold = r; }
 	void set_shader(bool b) { m_shader = b; }
 
   private:
 	stud_rendering_mode m_stud_mode;
 	render_method m_mode;
 	vbuffer_criteria m_vbuffer_criteria;
+	bool m_vbuffer_indexed;
 	bool m_shading;
 	bool m_debug;
 	bool m_culling;
+	bool m_frustum_culling;
+	bool m_level_of_detail;
+	float m_lod_threshold;
 	bool m_shader;
 };
 
@@ -4,6 +4,13 @@
  *                                                                                   *
  * Author: (c)2006-2010 Park "segfault" J. K. <mastermind_at_planetmono_dot_org>     */
 
+#include <algorithm>
+#include <vector>
+
+#include <libldr/filter.h>
+#include <libldr/frustum.h>
+#include <libldr/model.h>
+
 #include "opengl.h"
 #include "opengl_extension_vbo.h"
 #include "parameters.h"
@@ -15,6 +22,98 @@
 namespace ldraw_renderer
 {
 
+namespace
+{
+
+// ldraw::reference_bvh passes over what its filter selects; hit_test() looks
+// at nothing but that.
+struct inverted_filter : public ldraw::filter
+{
+	inverted_filter(const ldraw::filter *f) : inner(f) {}
+	
+	bool query(const ldraw::model *m, int index, int depth) const { return !inner->query(m, index, depth); }
+	
+	const ldraw::filter *inner;
+};
+
+// inv * (x, y, z, 1), w divided out
+ldraw::vector unproject(const ldraw::matrix &inv, float x, float y, float z)
+{
+	float r[4];
+	
+	for (int i = 0; i < 4; ++i)
+		r[i] = inv.value(i, 0) * x + inv.value(i, 1) * y + inv.value(i, 2) * z + inv.value(i, 3);
+	
+	return ldraw::vector(r[0] / r[3], r[1] / r[3], r[2] / r[3]);
+}
+
+// A rectangle dragged in any direction, with positive extents; a zero extent
+// counts as one pixel.
+void normalize_rect(int &x, int &y, int &w, int &h)
+{
+	if (w == 0)
+		w = 1;
+	else if (w < 0)
+		x += w, w = -w;
+	
+	if (h == 0)
+		h = 1;
+	else if (h < 0)
+		y += h, h = -h;
+}
+
+// the normalized window rectangle as a frustum in the coordinates transform
+// maps from
+ldraw::frustum rect_frustum(const ldraw::matrix &transform, int x, int y, int w, int h)
+{
+	GLint viewport[4];
+	
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	
+	// the rectangle in normalized device coordinates, y pointing up
+	float x0 = (float) (x - viewport[0]) / viewport[2] * 2.0f - 1.0f;
+	float x1 = (float) (x + w - viewport[0]) / viewport[2] * 2.0f - 1.0f;
+	float y0 = (float) (viewport[3] - (y + h) - viewport[1]) / viewport[3] * 2.0f - 1.0f;
+	float y1 = (float) (viewport[3] - y - viewport[1]) / viewport[3] * 2.0f - 1.0f;
+	
+	return ldraw::frustum(transform, x0, y0, x1, y1);
+}
+
+// depth of p in the window, behind the eye counting as nearest
+float window_depth(const ldraw::matrix &transform, const ldraw::vector &p)
+{
+	float z = transform.value(2, 0) * p.x() + transform.value(2, 1) * p.y() + transform.value(2, 2) * p.z() + transform.value(2, 3);
+	float w = transform.value(3, 0) * p.x() + transform.value(3, 1) * p.y() + transform.value(3, 2) * p.z() + transform.value(3, 3);
+	
+	if (w <= 0.0f)
+		return 0.0f;
+	
+	return std::min(std::max((z / w + 1.0f) * 0.5f, 0.0f), 1.0f);
+}
+
+float window_depth(const ldraw::matrix &transform, const ldraw::oriented_box &box)
+{
+	float depth = 1.0f;
+	
+	for (int i = 0; i < 8; ++i) {
+		ldraw::vector c = box.center;
+		
+		for (int j = 0; j < 3; ++j)
+			c = (i & (1 << j)) ? c + box.axes[j] : c - box.axes[j];
+		
+		depth = std::min(depth, window_depth(transform, c));
+	}
+	
+	return depth;
+}
+
+unsigned int scale_depth(float depth)
+{
+	return (unsigned int) (depth * 4294967295.0);
+}
+
+}
+
 renderer_opengl::renderer_opengl(const parameters *params)
 	: renderer(params)
 {
@@ -99,6 +198,73 @@ void renderer_opengl::setup()
 	}
 }
 
+// GL keeps its matrices column by column
+ldraw::matrix renderer_opengl::clip_transform(const float *projection_matrix, const float *modelview_matrix)
+{
+	ldraw::matrix projection(const_cast<float *>(projection_matrix));
+	ldraw::matrix modelview(const_cast<float *>(modelview_matrix));
+	
+	return projection.transpose() * modelview.transpose();
+}
+
+ldraw::ray renderer_opengl::pick_ray(const float *projection_matrix, const float *modelview_matrix, float x, float y)
+{
+	GLint viewport[4];
+	
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	
+	ldraw::matrix inv = ~clip_transform(projection_matrix, modelview_matrix);
+	
+	float nx = (x - viewport[0]) / viewport[2] * 2.0f - 1.0f;
+	float ny = (viewport[3] - y - viewport[1]) / viewport[3] * 2.0f - 1.0f;
+	
+	ldraw::ray r;
+	r.origin = unproject(inv, nx, ny, -1.0f);
+	r.direction = unproject(inv, nx, ny, 1.0f) - r.origin;
+	
+	return r;
+}
+
+bool renderer_opengl::hit_test(float *projection_matrix, float *modelview_matrix, int x, int y, int w, int h, ldraw::model *m, const ldraw::filter *hit_filter)
+{
+	inverted_filter skip(hit_filter);
+	std::vector<int> hits;
+	
+	normalize_rect(x, y, w, h);
+	
+	ldraw::reference_bvh::current(m)->query(rect_frustum(clip_transform(projection_matrix, modelview_matrix), x, y, w, h), hits, &skip);
+	
+	return !hits.empty();
+}
+
+selection_list renderer_opengl::select(float *projection_matrix, float *modelview_matrix, int x, int y, int w, int h, ldraw::model *m, const ldraw::filter *skip_filter)
+{
+	selection_list result;
+	
+	normalize_rect(x, y, w, h);
+	
+	ldraw::matrix transform = clip_transform(projection_matrix, modelview_matrix);
+	
+	if (m_selection == selection_model_full) {
+		ldraw::pick_result p = ldraw::pick(m, pick_ray(projection_matrix, modelview_matrix, x + w * 0.5f, y + h * 0.5f), skip_filter);
+		
+		if (p.element != -1)
+			result.push_back(std::pair<int, unsigned int>(p.element, scale_depth(window_depth(transform, p.point))));
+		
+		return result;
+	}
+	
+	const ldraw::reference_bvh *refs = ldraw::reference_bvh::current(m);
+	std::vector<int> hits;
+	
+	refs->query(rect_frustum(transform, x, y, w, h), hits, skip_filter);
+	
+	for (std::vector<int>::const_iterator it = hits.begin(); it != hits.end(); ++it)
+		result.push_back(std::pair<int, unsigned int>(*it, scale_depth(window_depth(transform, *refs->bounds(*it)))));
+	
+	return result;
+}
+
 renderer_opengl_factory::renderer_opengl_factory(const parameters *params, rendering_mode rm)
 {
 	m_params = params;
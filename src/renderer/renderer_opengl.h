@@ -7,6 +7,7 @@
 #ifndef _RENDERER_RENDERER_OPENGL_H_
 #define _RENDERER_RENDERER_OPENGL_H_
 
+#include <libldr/bvh.h>
 #include <libldr/common.h>
 
 #include <renderer/renderer.h>
@@ -24,6 +25,24 @@ class LIBLDRAWRENDERER_EXPORT renderer_opengl : public renderer
 	virtual ~renderer_opengl();
 	
 	virtual void setup();
+	
+	// Ray through window point (x, y) from the near to the far plane, in the
+	// coordinates the modelview matrix maps from; its depth runs from 0 to 1.
+	static ldraw::ray pick_ray(const float *projection_matrix, const float *modelview_matrix, float x, float y);
+	
+	// Whether a reference hit_filter selects has its box reach into the
+	// rectangle, from the spatial index of m as select() uses it; no
+	// GL_SELECT round trip. Lines-only parts count like any other.
+	virtual bool hit_test(float *projection_matrix, float *modelview_matrix, int x, int y, int w, int h, ldraw::model *m, const ldraw::filter *hit_filter);
+	
+	// References whose boxes reach into the rectangle, from the spatial index
+	// of m; with selection_model_full, the element nearest under the middle.
+	// Depths are scaled to unsigned int as GL_SELECT does.
+	virtual selection_list select(float *projection_matrix, float *modelview_matrix, int x, int y, int w, int h, ldraw::model *m, const ldraw::filter *skip_filter);
+	
+  protected:
+	// projection * modelview of GL matrices, as an ldraw::matrix
+	static ldraw::matrix clip_transform(const float *projection_matrix, const float *modelview_matrix);
 };
 
 class LIBLDRAWRENDERER_EXPORT renderer_opengl_factory
@@ -169,7 +169,7 @@ void renderer_opengl_immediate::draw_model_full(const ldraw::model_multipart *ba
 				// flip plane check
 				bool reverse;
 
-				if (ldraw::utils::det3(proj * l->get_matrix()) < 0.0f) {
+				if (l->determinant_sign() != 0 && l->is_mirrored() != flipped) {
 					reverse = true;
 				} else
 					reverse = false;
@@ -339,194 +339,6 @@ void renderer_opengl_immediate::draw_model_bounding_boxes(const ldraw::model_mul
 	}
 }
 
-bool renderer_opengl_immediate::hit_test(float *projection_matrix, float *modelview_matrix, int x, int y, int w, int h, ldraw::model *m, const ldraw::filter *skip_filter)
-{
-	GLint viewport[4];
-	GLuint selectionBuffer[4];
-	
-	if (w == 0)
-		w = 1;
-	else if (w < 0)
-		x += w, w = -w;
-
-	if (h == 0)
-		h = 1;
-	else if (h < 0)
-		y += h, h = -h;
-
-	glSelectBuffer(4, selectionBuffer);
-	glRenderMode(GL_SELECT);
-	
-	glGetIntegerv(GL_VIEWPORT, viewport);
-
-	glMatrixMode(GL_PROJECTION);
-	glLoadIdentity();
-	gluPickMatrix(x + w/2, viewport[3] - (y + h/2), w, h, viewport);
-	glMultMatrixf(projection_matrix);
-
-	glMatrixMode(GL_MODELVIEW);
-	glLoadMatrixf(modelview_matrix);
-	glInitNames();
-	glPushName(0);
-
-	glPointSize(7.0f);
-
-	int i = 0;
-	for (ldraw::model::const_iterator it = m->elements().begin(); it != m->elements().end(); ++it) {
-		ldraw::type elemtype = (*it)->get_type();
-
-		if (skip_filter->query(m, i, 0)) {
-			if (elemtype == ldraw::type_ref) {
-				ldraw::element_ref *l = CAST_AS_REF(*it);
-				
-				if (!l->get_model())
-					continue;
-				
-				if (!l->get_model()->custom_data<ldraw::metrics>())
-					l->get_model()->update_custom_data<ldraw::metrics>();
-				
-				glPushMatrix();
-				glMultMatrixf(l->get_matrix().transpose().get_pointer());
-				
-				render_filled_bounding_box(*l->get_model()->custom_data<ldraw::metrics>());
-				
-				glPopMatrix();
-			}
-		}
-
-		++i;
-	}
-
-	if (i == 0)
-		return false;
-
-	if (glRenderMode(GL_RENDER))
-		return true;
-	else
-		return false;
-}
-
-// Get selection
-selection_list renderer_opengl_immediate::select(float *projection_matrix, float *modelview_matrix, int x, int y, int w, int h, ldraw::model *m, const ldraw::filter *skip_filter)
-{
-	GLint hits, viewport[4];
-	GLuint selectionBuffer[1024];
-
-	if (w == 0)
-		w = 1;
-	else if (w < 0)
-		x += w, w = -w;
-
-	if (h == 0)
-		h = 1;
-	else if (h < 0)
-		y += h, h = -h;
-
-	glSelectBuffer(1024, selectionBuffer);
-	glRenderMode(GL_SELECT);
-	
-	glGetIntegerv(GL_VIEWPORT, viewport);
-
-	glMatrixMode(GL_PROJECTION);
-	glLoadIdentity();
-	gluPickMatrix(x + w/2, viewport[3] - (y + h/2), w, h, viewport);
-	glMultMatrixf(projection_matrix);
-
-	glMatrixMode(GL_MODELVIEW);
-	glLoadMatrixf(modelview_matrix);
-	glInitNames();
-	glPushName(0);
-
-	glPointSize(7.0f);
-
-	// Iterate!
-	int i = 0;
-	for (ldraw::model::const_iterator it = m->elements().begin(); it != m->elements().end(); ++it) {
- 		if (skip_filter->query(m, i, 0)) {
-			++i;
-			continue;
-		}
-		
-		ldraw::type elemtype = (*it)->get_type();
-			
-		if (elemtype == ldraw::type_ref) {
-			ldraw::element_ref *l = CAST_AS_REF(*it);
-
-			if (!l->get_model()) {
-				++i;
-				continue;
-			}
-			
-			if (!l->get_model()->custom_data<ldraw::metrics>())
-				l->get_model()->update_custom_data<ldraw::metrics>();
-			
-			glPushMatrix();
-			glMultMatrixf(l->get_matrix().transpose().get_pointer());
-			
-			glLoadName(i);
-			const ldraw::metrics *metrics = l->get_model()->custom_data<ldraw::metrics>();
-			ldraw::vector center = (metrics->min_() + metrics->max_()) * 0.5;
-			
-			glBegin(GL_POINTS);
-			glVertex3fv(center.get_pointer());
-			glEnd();
-			
-			glPopMatrix();
-		}
-		
-		++i;
-	}
-
-	hits = glRenderMode(GL_RENDER);
-
-	std::list<std::pair<int, GLuint> > result;
-	for (int i = 0; i < hits; ++i)
-		result.push_back(std::pair<int, GLuint>(selectionBuffer[i * 4 + 3], selectionBuffer[i * 4 + 1]));
-
-	return result;
-}
-
-// Draw a filled bounding box
-void renderer_opengl_immediate::render_filled_bounding_box(const ldraw::metrics &metrics)
-{
-	const ldraw::vector &min = metrics.min_();
-	const ldraw::vector &max = metrics.max_();
-	
-	glBegin(GL_QUADS);
-	
-	glVertex3f(max.x(), max.y(), min.z());
-	glVertex3f(min.x(), max.y(), min.z());
-	glVertex3f(min.x(), max.y(), max.z());
-	glVertex3f(max.x(), max.y(), max.z());
-
-	glVertex3f(max.x(), min.y(), max.z());
-	glVertex3f(min.x(), min.y(), max.z());
-	glVertex3f(min.x(), min.y(), min.z());
-	glVertex3f(max.x(), min.y(), min.z());
-
-	glVertex3f(max.x(), max.y(), max.z());
-	glVertex3f(min.x(), max.y(), max.z());
-	glVertex3f(min.x(), min.y(), max.z());
-	glVertex3f(max.x(), min.y(), max.z());
-
-	glVertex3f(max.x(), min.y(), min.z());
-	glVertex3f(min.x(), min.y(), min.z());
-	glVertex3f(min.x(), max.y(), min.z());
-	glVertex3f(max.x(), max.y(), min.z());
-
-	glVertex3f(min.x(), max.y(), max.z());
-	glVertex3f(min.x(), max.y(), min.z());
-	glVertex3f(min.x(), min.y(), min.z());
-	glVertex3f(min.x(), min.y(), max.z());
-
-	glVertex3f(max.x(), max.y(), min.z());
-	glVertex3f(max.x(), max.y(), max.z());
-	glVertex3f(max.x(), min.y(), max.z());
-	glVertex3f(max.x(), min.y(), min.z());
-	
-	glEnd();
-}
-
 // Draw a bounding box
 void renderer_opengl_immediate::render_bounding_box(const ldraw::metrics &metrics)
 {
@@ -4,9 +4,16 @@
  *                                                                                   *
  * Author: (c)2006-2008 Park "segfault" J. K. <mastermind_at_planetmono_dot_org>     */
 
+#include <algorithm>
+#include <cmath>
+
 #include <libldr/filter.h>
+#include <libldr/frustum.h>
+#include <libldr/metrics.h>
 #include <libldr/model.h>
+#include <libldr/utils.h>
 
+#include "lod_extension.h"
 #include "opengl.h"
 #include "opengl_extension_vbo.h"
 #include "opengl_extension_shader.h"
@@ -17,6 +24,23 @@
 namespace ldraw_renderer
 {
 
+namespace
+{
+
+void draw_buffer(const vbuffer_extension *ve, vbuffer_extension::buffer_type type, GLenum mode, bool vbo)
+{
+  if (!ve->is_indexed(type)) {
+    glDrawArrays(mode, 0, ve->count(type));
+    return;
+  }
+  
+  if (vbo)
+    opengl_extension_vbo::self()->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER_ARB, ve->get_vbo_indices(type));
+  glDrawElements(mode, ve->count(type), ve->get_index_type(), ve->get_index_array(type));
+}
+
+}
+
 const float renderer_opengl_retained::m_bbox_lines[] = {
   0.0f, 0.0f, 0.0f,
   1.0f, 0.0f, 0.0f,
@@ -95,6 +119,11 @@ renderer_opengl_retained::renderer_opengl_retained(const parameters *rp,
                                                    bool force_vbuffer, bool force_fixed)
     : renderer_opengl(rp)
 {
+  m_culling_stats.drawn = 0;
+  m_culling_stats.culled = 0;
+  m_culling_stats.simplified = 0;
+  m_lod_scale = 0.0f;
+  
   if (force_vbuffer)
     m_vbo = false;
   else
@@ -140,12 +169,39 @@ void renderer_opengl_retained::render(ldraw::model *m, const ldraw::filter *filt
     if (m_shader)
       shader->glEnableVertexAttribArray(m_vs_color_location_verttype);
     
-    render_recursive(m, filter, 0);
+    m_culling_stats.drawn = 0;
+    m_culling_stats.culled = 0;
+    m_culling_stats.simplified = 0;
+    
+    if (m_params->get_frustum_culling() || m_params->get_level_of_detail()) {
+      GLfloat projection[16], modelview[16];
+      GLint viewport[4];
+      
+      glGetFloatv(GL_PROJECTION_MATRIX, projection);
+      glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+      glGetIntegerv(GL_VIEWPORT, viewport);
+      
+      m_clip = clip_transform(projection, modelview);
+      
+      // a unit along x or y of the model, at the worst orientation
+      float sx = ldraw::vector(m_clip.value(0, 0), m_clip.value(0, 1), m_clip.value(0, 2)).length() * viewport[2];
+      float sy = ldraw::vector(m_clip.value(1, 0), m_clip.value(1, 1), m_clip.value(1, 2)).length() * viewport[3];
+      m_lod_scale = std::max(sx, sy) * 0.5f;
+    }
+    
+    if (m_params->get_frustum_culling()) {
+      ldraw::frustum frustum(m_clip);
+      render_recursive(m, filter, 0, ldraw::matrix(), &frustum);
+    } else {
+      render_recursive(m, filter, 0, ldraw::matrix(), 0L);
+    }
     
     if (m_shader)
       shader->glDisableVertexAttribArray(m_vs_color_location_verttype);
-    if (m_vbo)
+    if (m_vbo) {
       vbo->glBindBuffer(GL_ARRAY_BUFFER_ARB, 0);
+      vbo->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER_ARB, 0);
+    }
     glDisableClientState(GL_COLOR_ARRAY);
   }
   
@@ -237,194 +293,6 @@ void renderer_opengl_retained::render_bounding_boxes(ldraw::model *m,
   }
 }
 
-bool renderer_opengl_retained::hit_test(float *projection_matrix,
-                                        float *modelview_matrix,
-                                        int x, int y,
-                                        int w, int h,
-                                        ldraw::model *m,
-                                        const ldraw::filter *skip_filter)
-{
-  GLint viewport[4];
-  GLuint selectionBuffer[4];
-  
-  if (m_vbo)
-    opengl_extension_vbo::self()->glBindBuffer(GL_ARRAY_BUFFER_ARB, 0);
-  
-  if (w == 0)
-    w = 1;
-  else if (w < 0)
-    x += w, w = -w;
-  
-  if (h == 0)
-    h = 1;
-  else if (h < 0)
-    y += h, h = -h;
-  
-  glSelectBuffer(4, selectionBuffer);
-  glRenderMode(GL_SELECT);
-  
-  glGetIntegerv(GL_VIEWPORT, viewport);
-  
-  glMatrixMode(GL_PROJECTION);
-  glLoadIdentity();
-  gluPickMatrix(x + w/2, viewport[3] - (y + h/2), w, h, viewport);
-  glMultMatrixf(projection_matrix);
-  
-  glMatrixMode(GL_MODELVIEW);
-  glLoadMatrixf(modelview_matrix);
-  glInitNames();
-  glPushName(0);
-  
-  glPointSize(7.0f);
-  
-  int i = 0;
-  for (ldraw::model::const_iterator it = m->elements().begin(); it != m->elements().end(); ++it) {
-    ldraw::type elemtype = (*it)->get_type();
-    
-    if (skip_filter->query(m, i, 0)) {
-      if (elemtype == ldraw::type_ref) {
-        ldraw::element_ref *l = CAST_AS_REF(*it);
-	
-        if (!l->get_model())
-          continue;
-	
-        if (!l->get_model()->custom_data<ldraw::metrics>())
-          l->get_model()->update_custom_data<ldraw::metrics>();
-	
-        glPushMatrix();
-        glMultMatrixf(l->get_matrix().transpose().get_pointer());
-	
-        render_bounding_box_filled(*l->get_model()->custom_data<ldraw::metrics>());
-	
-        glPopMatrix();
-      }
-    }
-    
-    ++i;
-  }
-
-  glPopName();
-  
-  if (m_vbo)
-    opengl_extension_vbo::self()->glBindBuffer(GL_ARRAY_BUFFER_ARB, 0);
-  if (i == 0)
-    return false;
-  
-  if (glRenderMode(GL_RENDER))
-    return true;
-  else
-    return false;
-}
-
-selection_list renderer_opengl_retained::select(float *projection_matrix,
-                                                float *modelview_matrix,
-                                                int x, int y,
-                                                int w, int h,
-                                                ldraw::model *m,
-                                                const ldraw::filter *skip_filter)
-{
-  GLint hits, viewport[4];
-  GLuint selectionBuffer[1024 * 4];
-  
-  if (m_vbo)
-    opengl_extension_vbo::self()->glBindBuffer(GL_ARRAY_BUFFER_ARB, 0);
-  if (w == 0)
-    w = 1;
-  else if (w < 0)
-    x += w, w = -w;
-  
-  if (h == 0)
-    h = 1;
-  else if (h < 0)
-    y += h, h = -h;
-  
-  glSelectBuffer(1024, selectionBuffer);
-  glRenderMode(GL_SELECT);
-  
-  glGetIntegerv(GL_VIEWPORT, viewport);
-  
-  glMatrixMode(GL_PROJECTION);
-  glLoadIdentity();
-  gluPickMatrix(x + w/2, viewport[3] - (y + h/2), w, h, viewport);
-  glMultMatrixf(projection_matrix);
-  
-  glMatrixMode(GL_MODELVIEW);
-  glLoadMatrixf(modelview_matrix);
-  glInitNames();
-  glPushName(0);
-  
-  glPointSize(7.0f);
-  
-  if (m_selection == selection_model_full) {
-    glPushAttrib(GL_ENABLE_BIT);
-    glEnable(GL_DEPTH_TEST);
-  }
-  
-  // Iterate!
-  int i = 0;
-  for (ldraw::model::const_iterator it = m->elements().begin(); it != m->elements().end(); ++it) {
-    if (skip_filter && skip_filter->query(m, i, 0)) {
-      ++i;
-      continue;
-    }
-    
-    ldraw::type elemtype = (*it)->get_type();
-    
-    if (elemtype == ldraw::type_ref) {
-      ldraw::element_ref *l = CAST_AS_REF(*it);
-      
-      if (!l->get_model()) {
-        ++i;
-        continue;
-      }
-      
-      ldraw::model *rm = l->get_model();
-      
-      if (!rm->custom_data<ldraw::metrics>())
-        rm->init_custom_data<ldraw::metrics>();
-      
-      glLoadName(i);
-      
-      const ldraw::metrics *rmm = rm->custom_data<ldraw::metrics>();
-      const ldraw::matrix &rmt = l->get_matrix();
-      
-      if (m_selection == selection_points) {
-        ldraw::vector center = (rmt * rmm->min_() + rmt * rmm->max_()) * 0.5f;
-	
-        glBegin(GL_POINTS);
-        glVertex3fv(center.get_pointer());
-        glEnd();
-      } else {
-        glPushMatrix();
-        glMultMatrixf(l->get_matrix().transpose().get_pointer());
-        
-        if (m_selection == selection_model_full)
-          render_bounding_box_filled(*rmm);
-        else
-          render(rm, 0L);
-
-        glPopMatrix();
-      }
-    }
-    
-    ++i;
-  }
-
-  glPopName();
-  
-  hits = glRenderMode(GL_RENDER);
-  
-  if (m_selection == selection_model_full) {
-    glPopAttrib();
-  }
-  
-  std::list<std::pair<int, GLuint> > result;
-  for (int i = 0; i < hits; ++i)
-    result.push_back(std::pair<int, GLuint>(selectionBuffer[i * 4 + 3], selectionBuffer[i * 4 + 1]));
-  
-  return result;
-}
-
 #if 0
 void printInfo(GLenum e)
 {
@@ -496,24 +364,13 @@ void renderer_opengl_retained::init_vbuffer()
   }
 }
 
-void renderer_opengl_retained::render_recursive(ldraw::model *m, const ldraw::filter *filter, int depth)
+void renderer_opengl_retained::render_recursive(ldraw::model *m, const ldraw::filter *filter, int depth, const ldraw::matrix &transform, const ldraw::frustum *frustum)
 {
   if (!m)
     return;
   
   bool edgesonly = m_params->get_rendering_mode() == parameters::model_edges;
-  
-  bool collapse = false;
-  parameters::vbuffer_criteria vc = m_params->get_vbuffer_criteria();
-
-  if (vc == parameters::vbuffer_everything && depth == 0)
-    collapse = true;
-  else if (vc == parameters::vbuffer_submodels && m->modeltype() <= ldraw::model::submodel)
-    collapse = true;
-  else if (vc == parameters::vbuffer_parts && m->modeltype() <= ldraw::model::part)
-    collapse = true;
-  else
-    collapse = false;
+  bool collapse = is_collapsed(m, depth);
   
   vbuffer_extension *ve = m->custom_data<vbuffer_extension>();
   if (!ve) {
@@ -569,7 +426,7 @@ void renderer_opengl_retained::render_recursive(ldraw::model *m, const ldraw::fi
       else
         color = ve->get_precolored_array(vbuffer_extension::type_lines, m_colorstack.top());
       glColorPointer(4, GL_FLOAT, 0, color);
-      glDrawArrays(GL_LINES, 0, ve->count(vbuffer_extension::type_lines));
+      draw_buffer(ve, vbuffer_extension::type_lines, GL_LINES, m_vbo);
     }
     
     /* conditional lines */
@@ -614,7 +471,7 @@ void renderer_opengl_retained::render_recursive(ldraw::model *m, const ldraw::fi
         else
           color = ve->get_precolored_array(vbuffer_extension::type_triangles, m_colorstack.top());
         glColorPointer(4, GL_FLOAT, 0, color);
-        glDrawArrays(GL_TRIANGLES, 0, ve->count(vbuffer_extension::type_triangles));
+        draw_buffer(ve, vbuffer_extension::type_triangles, GL_TRIANGLES, m_vbo);
       }
       
       /* quads */
@@ -639,7 +496,7 @@ void renderer_opengl_retained::render_recursive(ldraw::model *m, const ldraw::fi
         else
           color = ve->get_precolored_array(vbuffer_extension::type_quads, m_colorstack.top());
         glColorPointer(4, GL_FLOAT, 0, color);
-        glDrawArrays(GL_QUADS, 0, ve->count(vbuffer_extension::type_quads));
+        draw_buffer(ve, vbuffer_extension::type_quads, GL_QUADS, m_vbo);
       }
       
       if (m_shader)
@@ -657,11 +514,52 @@ void renderer_opengl_retained::render_recursive(ldraw::model *m, const ldraw::fi
         ldraw::element_ref *r = CAST_AS_REF(*it);
         
         if (!filter || (filter && !filter->query(m, i, depth))) {
+          ldraw::model *rm = r->get_model();
+          ldraw::matrix placed = transform * r->get_matrix();
+          const ldraw::frustum *subfrustum = frustum;
+          
+          // studs are measured as a line and cannot be judged by their box;
+          // the editor only measures the submodel it changed, so those above
+          // it are measured again here when needed
+          const ldraw::metrics *mt = frustum && rm && !ldraw::utils::is_stud(r) ? ldraw::metrics::current(rm) : 0L;
+          if (mt) {
+            ldraw::frustum::containment c = frustum->test(mt->oriented(placed));
+            
+            if (c == ldraw::frustum::outside) {
+              ++m_culling_stats.culled;
+              ++i;
+              continue;
+            } else if (c == ldraw::frustum::inside) {
+              subfrustum = 0L;
+            }
+          }
+          
+          ++m_culling_stats.drawn;
           m_colorstack.push(r->get_color());
           
+          // a part drawn whole may as well be drawn coarser when small
+          ldraw::model *dm = rm;
+          if (rm && m_params->get_level_of_detail() && is_collapsed(rm, depth + 1) && !ldraw::utils::is_stud(r)) {
+            int level = detail_level(rm, placed);
+            
+            if (level > 0) {
+              lod_extension *lod = rm->custom_data<lod_extension>();
+              
+              if (!lod) {
+                lod = rm->init_custom_data<lod_extension>(const_cast<parameters *>(m_params));
+                lod->update();
+              } else if (lod->is_update_required()) {
+                lod->update();
+              }
+              
+              dm = lod->level(level);
+              ++m_culling_stats.simplified;
+            }
+          }
+          
           glPushMatrix();
           glMultMatrixf(r->get_matrix().transpose().get_pointer());
-          render_recursive(r->get_model(), filter, depth + 1);
+          render_recursive(dm, filter, depth + 1, placed, subfrustum);
           glPopMatrix();
           
           m_colorstack.pop();
@@ -672,4 +570,37 @@ void renderer_opengl_retained::render_recursive(ldraw::model *m, const ldraw::fi
   }
 }
 
+bool renderer_opengl_retained::is_collapsed(const ldraw::model *m, int depth) const
+{
+  parameters::vbuffer_criteria vc = m_params->get_vbuffer_criteria();
+  
+  if (vc == parameters::vbuffer_everything && depth == 0)
+    return true;
+  else if (vc == parameters::vbuffer_submodels && m->modeltype() <= ldraw::model::submodel)
+    return true;
+  else if (vc == parameters::vbuffer_parts && m->modeltype() <= ldraw::model::part)
+    return true;
+  else
+    return false;
+}
+
+// Radius of the bounding sphere on screen, from the w of its center; models
+// reaching to or behind the eye are always drawn in full.
+int renderer_opengl_retained::detail_level(ldraw::model *m, const ldraw::matrix &transform) const
+{
+  ldraw::oriented_box box = ldraw::metrics::current(m)->oriented(transform);
+  
+  float radius = std::sqrt(ldraw::vector::dot_product(box.axes[0], box.axes[0]) +
+                           ldraw::vector::dot_product(box.axes[1], box.axes[1]) +
+                           ldraw::vector::dot_product(box.axes[2], box.axes[2]));
+  
+  float w = m_clip.value(3, 0) * box.center.x() + m_clip.value(3, 1) * box.center.y() + m_clip.value(3, 2) * box.center.z() + m_clip.value(3, 3);
+  float wspan = ldraw::vector(m_clip.value(3, 0), m_clip.value(3, 1), m_clip.value(3, 2)).length() * radius;
+  
+  if (w - wspan <= 0.0f)
+    return 0;
+  
+  return lod_extension::select(radius * m_lod_scale / w, m_params->get_lod_threshold());
+}
+
 }
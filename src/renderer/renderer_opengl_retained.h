@@ -9,11 +9,25 @@
 
 #include <renderer/renderer_opengl.h>
 
+namespace ldraw
+{
+  class frustum;
+}
+
 namespace ldraw_renderer
 {
 
 class parameters;
 
+// References looked at by the last render(); a culled one takes everything
+// below it along. Simplified ones are among those drawn.
+struct culling_statistics
+{
+  int drawn;
+  int culled;
+  int simplified;
+};
+
 /* OpenGL retained rendering path */
 
 class LIBLDRAWRENDERER_EXPORT renderer_opengl_retained : public renderer_opengl
@@ -27,8 +41,7 @@ class LIBLDRAWRENDERER_EXPORT renderer_opengl_retained : public renderer_opengl
   
   void render_bounding_boxes(ldraw::model *m, const ldraw::filter *filter);
   
-  bool hit_test(float *projection_matrix, float *modelview_matrix, int x, int y, int w, int h, ldraw::model *m, const ldraw::filter *filter);
-  selection_list select(float *projection_matrix, float *modelview_matrix, int x, int y, int w, int h, ldraw::model *m, const ldraw::filter *filter);
+  const culling_statistics* get_culling_stats() const { return &m_culling_stats; }
   
  private:
   friend class renderer_opengl_factory;
@@ -38,7 +51,14 @@ class LIBLDRAWRENDERER_EXPORT renderer_opengl_retained : public renderer_opengl
   void init_shader();
   void init_vbuffer();
   
-  void render_recursive(ldraw::model *m, const ldraw::filter *filter, int depth = 0);
+  // transform places m in the rendered model; frustum is 0 if all of m is
+  // known to be in view
+  void render_recursive(ldraw::model *m, const ldraw::filter *filter, int depth, const ldraw::matrix &transform, const ldraw::frustum *frustum);
+  
+  // whether m is drawn from a single vertex buffer, references and all
+  bool is_collapsed(const ldraw::model *m, int depth) const;
+  // lod_extension level for m placed by transform in the rendered model
+  int detail_level(ldraw::model *m, const ldraw::matrix &transform) const;
   
   static const float m_bbox_lines[];
   static const float m_bbox_filled[];
@@ -48,6 +68,12 @@ class LIBLDRAWRENDERER_EXPORT renderer_opengl_retained : public renderer_opengl
   bool m_vbo;
   bool m_shader;
   
+  culling_statistics m_culling_stats;
+  
+  /* Level of detail, set up by render() */
+  ldraw::matrix m_clip;
+  float m_lod_scale; // pixels per unit at w = 1
+  
   /* VBO */
   GLuint m_vbo_bbox_lines;
   GLuint m_vbo_bbox_filled;
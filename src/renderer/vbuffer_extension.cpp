@@ -4,6 +4,9 @@
  *                                                                                   *
  * Author: (c)2006-2010 Park "segfault" J. K. <mastermind_at_planetmono_dot_org>     */
 
+#include <cstring>
+#include <stdint.h>
+
 #include <libldr/elements.h>
 #include <libldr/model.h>
 #include <libldr/utils.h>
@@ -19,6 +22,22 @@
 namespace ldraw_renderer
 {
 
+namespace
+{
+
+// FNV-1a over the bits of count floats
+inline uint32_t hash_floats(const float *f, int count, uint32_t h)
+{
+	const unsigned char *p = reinterpret_cast<const unsigned char *>(f);
+
+	for (int i = 0; i < count * (int)sizeof(float); ++i)
+		h = (h ^ p[i]) * 16777619u;
+
+	return h;
+}
+
+}
+
 vbuffer_extension::vbuffer_extension(ldraw::model *m, void *arg)
 	: ldraw::extension(m, arg)
 {
@@ -46,11 +65,19 @@ vbuffer_extension::vbuffer_extension(ldraw::model *m, void *arg)
 		m_normals[i] = 0L;
 	}
 
+	for (int i = 0; i < 3; ++i) {
+		m_vbo_indices[i] = 0;
+		m_indexcnt[i] = 0;
+		m_indices[i] = 0L;
+	}
+
 	m_vbo_condparams = 0;
 	m_condparams = 0L;
 	m_condparamptr = 0;
 
 	m_colorfixed = false;
+	m_indexed = false;
+	m_indexsize = 0;
 }
 
 vbuffer_extension::~vbuffer_extension()
@@ -76,34 +103,54 @@ void vbuffer_extension::clear()
 	if (!m_isnull) {
 		if (m_vertices[0] != 0L) {
 			for (int i = 0; i < 4; ++i) {
-				delete m_vertices[i];
-				delete m_colors[i];
+				delete[] m_vertices[i];
+				delete[] m_colors[i];
 			}
 			
 			for (int i = 0; i < 2; ++i)
-				delete m_normals[i];
+				delete[] m_normals[i];
 
-			delete m_condparams;
+			delete[] m_condparams;
 		}
 		
+		for (int i = 0; i < 3; ++i) {
+			delete[] m_indices[i];
+			m_indices[i] = 0L;
+		}
+
 		opengl_extension_vbo *vboext = opengl_extension_vbo::self();
 		if (!m_params->force_vbuffer && vboext->is_supported()) {
 			vboext->glDeleteBuffers(4, m_vbo_vertices);
 			vboext->glDeleteBuffers(2, m_vbo_normals);
 			vboext->glDeleteBuffers(4, m_vbo_colors);
 			vboext->glDeleteBuffers(1, &m_vbo_condparams);
+
+			if (m_vbo_indices[0]) {
+				vboext->glDeleteBuffers(3, m_vbo_indices);
+
+				for (int i = 0; i < 3; ++i)
+					m_vbo_indices[i] = 0;
+			}
 		}
 
 		for (int i = 0; i < 4; ++i)
 			m_elemcnt[i] = 0;
 
+		for (int i = 0; i < 3; ++i)
+			m_indexcnt[i] = 0;
+
 		for (std::map<ldraw::color, float **>::iterator it = m_precolored_buf.begin(); it != m_precolored_buf.end(); ++it) {
 			for (int i = 0; i < 4; ++i)
-				delete (*it).second[i];
+				delete[] (*it).second[i];
+			delete[] (*it).second;
 		}
+		m_precolored_buf.clear();
 
-		for (std::map<ldraw::color, GLuint *>::iterator it = m_vbo_precolored.begin(); it != m_vbo_precolored.end(); ++it)
+		for (std::map<ldraw::color, GLuint *>::iterator it = m_vbo_precolored.begin(); it != m_vbo_precolored.end(); ++it) {
 			vboext->glDeleteBuffers(4, (*it).second);
+			delete[] (*it).second;
+		}
+		m_vbo_precolored.clear();
 		
 		m_colorfixed = false;
 		
@@ -126,31 +173,41 @@ void vbuffer_extension::update()
 	count_elements();
 
 	m_stud = m_params->params->get_stud_rendering_mode();
+	m_indexed = m_params->params->get_vbuffer_indexed();
 
 	if (m_elemcnt[0] + m_elemcnt[1] + m_elemcnt[2] + m_elemcnt[3] == 0)
 		return;
 
 	m_isnull = false;
 
+	for (int i = 0; i < 4; ++i) {
+		m_vertices[i] = new float[3 * m_elemcnt[i]];
+		m_colors[i] = new float[4 * m_elemcnt[i]];
+	}
+
+	m_normals[0] = new float[3 * m_elemcnt[1]];
+	m_normals[1] = new float[3 * m_elemcnt[2]];
+
+	m_condparams = new float[3 * m_elemcnt[3]];
+
+	fill_elements();
+
+	// shrinks m_elemcnt to the distinct vertices
+	if (m_indexed)
+		weld();
+
 	for (int i = 0; i < 4; ++i) {
 		nbytes[i] = 3 * m_elemcnt[i];
 		ncolorbytes[i] = 4 * m_elemcnt[i];
 
-		m_vertices[i] = new float[nbytes[i]];
-		m_colors[i] = new float[ncolorbytes[i]];
-
 		s_memory_usage += nbytes[i] * sizeof(float);
 		s_memory_usage += ncolorbytes[i] * sizeof(float);
 	}
 
-	m_normals[0] = new float[nbytes[1]];
-	m_normals[1] = new float[nbytes[2]];
-
-	m_condparams = new float[nbytes[3]];
-
 	s_memory_usage += nbytes[1] * sizeof(float) + nbytes[2] * sizeof(float) + nbytes[3] * sizeof(float);
 
-	fill_elements();
+	for (int i = 0; i < 3; ++i)
+		s_memory_usage += m_indexcnt[i] * m_indexsize;
 
 	opengl_extension_vbo *vbo = opengl_extension_vbo::self();
 	if (!m_params->force_vbuffer && vbo->is_supported()) {
@@ -171,11 +228,11 @@ void vbuffer_extension::update()
 				vbo->glBufferData(GL_ARRAY_BUFFER_ARB, ncolorbytes[i] * sizeof(float), m_colors[i], GL_STATIC_DRAW_ARB);
 			}
 			
-			delete m_vertices[i];
+			delete[] m_vertices[i];
 			m_vertices[i] = 0L;
 
 			if (is_shader && m_colorfixed) {
-				delete m_colors[i];
+				delete[] m_colors[i];
 				m_colors[i] = 0L;
 			}
 		}
@@ -184,15 +241,29 @@ void vbuffer_extension::update()
 			vbo->glBindBuffer(GL_ARRAY_BUFFER_ARB, m_vbo_normals[i]);
 			vbo->glBufferData(GL_ARRAY_BUFFER_ARB, nbytes[i + 1] * sizeof(float), m_normals[i], GL_STATIC_DRAW_ARB);
 			
-			delete m_normals[i];
+			delete[] m_normals[i];
 			m_normals[i] = 0L;
 		}
 
 		vbo->glBindBuffer(GL_ARRAY_BUFFER_ARB, m_vbo_condparams);
 		vbo->glBufferData(GL_ARRAY_BUFFER_ARB, nbytes[3] * sizeof(float), m_condparams, GL_STATIC_DRAW_ARB);
 
-		delete m_condparams;
+		delete[] m_condparams;
 		m_condparams = 0L;
+
+		if (m_indexed) {
+			vbo->glGenBuffers(3, m_vbo_indices);
+
+			for (int i = 0; i < 3; ++i) {
+				vbo->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER_ARB, m_vbo_indices[i]);
+				vbo->glBufferData(GL_ELEMENT_ARRAY_BUFFER_ARB, m_indexcnt[i] * m_indexsize, m_indices[i], GL_STATIC_DRAW_ARB);
+
+				delete[] m_indices[i];
+				m_indices[i] = 0L;
+			}
+
+			vbo->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER_ARB, 0);
+		}
 	} else {
 		m_isvbo = false;
 	}
@@ -217,14 +288,23 @@ bool vbuffer_extension::is_null() const
 
 bool vbuffer_extension::is_update_required(bool collapse) const
 {
-	if (m_params->collapse_subfiles != collapse || m_stud != m_params->params->get_stud_rendering_mode())
+	if (m_params->collapse_subfiles != collapse || m_stud != m_params->params->get_stud_rendering_mode() ||
+	    m_indexed != m_params->params->get_vbuffer_indexed())
 		return true;
 	else
 		return false;
 }
 
+bool vbuffer_extension::is_indexed(buffer_type type) const
+{
+	return m_indexed && type != type_condlines;
+}
+
 int vbuffer_extension::count(buffer_type type) const
 {
+	if (is_indexed(type))
+		return m_indexcnt[type];
+
 	return m_elemcnt[type];
 }
 
@@ -279,6 +359,14 @@ GLuint vbuffer_extension::get_vbo_precolored(buffer_type type, const ldraw::colo
 	return m_vbo_precolored[c][type];
 }
 
+GLuint vbuffer_extension::get_vbo_indices(buffer_type type) const
+{
+	if (!m_isvbo || m_isnull || !is_indexed(type))
+		return 0;
+
+	return m_vbo_indices[type];
+}
+
 const float* vbuffer_extension::get_vertex_array(buffer_type type) const
 {
 	if (m_isvbo || m_isnull)
@@ -330,6 +418,19 @@ const float* vbuffer_extension::get_precolored_array(buffer_type type, const ldr
 	return m_precolored_buf[c][type];
 }
 
+const void* vbuffer_extension::get_index_array(buffer_type type) const
+{
+	if (m_isvbo || m_isnull || !is_indexed(type))
+		return 0L;
+
+	return m_indices[type];
+}
+
+GLenum vbuffer_extension::get_index_type() const
+{
+	return m_indexsize == sizeof(GLushort) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
+
 bool vbuffer_extension::is_color_ambiguous() const
 {
 	return is_color_ambiguous_recursive(m_model);
@@ -337,47 +438,22 @@ bool vbuffer_extension::is_color_ambiguous() const
 
 bool vbuffer_extension::is_color_ambiguous_recursive(const ldraw::model *m) const
 {
-	bool found;
-	
-	for (ldraw::model::const_iterator it = m->elements().begin(); it != m->elements().end(); ++it) {
-		ldraw::type t = (*it)->get_type();
-		ldraw::color c;
+	const ldraw::geometry_store &g = m->geometry();
 
-		found = false;
+	for (int p = 0; p < ldraw::geometry_store::primitive_count; ++p) {
+		const std::vector<unsigned int> &colors = g.get((ldraw::geometry_store::primitive)p).colors;
 
-		switch (t) {
-			case ldraw::type_line:
-				c = CAST_AS_CONST_LINE(*it)->get_color();
-				found = true;
-				break;
-			case ldraw::type_triangle:
-				c = CAST_AS_CONST_TRIANGLE(*it)->get_color();
-				found = true;
-				break;
-			case ldraw::type_quadrilateral:
-				c = CAST_AS_CONST_QUADRILATERAL(*it)->get_color();
-				found = true;
-				break;
-			case ldraw::type_condline:
-				c = CAST_AS_CONST_CONDLINE(*it)->get_color();
-				found = true;
-				break;
-			case ldraw::type_ref:
-				if (m_params->collapse_subfiles) {
-					const ldraw::model *mm = CAST_AS_CONST_REF(*it)->get_model();
-
-					if (mm) {
-						if (is_color_ambiguous_recursive(mm))
-							return true;
-					}
-				}
-				break;
-			default:
-				break;
+		for (std::vector<unsigned int>::const_iterator it = colors.begin(); it != colors.end(); ++it) {
+			if (*it == 16 || *it == 24)
+				return true;
 		}
+	}
 
-		if (found) {
-			if (c.get_id() == 16 || c.get_id() == 24)
+	if (m_params->collapse_subfiles) {
+		for (std::vector<int>::const_iterator it = g.refs().begin(); it != g.refs().end(); ++it) {
+			const ldraw::model *mm = CAST_AS_CONST_REF(m->elements()[*it])->get_model();
+
+			if (mm && is_color_ambiguous_recursive(mm))
 				return true;
 		}
 	}
@@ -433,15 +509,15 @@ void vbuffer_extension::fork_color(const ldraw::color &c)
 			if (colors[i]) {
 				vbo->glBindBuffer(GL_ARRAY_BUFFER_ARB, vbobuf[i]);
 				vbo->glBufferData(GL_ARRAY_BUFFER_ARB, 4 * m_elemcnt[i] * sizeof(float), colors[i], GL_STATIC_DRAW_ARB);
-				delete colors[i];
+				delete[] colors[i];
 			}
 		}
-		delete colors;
+		delete[] colors;
 
 		if (m_vbo_precolored.find(c) != m_vbo_precolored.end()) {
 			GLuint *b = m_vbo_precolored[c];
 			vbo->glDeleteBuffers(4, b);
-			delete b;
+			delete[] b;
 		}
 		m_vbo_precolored[c] = vbobuf;
 	} else {
@@ -449,8 +525,8 @@ void vbuffer_extension::fork_color(const ldraw::color &c)
 			float **b = m_precolored_buf[c];
 
 			for (int i = 0; i < 4; ++i)
-				delete b[i];
-			delete b;
+				delete[] b[i];
+			delete[] b;
 		}
 		m_precolored_buf[c] = colors;
 	}
@@ -468,28 +544,27 @@ void vbuffer_extension::count_elements_stud(const ldraw::model *m)
 
 void vbuffer_extension::count_elements_recursive(const ldraw::model *m)
 {
-	for (ldraw::model::const_iterator it = m->elements().begin(); it != m->elements().end(); ++it) {
-		ldraw::type t = (*it)->get_type();
-		
-		if (t == ldraw::type_line) {
-			m_elemcnt[0] += 2;
-		} else if (t == ldraw::type_triangle) {
-			m_elemcnt[1] += 3;
-		} else if (t == ldraw::type_quadrilateral) {
-			m_elemcnt[2] += 4;
-		} else if (t == ldraw::type_condline) {
-			m_elemcnt[3] += 2;
-		} else if (t == ldraw::type_ref && m_params->collapse_subfiles) {
-			const ldraw::model *mm = CAST_AS_CONST_REF(*it)->get_model();
-
-			if (!mm)
-				continue;
-
-			if (ldraw::utils::is_stud(mm))
-				count_elements_stud(mm);
-			else
-				count_elements_recursive(mm);
-		}
+	const ldraw::geometry_store &g = m->geometry();
+
+	// condlines only contribute their first two vertices
+	m_elemcnt[0] += 2 * g.get(ldraw::geometry_store::lines).size();
+	m_elemcnt[1] += 3 * g.get(ldraw::geometry_store::triangles).size();
+	m_elemcnt[2] += 4 * g.get(ldraw::geometry_store::quads).size();
+	m_elemcnt[3] += 2 * g.get(ldraw::geometry_store::condlines).size();
+
+	if (!m_params->collapse_subfiles)
+		return;
+
+	for (std::vector<int>::const_iterator it = g.refs().begin(); it != g.refs().end(); ++it) {
+		const ldraw::model *mm = CAST_AS_CONST_REF(m->elements()[*it])->get_model();
+
+		if (!mm)
+			continue;
+
+		if (ldraw::utils::is_stud(mm))
+			count_elements_stud(mm);
+		else
+			count_elements_recursive(mm);
 	}
 }
 
@@ -576,78 +651,68 @@ void vbuffer_extension::fill_elements_recursive(std::stack<ldraw::color> &colors
 	transform_wo_position.set_translation_vector(ldraw::vector());
 
 	const std::map<int, ldraw::vector> &norms = m->custom_data<normal_extension>()->normals();
-	
-	int i = 0;
-	
-	for (ldraw::model::const_iterator it = m->elements().begin(); it != m->elements().end(); ++it) {
-		ldraw::type t = (*it)->get_type();
-		
-		if (t == ldraw::type_line) {
-			const ldraw::element_line *l = CAST_AS_CONST_LINE(*it);
+	const ldraw::geometry_store &g = m->geometry();
+
+	// buffer, vertices emitted per primitive, normal buffer (-1 for none)
+	static const struct { buffer_type type; int vertices; int normals; } layout[] = {
+		{ type_lines, 2, -1 },
+		{ type_triangles, 3, 0 },
+		{ type_quads, 4, 1 },
+		{ type_condlines, 2, -1 }
+	};
+
+	// colors mostly come in runs; avoid a table lookup per primitive
+	std::map<unsigned int, ldraw::color> palette;
+	const ldraw::color *c = 0L;
+	unsigned int lastid = 0;
+
+	for (int p = 0; p < ldraw::geometry_store::primitive_count; ++p) {
+		const ldraw::geometry_store::stream &s = g.get((ldraw::geometry_store::primitive)p);
+		int b = layout[p].type;
+
+		for (int i = 0; i < s.size(); ++i) {
+			for (int v = 0; v < layout[p].vertices; ++v)
+				fill_element_atomic(transform * s.vertex(i, v), m_vertices[b], &m_vertptr[b]);
+
+			if (layout[p].normals >= 0) {
+				int nb = layout[p].normals;
+				ldraw::vector n = transform_wo_position * (*norms.find(s.indices[i])).second;
+
+				for (int v = 0; v < layout[p].vertices; ++v)
+					fill_element_atomic(n, m_normals[nb], &m_normptr[nb]);
+			}
 
-			fill_element_atomic(transform * l->pos1(), m_vertices[0], &m_vertptr[0]);
-			fill_element_atomic(transform * l->pos2(), m_vertices[0], &m_vertptr[0]);
+			if (!c || s.colors[i] != lastid) {
+				lastid = s.colors[i];
+				c = &(*palette.insert(std::make_pair(lastid, ldraw::color(lastid))).first).second;
+			}
 
-			fill_color(colorstack, l->get_color(), 2, type_lines);
-		} else if (t == ldraw::type_triangle) {
-			const ldraw::element_triangle *l = CAST_AS_CONST_TRIANGLE(*it);
+			fill_color(colorstack, *c, layout[p].vertices, layout[p].type);
+		}
+	}
 
-			fill_element_atomic(transform * l->pos1(), m_vertices[1], &m_vertptr[1]);
-			fill_element_atomic(transform * l->pos2(), m_vertices[1], &m_vertptr[1]);
-			fill_element_atomic(transform * l->pos3(), m_vertices[1], &m_vertptr[1]);
+	if (!m_params->collapse_subfiles)
+		return;
 
-			ldraw::vector n = transform_wo_position * (*norms.find(i)).second;
-			
-			fill_element_atomic(n, m_normals[0], &m_normptr[0]);
-			fill_element_atomic(n, m_normals[0], &m_normptr[0]);
-			fill_element_atomic(n, m_normals[0], &m_normptr[0]);
-
-			fill_color(colorstack, l->get_color(), 3, type_triangles);
-		} else if (t == ldraw::type_quadrilateral) {
-			const ldraw::element_quadrilateral *l = CAST_AS_CONST_QUADRILATERAL(*it);
-
-			fill_element_atomic(transform * l->pos1(), m_vertices[2], &m_vertptr[2]);
-			fill_element_atomic(transform * l->pos2(), m_vertices[2], &m_vertptr[2]);
-			fill_element_atomic(transform * l->pos3(), m_vertices[2], &m_vertptr[2]);
-			fill_element_atomic(transform * l->pos4(), m_vertices[2], &m_vertptr[2]);
-			
-			ldraw::vector n = transform_wo_position * (*norms.find(i)).second;
-			
-			fill_element_atomic(n, m_normals[1], &m_normptr[1]);
-			fill_element_atomic(n, m_normals[1], &m_normptr[1]);
-			fill_element_atomic(n, m_normals[1], &m_normptr[1]);
-			fill_element_atomic(n, m_normals[1], &m_normptr[1]);
-
-			fill_color(colorstack, l->get_color(), 4, type_quads);
-		} else if (t == ldraw::type_condline) {
-			const ldraw::element_condline *l = CAST_AS_CONST_CONDLINE(*it);
-
-			fill_element_atomic(transform * l->pos1(), m_vertices[3], &m_vertptr[3]);
-			fill_element_atomic(transform * l->pos2(), m_vertices[3], &m_vertptr[3]);
-
-			fill_color(colorstack, l->get_color(), 2, type_condlines);			
-		} else if (t == ldraw::type_ref && m_params->collapse_subfiles) {
-			ldraw::element_ref *l = CAST_AS_REF(*it);
-			ldraw::model *m = l->get_model();
-
-			if (m) {
-				const ldraw::color &c = l->get_color();
-				
-				if (c.get_id() == 16 || c.get_id() == 24)
-					colorstack.push(colorstack.top());
-				else
-					colorstack.push(c);
-				
-				if (ldraw::utils::is_stud(m))
-					fill_elements_stud(colorstack, m, transform * l->get_matrix());
-				else
-					fill_elements_recursive(colorstack, m, transform * l->get_matrix());
-				
-				colorstack.pop();
-			}
-		}
+	for (std::vector<int>::const_iterator it = g.refs().begin(); it != g.refs().end(); ++it) {
+		ldraw::element_ref *l = CAST_AS_REF(m->elements()[*it]);
+		ldraw::model *m = l->get_model();
+
+		if (m) {
+			const ldraw::color &c = l->get_color();
+
+			if (c.get_id() == 16 || c.get_id() == 24)
+				colorstack.push(colorstack.top());
+			else
+				colorstack.push(c);
+
+			if (ldraw::utils::is_stud(m))
+				fill_elements_stud(colorstack, m, transform * l->get_matrix());
+			else
+				fill_elements_recursive(colorstack, m, transform * l->get_matrix());
 
-		++i;
+			colorstack.pop();
+		}
 	}
 }
 
@@ -708,7 +773,116 @@ void vbuffer_extension::fill_elements()
 	fill_elements_recursive(colorstack, m_model, transform);
 }
 
+// Merges the vertices of a buffer that agree bit for bit in position, normal
+// and color into one, through an open-addressing hash table. The arrays are
+// replaced by the distinct vertices; indices gets the new vertex of every old
+// one, in the order they are drawn.
+void vbuffer_extension::weld(buffer_type type, std::vector<unsigned int> &indices)
+{
+	const int n = m_elemcnt[type];
+	float *normals = 0L;
+
+	if (type == type_triangles)
+		normals = m_normals[0];
+	else if (type == type_quads)
+		normals = m_normals[1];
 
+	int size = 1;
+	while (size < 2 * n)
+		size <<= 1;
+
+	std::vector<int> table(size, -1); // distinct vertex in each slot
+	std::vector<int> first;           // old vertex of each distinct one
+
+	indices.resize(n);
+
+	for (int i = 0; i < n; ++i) {
+		const float *v = &m_vertices[type][i * 3];
+		const float *c = &m_colors[type][i * 4];
+		uint32_t h = hash_floats(v, 3, 2166136261u);
+
+		if (normals)
+			h = hash_floats(&normals[i * 3], 3, h);
+		h = hash_floats(c, 4, h);
+
+		for (int slot = h & (size - 1); ; slot = (slot + 1) & (size - 1)) {
+			int k = table[slot];
+
+			if (k == -1) {
+				table[slot] = (int)first.size();
+				indices[i] = (unsigned int)first.size();
+				first.push_back(i);
+				break;
+			}
+
+			int j = first[k];
+			if (!std::memcmp(v, &m_vertices[type][j * 3], 3 * sizeof(float)) &&
+			    !std::memcmp(c, &m_colors[type][j * 4], 4 * sizeof(float)) &&
+			    (!normals || !std::memcmp(&normals[i * 3], &normals[j * 3], 3 * sizeof(float)))) {
+				indices[i] = k;
+				break;
+			}
+		}
+	}
+
+	const int m = (int)first.size();
+	float *vertices = new float[3 * m];
+	float *colors = new float[4 * m];
+	float *compact_normals = normals ? new float[3 * m] : 0L;
+
+	for (int k = 0; k < m; ++k) {
+		std::memcpy(&vertices[k * 3], &m_vertices[type][first[k] * 3], 3 * sizeof(float));
+		std::memcpy(&colors[k * 4], &m_colors[type][first[k] * 4], 4 * sizeof(float));
+
+		if (normals)
+			std::memcpy(&compact_normals[k * 3], &normals[first[k] * 3], 3 * sizeof(float));
+	}
+
+	delete[] m_vertices[type];
+	delete[] m_colors[type];
+	m_vertices[type] = vertices;
+	m_colors[type] = colors;
+
+	if (type == type_triangles) {
+		delete[] m_normals[0];
+		m_normals[0] = compact_normals;
+	} else if (type == type_quads) {
+		delete[] m_normals[1];
+		m_normals[1] = compact_normals;
+	}
+
+	m_indexcnt[type] = n;
+	m_elemcnt[type] = m;
 }
 
+// Condlines are left as they are: each carries the control points of its own
+// line, which would be lost by sharing vertices.
+void vbuffer_extension::weld()
+{
+	std::vector<unsigned int> indices[3];
+	int largest = 0;
+
+	for (int i = 0; i < 3; ++i) {
+		weld((buffer_type)i, indices[i]);
+
+		if (m_elemcnt[i] > largest)
+			largest = m_elemcnt[i];
+	}
+
+	m_indexsize = largest <= 65536 ? sizeof(GLushort) : sizeof(GLuint);
+
+	for (int i = 0; i < 3; ++i) {
+		m_indices[i] = new unsigned char[m_indexcnt[i] * m_indexsize];
+
+		if (m_indexsize == sizeof(GLushort)) {
+			GLushort *out = reinterpret_cast<GLushort *>(m_indices[i]);
+
+			for (int j = 0; j < m_indexcnt[i]; ++j)
+				out[j] = (GLushort)indices[i][j];
+		} else if (m_indexcnt[i] > 0) {
+			std::memcpy(m_indices[i], &indices[i][0], m_indexcnt[i] * sizeof(GLuint));
+		}
+	}
+}
 
+}
@@ -9,6 +9,7 @@
 
 #include <map>
 #include <stack>
+#include <vector>
 
 #include <libldr/color.h>
 #include <libldr/extension.h>
@@ -56,6 +57,11 @@ class LIBLDRAWRENDERER_EXPORT vbuffer_extension : public ldraw::extension
 	bool is_null() const;
 	bool is_update_required(bool collapse) const;
 
+	// Whether type is drawn with glDrawElements() from the index arrays
+	// below; condlines never are.
+	bool is_indexed(buffer_type type) const;
+
+	// vertices to draw, that is indices if indexed
 	int count(buffer_type type) const;
 
 	GLuint get_vbo_vertices(buffer_type type) const;
@@ -63,12 +69,16 @@ class LIBLDRAWRENDERER_EXPORT vbuffer_extension : public ldraw::extension
 	GLuint get_vbo_colors(buffer_type type) const;
 	GLuint get_vbo_condline_directions() const;
 	GLuint get_vbo_precolored(buffer_type type, const ldraw::color &c);
+	GLuint get_vbo_indices(buffer_type type) const;
 
 	const float* get_vertex_array(buffer_type type) const;
 	const float* get_normal_array(buffer_type type) const;
 	const float* get_color_array(buffer_type type) const;
 	const float* get_condline_direction_array() const;
 	const float* get_precolored_array(buffer_type type, const ldraw::color &c);
+	const void* get_index_array(buffer_type type) const;
+	// GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+	GLenum get_index_type() const;
 
   private:
 	bool is_color_ambiguous() const;
@@ -88,6 +98,9 @@ class LIBLDRAWRENDERER_EXPORT vbuffer_extension : public ldraw::extension
 	void fill_elements_stud(std::stack<ldraw::color> &colorstack, ldraw::model *m, const ldraw::matrix &transform);
 	void fill_elements();
 
+	void weld(buffer_type type, std::vector<unsigned int> &indices);
+	void weld();
+
   private:
 	static int s_memory_usage;
 	
@@ -96,19 +109,24 @@ class LIBLDRAWRENDERER_EXPORT vbuffer_extension : public ldraw::extension
 	bool m_isnull;
 	bool m_isvbo;
 	bool m_colorfixed;
+	bool m_indexed;
 	parameters::stud_rendering_mode m_stud;
 	
 	GLuint m_vbo_vertices[4];
 	GLuint m_vbo_normals[2];
 	GLuint m_vbo_colors[4];
 	GLuint m_vbo_condparams;
+	GLuint m_vbo_indices[3];
 	
 	int m_elemcnt[4];
+	int m_indexcnt[3];
+	int m_indexsize;
 	
 	float *m_vertices[4];
 	float *m_normals[2];
 	float *m_colors[4];
 	float *m_condparams;
+	unsigned char *m_indices[3];
 
 	int m_vertptr[4];
 	int m_normptr[2];
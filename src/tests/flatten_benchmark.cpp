@@ -0,0 +1,205 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include <libldr/color.h>
+#include <libldr/elements.h>
+#include <libldr/flat_geometry.h>
+#include <libldr/model.h>
+#include <libldr/part_library.h>
+#include <libldr/reader.h>
+
+/* Flattening benchmark: ldraw::flat_geometry on threads vs. a plain serial walk */
+
+// what flat_geometry should answer, kept per primitive
+struct reference_geometry
+{
+	std::vector<float> positions[ldraw::flat_geometry::primitive_count];
+	std::vector<unsigned char> colors[ldraw::flat_geometry::primitive_count];  // RGBA
+};
+
+static void push(std::vector<float> &out, const ldraw::vector &v)
+{
+	out.push_back(v.x());
+	out.push_back(v.y());
+	out.push_back(v.z());
+}
+
+// color a reference passes on to its contents
+static unsigned int inherit(unsigned int id, unsigned int current)
+{
+	return (id == 16 || id == 24) ? current : id;
+}
+
+static void push_color(std::vector<unsigned char> &out, unsigned int id, unsigned int current)
+{
+	const unsigned char *rgba;
+
+	if (id == 24)
+		rgba = ldraw::color(current).get_entity()->complement;
+	else
+		rgba = ldraw::color(inherit(id, current)).get_entity()->rgba;
+
+	out.insert(out.end(), rgba, rgba + 4);
+}
+
+// Walks m placed by transform as an exporter with a matrix stack of its
+// own would: every primitive of m in file order, grouped as flat_geometry
+// groups them, then every reference in file order.
+static void walk(const ldraw::model *m, const ldraw::matrix &transform, unsigned int current, reference_geometry &out)
+{
+	std::vector<float> quads;
+	std::vector<unsigned char> quadcolors;
+
+	for (int i = 0; i < m->size(); ++i) {
+		const ldraw::element_base *e = m->elements()[i];
+
+		if (e->get_type() == ldraw::type_line) {
+			const ldraw::element_line *l = CAST_AS_CONST_LINE(e);
+			push(out.positions[ldraw::flat_geometry::lines], transform * l->pos1());
+			push(out.positions[ldraw::flat_geometry::lines], transform * l->pos2());
+			push_color(out.colors[ldraw::flat_geometry::lines], l->get_color().get_id(), current);
+		} else if (e->get_type() == ldraw::type_triangle) {
+			const ldraw::element_triangle *t = CAST_AS_CONST_TRIANGLE(e);
+			push(out.positions[ldraw::flat_geometry::triangles], transform * t->pos1());
+			push(out.positions[ldraw::flat_geometry::triangles], transform * t->pos2());
+			push(out.positions[ldraw::flat_geometry::triangles], transform * t->pos3());
+			push_color(out.colors[ldraw::flat_geometry::triangles], t->get_color().get_id(), current);
+		} else if (e->get_type() == ldraw::type_quadrilateral) {
+			// (1, 2, 3) and (1, 3, 4), after the triangles
+			const ldraw::element_quadrilateral *q = CAST_AS_CONST_QUADRILATERAL(e);
+			ldraw::vector v[4] = { transform * q->pos1(), transform * q->pos2(), transform * q->pos3(), transform * q->pos4() };
+			push(quads, v[0]);
+			push(quads, v[1]);
+			push(quads, v[2]);
+			push(quads, v[0]);
+			push(quads, v[2]);
+			push(quads, v[3]);
+			push_color(quadcolors, q->get_color().get_id(), current);
+			push_color(quadcolors, q->get_color().get_id(), current);
+		} else if (e->get_type() == ldraw::type_condline) {
+			const ldraw::element_condline *c = CAST_AS_CONST_CONDLINE(e);
+			push(out.positions[ldraw::flat_geometry::condlines], transform * c->pos1());
+			push(out.positions[ldraw::flat_geometry::condlines], transform * c->pos2());
+			push(out.positions[ldraw::flat_geometry::condlines], transform * c->pos3());
+			push(out.positions[ldraw::flat_geometry::condlines], transform * c->pos4());
+			push_color(out.colors[ldraw::flat_geometry::condlines], c->get_color().get_id(), current);
+		}
+	}
+
+	std::vector<float> &t = out.positions[ldraw::flat_geometry::triangles];
+	std::vector<unsigned char> &tc = out.colors[ldraw::flat_geometry::triangles];
+	t.insert(t.end(), quads.begin(), quads.end());
+	tc.insert(tc.end(), quadcolors.begin(), quadcolors.end());
+
+	for (int i = 0; i < m->size(); ++i) {
+		const ldraw::element_ref *r = CAST_AS_CONST_REF(m->elements()[i]);
+
+		if (r && r->get_model())
+			walk(r->get_model(), transform * r->get_matrix(), inherit(r->get_color().get_id(), current), out);
+	}
+}
+
+// number of primitives of g that differ from the serial walk
+static int compare(const ldraw::flat_geometry &g, const reference_geometry &expected)
+{
+	int wrong = 0;
+
+	for (int p = 0; p < ldraw::flat_geometry::primitive_count; ++p) {
+		const ldraw::flat_geometry::stream &s = g.get((ldraw::flat_geometry::primitive)p);
+		const std::vector<float> &pos = expected.positions[p];
+
+		if (s.size() != (int)expected.colors[p].size() / 4 || s.positions.size() != pos.size()) {
+			std::cerr << "primitive " << p << ": " << s.size() << " built, " << expected.colors[p].size() / 4 << " expected" << std::endl;
+			wrong += std::abs(s.size() - (int)expected.colors[p].size() / 4);
+			continue;
+		}
+
+		int per = s.vertices * 3;
+		for (int i = 0; i < s.size(); ++i) {
+			bool ok = std::memcmp(s.color(i), &expected.colors[p][i * 4], 4) == 0;
+
+			for (int k = 0; k < per && ok; ++k) {
+				float a = s.positions[i * per + k], b = pos[i * per + k];
+				ok = std::fabs(a - b) <= 1e-4f * std::max(1.0f, std::fabs(b));
+			}
+
+			if (!ok)
+				++wrong;
+		}
+	}
+
+	return wrong;
+}
+
+int main(int argc, char *argv[])
+{
+	int iterations = 10;
+	int first = 1;
+
+	if (argc > 2 && std::strcmp(argv[1], "-n") == 0) {
+		iterations = std::atoi(argv[2]);
+		first = 3;
+	}
+
+	if (first + 2 != argc || iterations < 1) {
+		std::cerr << "Usage: " << argv[0] << " [-n iterations] ldrawpath filename" << std::endl;
+		return -1;
+	}
+
+	ldraw::color::init();
+
+	ldraw::part_library library(argv[first]);
+	ldraw::model_multipart *mp = ldraw::reader().load_from_file(argv[first + 1]);
+	if (!mp) {
+		std::cerr << "could not read model file: " << argv[first + 1] << std::endl;
+		return -1;
+	}
+	library.link(mp);
+
+	ldraw::model *m = mp->main_model();
+
+	reference_geometry expected;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int i = 0; i < iterations; ++i) {
+		expected = reference_geometry();
+		walk(m, ldraw::matrix(), 16, expected);
+	}
+	std::chrono::duration<double> serial = std::chrono::steady_clock::now() - start;
+
+	std::cout << argv[first + 1] << ": " << expected.colors[ldraw::flat_geometry::triangles].size() / 4 << " triangles, serial walk "
+			  << serial.count() / iterations * 1000.0 << " ms";
+
+	// 1 runs on the caller only, 0 on every core
+	const int threads[] = { 1, 4, 0 };
+	int wrong = 0;
+
+	for (int t = 0; t < 3; ++t) {
+		ldraw::flat_geometry g;
+
+		start = std::chrono::steady_clock::now();
+		for (int i = 0; i < iterations; ++i)
+			g.build(m, ldraw::matrix(), ldraw::color(16), threads[t]);
+		std::chrono::duration<double> built = std::chrono::steady_clock::now() - start;
+
+		int w = compare(g, expected);
+		if (threads[t])
+			std::cout << ", " << threads[t] << (threads[t] == 1 ? " thread " : " threads ");
+		else
+			std::cout << ", every core ";
+		std::cout << built.count() / iterations * 1000.0 << " ms";
+		if (w)
+			std::cout << " (" << w << " MISMATCHES)";
+
+		wrong += w;
+	}
+	std::cout << std::endl;
+
+	delete mp;
+
+	return wrong ? 1 : 0;
+}
@@ -0,0 +1,274 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include <libldr/math.h>
+
+/* Matrix kernel benchmark: the plain scalar loops vs. libLDR's (SIMD) ones */
+
+static ldraw::matrix scalar_multiply(const ldraw::matrix &a, const ldraw::matrix &b)
+{
+	ldraw::matrix n;
+
+	for (int i = 0; i < 4; i++) {
+		for (int j = 0; j < 4; j++) {
+			n.value(i, j) = 0.0f;
+			for (int k = 0; k < 4; k++)
+				n.value(i, j) += a.value(i, k) * b.value(k, j);
+		}
+	}
+
+	return n;
+}
+
+static ldraw::vector scalar_transform(const ldraw::matrix &m, const ldraw::vector &v)
+{
+	return ldraw::vector(
+		m.value(0, 0)*v.x() + m.value(0, 1)*v.y() + m.value(0, 2)*v.z() + m.value(0, 3)*v.w(),
+		m.value(1, 0)*v.x() + m.value(1, 1)*v.y() + m.value(1, 2)*v.z() + m.value(1, 3)*v.w(),
+		m.value(2, 0)*v.x() + m.value(2, 1)*v.y() + m.value(2, 2)*v.z() + m.value(2, 3)*v.w());
+}
+
+// cofactor inverse as in math.cpp without SIMD
+static ldraw::matrix scalar_inverse(const ldraw::matrix &m)
+{
+	float tmp[12], src[16], det;
+	ldraw::matrix dst;
+
+	// Transpose
+	for (int i = 0; i < 4; i++) {
+		src[i   ] = m.value(i, 0);
+		src[i+ 4] = m.value(i, 1);
+		src[i+ 8] = m.value(i, 2);
+		src[i+12] = m.value(i, 3);
+	}
+
+	/* Calculate pairs for first 8 elements (cofactors) */
+	tmp[ 0] = src[10] * src[15];
+	tmp[ 1] = src[11] * src[14];
+	tmp[ 2] = src[ 9] * src[15];
+	tmp[ 3] = src[11] * src[13];
+	tmp[ 4] = src[ 9] * src[14];
+	tmp[ 5] = src[10] * src[13];
+	tmp[ 6] = src[ 8] * src[15];
+	tmp[ 7] = src[11] * src[12];
+	tmp[ 8] = src[ 8] * src[14];
+	tmp[ 9] = src[10] * src[12];
+	tmp[10] = src[ 8] * src[13];
+	tmp[11] = src[ 9] * src[12];
+
+	/* Calculate first 8 elements (cofactors) */
+	dst.value(0, 0) = tmp[0]*src[5] + tmp[3]*src[6] + tmp[ 4]*src[7] - (tmp[1]*src[5] + tmp[2]*src[6] + tmp[ 5]*src[7]);
+	dst.value(0, 1) = tmp[1]*src[4] + tmp[6]*src[6] + tmp[ 9]*src[7] - (tmp[0]*src[4] + tmp[7]*src[6] + tmp[ 8]*src[7]);
+	dst.value(0, 2) = tmp[2]*src[4] + tmp[7]*src[5] + tmp[10]*src[7] - (tmp[3]*src[4] + tmp[6]*src[5] + tmp[11]*src[7]);
+	dst.value(0, 3) = tmp[5]*src[4] + tmp[8]*src[5] + tmp[11]*src[6] - (tmp[4]*src[4] + tmp[9]*src[5] + tmp[10]*src[6]);
+	dst.value(1, 0) = tmp[1]*src[1] + tmp[2]*src[2] + tmp[ 5]*src[3] - (tmp[0]*src[1] + tmp[3]*src[2] + tmp[ 4]*src[3]);
+	dst.value(1, 1) = tmp[0]*src[0] + tmp[7]*src[2] + tmp[ 8]*src[3] - (tmp[1]*src[0] + tmp[6]*src[2] + tmp[ 9]*src[3]);
+	dst.value(1, 2) = tmp[3]*src[0] + tmp[6]*src[1] + tmp[11]*src[3] - (tmp[2]*src[0] + tmp[7]*src[1] + tmp[10]*src[3]);
+	dst.value(1, 3) = tmp[4]*src[0] + tmp[9]*src[1] + tmp[10]*src[2] - (tmp[5]*src[0] + tmp[8]*src[1] + tmp[11]*src[2]);
+
+	/* Calculate pairs for second 8 elements (cofactors) */
+	tmp[ 0] = src[2] * src[7];
+	tmp[ 1] = src[3] * src[6];
+	tmp[ 2] = src[1] * src[7];
+	tmp[ 3] = src[3] * src[5];
+	tmp[ 4] = src[1] * src[6];
+	tmp[ 5] = src[2] * src[5];
+	tmp[ 6] = src[0] * src[7];
+	tmp[ 7] = src[3] * src[4];
+	tmp[ 8] = src[0] * src[6];
+	tmp[ 9] = src[2] * src[4];
+	tmp[10] = src[0] * src[5];
+	tmp[11] = src[1] * src[4];
+
+	/* Calculate second 8 elements (cofactors) */
+	dst.value(2, 0) = tmp[ 0]*src[13] + tmp[ 3]*src[14] + tmp[ 4]*src[15] - (tmp[ 1]*src[13] + tmp[ 2]*src[14] + tmp[ 5]*src[15]);
+	dst.value(2, 1) = tmp[ 1]*src[12] + tmp[ 6]*src[14] + tmp[ 9]*src[15] - (tmp[ 0]*src[12] + tmp[ 7]*src[14] + tmp[ 8]*src[15]);
+	dst.value(2, 2) = tmp[ 2]*src[12] + tmp[ 7]*src[13] + tmp[10]*src[15] - (tmp[ 3]*src[12] + tmp[ 6]*src[13] + tmp[11]*src[15]);
+	dst.value(2, 3) = tmp[ 5]*src[12] + tmp[ 8]*src[13] + tmp[11]*src[14] - (tmp[ 4]*src[12] + tmp[ 9]*src[13] + tmp[10]*src[14]);
+	dst.value(3, 0) = tmp[ 2]*src[10] + tmp[ 5]*src[11] + tmp[ 1]*src[ 9] - (tmp[ 4]*src[11] + tmp[ 0]*src[ 9] + tmp[ 3]*src[10]);
+	dst.value(3, 1) = tmp[ 8]*src[11] + tmp[ 0]*src[ 8] + tmp[ 7]*src[10] - (tmp[ 6]*src[10] + tmp[ 9]*src[11] + tmp[ 1]*src[ 8]);
+	dst.value(3, 2) = tmp[ 6]*src[ 9] + tmp[11]*src[11] + tmp[ 3]*src[ 8] - (tmp[10]*src[11] + tmp[ 2]*src[ 8] + tmp[ 7]*src[ 9]);
+	dst.value(3, 3) = tmp[10]*src[10] + tmp[ 4]*src[ 8] + tmp[ 9]*src[ 9] - (tmp[ 8]*src[ 9] + tmp[11]*src[10] + tmp[ 5]*src[ 8]);
+
+	/* Calculate determinant */
+	det = 1.0 / (src[0]*dst.value(0, 0) + src[1]*dst.value(0, 1) + src[2]*dst.value(0, 2) + src[3]*dst.value(0, 3));
+
+	/* Calculate inverse matrix */
+	for (int j = 0; j < 4; j++) {
+		dst.value(j, 0) *= det;
+		dst.value(j, 1) *= det;
+		dst.value(j, 2) *= det;
+		dst.value(j, 3) *= det;
+	}
+
+	return dst;
+}
+
+// Gauss-Jordan in double precision; only the reference for checking ~
+static ldraw::matrix reference_inverse(const ldraw::matrix &m)
+{
+	double a[4][8];
+
+	for (int i = 0; i < 4; i++) {
+		for (int j = 0; j < 4; j++) {
+			a[i][j] = m.value(i, j);
+			a[i][j + 4] = i == j ? 1.0 : 0.0;
+		}
+	}
+
+	for (int c = 0; c < 4; c++) {
+		int p = c;
+		for (int r = c + 1; r < 4; r++) {
+			if (std::fabs(a[r][c]) > std::fabs(a[p][c]))
+				p = r;
+		}
+		for (int j = 0; j < 8; j++)
+			std::swap(a[c][j], a[p][j]);
+
+		double d = a[c][c];
+		for (int j = 0; j < 8; j++)
+			a[c][j] /= d;
+
+		for (int r = 0; r < 4; r++) {
+			if (r == c)
+				continue;
+			double f = a[r][c];
+			for (int j = 0; j < 8; j++)
+				a[r][j] -= f * a[c][j];
+		}
+	}
+
+	ldraw::matrix out;
+	for (int i = 0; i < 4; i++) {
+		for (int j = 0; j < 4; j++)
+			out.value(i, j) = (float)a[i][j + 4];
+	}
+
+	return out;
+}
+
+static float frand()
+{
+	return (float)std::rand() / RAND_MAX * 2.0f - 1.0f;
+}
+
+// rotation/scale part and translation like in a model file; kept well away
+// from singular so that the inverses can be compared
+static ldraw::matrix random_matrix()
+{
+	return ldraw::matrix(frand() + 3.0f, frand(), frand(), frand(), frand() + 3.0f, frand(), frand(), frand(), frand() + 3.0f,
+						 frand() * 100.0f, frand() * 100.0f, frand() * 100.0f);
+}
+
+static double now()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void report(const char *name, double scalar, double simd, int n, bool ok)
+{
+	std::cout << name << ": scalar " << scalar / n * 1e9 << " ns, libLDR " << simd / n * 1e9 << " ns, speedup "
+			  << scalar / simd << "x" << (ok ? "" : " (MISMATCH)") << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+	int n = argc > 1 ? std::atoi(argv[1]) : 1 << 20;
+
+	if (n < 1) {
+		std::cerr << "Usage: " << argv[0] << " [count]" << std::endl;
+		return -1;
+	}
+
+	std::vector<ldraw::matrix> a, b, r1(n), r2(n);
+	std::vector<ldraw::vector> v, o1(n), o2(n);
+	std::vector<float> points(n * 3), p1(n * 3), p2(n * 3);
+
+	for (int i = 0; i < n; ++i) {
+		a.push_back(random_matrix());
+		b.push_back(random_matrix());
+		v.push_back(ldraw::vector(frand() * 100.0f, frand() * 100.0f, frand() * 100.0f));
+		std::memcpy(&points[i * 3], v[i].get_pointer(), sizeof(float) * 3);
+	}
+
+	bool identical = true, ok;
+	double t0, t1, t2;
+
+	// matrix * matrix; same order of additions, so the results must be equal
+	t0 = now();
+	for (int i = 0; i < n; ++i)
+		r1[i] = scalar_multiply(a[i], b[i]);
+	t1 = now();
+	for (int i = 0; i < n; ++i)
+		r2[i] = a[i] * b[i];
+	t2 = now();
+
+	ok = true;
+	for (int i = 0; i < n; ++i)
+		ok &= std::memcmp(r1[i].get_pointer(), r2[i].get_pointer(), sizeof(float) * 16) == 0;
+	report("matrix * matrix", t1 - t0, t2 - t1, n, ok);
+	identical &= ok;
+
+	// matrix * vector
+	t0 = now();
+	for (int i = 0; i < n; ++i)
+		o1[i] = scalar_transform(a[i & 1023], v[i]);
+	t1 = now();
+	for (int i = 0; i < n; ++i)
+		o2[i] = a[i & 1023] * v[i];
+	t2 = now();
+
+	ok = true;
+	for (int i = 0; i < n; ++i)
+		ok &= std::memcmp(o1[i].get_pointer(), o2[i].get_pointer(), sizeof(float) * 3) == 0;
+	report("matrix * vector", t1 - t0, t2 - t1, n, ok);
+	identical &= ok;
+
+	// n points through one matrix
+	t0 = now();
+	for (int i = 0; i < n; ++i) {
+		ldraw::vector t = scalar_transform(a[0], ldraw::vector(points[i * 3], points[i * 3 + 1], points[i * 3 + 2]));
+		std::memcpy(&p1[i * 3], t.get_pointer(), sizeof(float) * 3);
+	}
+	t1 = now();
+	a[0].transform(&points[0], &p2[0], n);
+	t2 = now();
+
+	ok = p1 == p2;
+	report("matrix::transform", t1 - t0, t2 - t1, n, ok);
+	identical &= ok;
+
+	// inverse; both checked against a double precision reference
+	t0 = now();
+	for (int i = 0; i < n; ++i)
+		r1[i] = scalar_inverse(a[i]);
+	t1 = now();
+	for (int i = 0; i < n; ++i)
+		r2[i] = ~a[i];
+	t2 = now();
+
+	// the cofactors of the translation cancel out a lot, so allow for the
+	// magnitude of the whole matrix
+	ok = true;
+	for (int i = 0; i < n; ++i) {
+		ldraw::matrix ref = reference_inverse(a[i]);
+		float scale = 1.0f;
+
+		for (int j = 0; j < 16; ++j)
+			scale = std::max(scale, std::fabs(ref.get_pointer()[j]));
+		for (int j = 0; j < 16; ++j) {
+			float x = ref.get_pointer()[j];
+			ok &= std::fabs(x - r1[i].get_pointer()[j]) <= 1e-4f * scale;
+			ok &= std::fabs(x - r2[i].get_pointer()[j]) <= 1e-4f * scale;
+		}
+	}
+	report("~matrix", t1 - t0, t2 - t1, n, ok);
+	identical &= ok;
+
+	return identical ? 0 : 1;
+}
@@ -12,6 +12,7 @@
 #include <renderer/opengl.h>
 #include <renderer/normal_extension.h>
 #include <renderer/opengl_extension_vbo.h>
+#include <renderer/renderer_opengl_retained.h>
 #include <renderer/vbuffer_extension.h>
 
 #include "modelviewer.h"
@@ -29,6 +30,7 @@ ldraw_renderer::renderer_opengl *renderer_;
 int width_, height_;
 float length_;
 int memsiz_ = 0;
+int drawn_ = 0, culled_ = 0, simplified_ = 0;
 ldraw_renderer::parameters params_;
 ldraw_renderer::renderer_opengl_factory::rendering_mode mode_ = ldraw_renderer::renderer_opengl_factory::mode_vbo;
 
@@ -106,6 +108,13 @@ void render(int elapsed)
 
 	memsiz_ = ldraw_renderer::vbuffer_extension::get_total_memory_usage();
 
+	const ldraw_renderer::renderer_opengl_retained *retained = dynamic_cast<const ldraw_renderer::renderer_opengl_retained *>(renderer_);
+	if (retained) {
+		drawn_ = retained->get_culling_stats()->drawn;
+		culled_ = retained->get_culling_stats()->culled;
+		simplified_ = retained->get_culling_stats()->simplified;
+	}
+
 	glPopMatrix();
 
 	glDisable(GL_LIGHTING);
@@ -119,13 +128,13 @@ void resize(int width, int height)
 	length_ = std::sqrt(std::pow(width_, 2.0) + std::pow(height_, 2.0));
 
 	const ldraw::metrics *metrics = model_->main_model()->custom_data<ldraw::metrics>();
-	float distance = ldraw::vector::distance(ldraw::vector(0.0, 0.0, 0.0), (metrics->max() - metrics->min()) * 0.5f) * 1.5f;
-	float theight = std::fabs(metrics->max().z() - metrics->min().z());
+	float distance = ldraw::vector::distance(ldraw::vector(0.0, 0.0, 0.0), (metrics->max_() - metrics->min_()) * 0.5f) * 1.5f;
+	float theight = std::fabs(metrics->max_().z() - metrics->min_().z());
 
 	glMatrixMode(GL_MODELVIEW);
 	glLoadIdentity();
 	
-	ldraw::vector lv = (metrics->min() + metrics->max()) * 0.5f;
+	ldraw::vector lv = (metrics->min_() + metrics->max_()) * 0.5f;
 	glTranslatef(-lv.x(), -lv.y(), -lv.z());
 	
 	glMatrixMode(GL_PROJECTION);
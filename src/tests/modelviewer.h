@@ -7,6 +7,7 @@
 extern int width_, height_;
 extern float length_;
 extern int memsiz_;
+extern int drawn_, culled_, simplified_;
 extern ldraw_renderer::parameters params_;
 extern ldraw_renderer::renderer_opengl_factory::rendering_mode mode_;
 extern ldraw_renderer::renderer_opengl *renderer_;
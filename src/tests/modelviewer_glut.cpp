@@ -80,6 +80,14 @@ void displayFunc()
 	if (mode_ != ldraw_renderer::renderer_opengl_factory::mode_immediate) {
 		std::snprintf(text, sizeof(text), "%.3f Kbytes of vertex buffers", memsiz_ / 1024.0f);
 		renderText(10, 65, (const unsigned char *)text);
+
+		std::snprintf(text, sizeof(text), "%d references drawn, %d culled (%s; 'c' toggles)", drawn_, culled_,
+					  params_.get_frustum_culling() ? "frustum culling on" : "frustum culling off");
+		renderText(10, 80, (const unsigned char *)text);
+
+		std::snprintf(text, sizeof(text), "%d simplified (%s; 'l' toggles)", simplified_,
+					  params_.get_level_of_detail() ? "level of detail on" : "level of detail off");
+		renderText(10, 95, (const unsigned char *)text);
 	}
 
 	glMatrixMode(GL_PROJECTION);
@@ -88,6 +96,14 @@ void displayFunc()
 	glutSwapBuffers();
 }
 
+void keyboardFunc(unsigned char key, int, int)
+{
+	if (key == 'c')
+		params_.set_frustum_culling(!params_.get_frustum_culling());
+	else if (key == 'l')
+		params_.set_level_of_detail(!params_.get_level_of_detail());
+}
+
 int main(int argc, char *argv[])
 {
 	if (!initializeLdraw())
@@ -121,6 +137,7 @@ int main(int argc, char *argv[])
 	glutDisplayFunc(displayFunc);
 	glutIdleFunc(displayFunc);
 	glutReshapeFunc(resize);
+	glutKeyboardFunc(keyboardFunc);
 	glutMainLoop();
 
 	return 0;
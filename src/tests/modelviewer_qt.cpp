@@ -88,6 +88,7 @@ void ModelViewerWidget::paintEvent(QPaintEvent *event)
 	end = time_.elapsed();
 
 	p.drawText(10, 25, QString("%1 ms").arg(end - start));
+	p.drawText(10, 40, QString("%1 references drawn, %2 culled, %3 simplified").arg(drawn_).arg(culled_).arg(simplified_));
 	p.end();
 }
 
@@ -0,0 +1,257 @@
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include <libldr/bvh.h>
+#include <libldr/color.h>
+#include <libldr/elements.h>
+#include <libldr/filter.h>
+#include <libldr/metrics.h>
+#include <libldr/model.h>
+#include <libldr/part_library.h>
+#include <libldr/reader.h>
+
+/* Picking benchmark: ldraw::pick() vs. testing every triangle of the model */
+
+// skips every odd element of the model picked from
+class odd_filter : public ldraw::filter
+{
+  public:
+	odd_filter(const ldraw::model *m) : m_model(m) {}
+
+	bool query(const ldraw::model *m, int index, int) const { return m == m_model && index % 2; }
+
+  private:
+	const ldraw::model *m_model;
+};
+
+// Moeller-Trumbore, in double so that the reference answer is the better one
+static bool intersect(const ldraw::ray &r, const ldraw::vector &a, const ldraw::vector &b, const ldraw::vector &c, double &depth)
+{
+	double s[3], d[3], e1[3], e2[3];
+
+	for (int i = 0; i < 3; ++i) {
+		s[i] = r.origin[i] - a[i];
+		d[i] = r.direction[i];
+		e1[i] = b[i] - a[i];
+		e2[i] = c[i] - a[i];
+	}
+
+	double p[3] = { d[1] * e2[2] - d[2] * e2[1], d[2] * e2[0] - d[0] * e2[2], d[0] * e2[1] - d[1] * e2[0] };
+	double det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+	if (det == 0.0)
+		return false;
+
+	double u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) / det;
+	if (u < 0.0 || u > 1.0)
+		return false;
+
+	double q[3] = { s[1] * e1[2] - s[2] * e1[1], s[2] * e1[0] - s[0] * e1[2], s[0] * e1[1] - s[1] * e1[0] };
+	double v = (d[0] * q[0] + d[1] * q[1] + d[2] * q[2]) / det;
+	if (v < 0.0 || u + v > 1.0)
+		return false;
+
+	depth = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) / det;
+
+	return depth > 0.0;
+}
+
+static bool brute_force(const ldraw::model *m, const ldraw::matrix &transform, const ldraw::ray &r, double &depth);
+
+// nearest hit on element e of m placed by transform, closer than depth
+static bool brute_force(const ldraw::model *m, const ldraw::element_base *e, const ldraw::matrix &transform, const ldraw::ray &r, double &depth)
+{
+	bool hit = false;
+	double d;
+
+	if (e->get_type() == ldraw::type_ref) {
+		const ldraw::element_ref *l = CAST_AS_CONST_REF(e);
+		if (l->get_model() && l->get_model() != m && !l->is_singular())
+			hit = brute_force(l->get_model(), transform * l->get_matrix(), r, depth);
+	} else if (e->get_type() == ldraw::type_triangle) {
+		const ldraw::element_triangle *t = CAST_AS_CONST_TRIANGLE(e);
+		if (intersect(r, transform * t->pos1(), transform * t->pos2(), transform * t->pos3(), d) && d < depth) {
+			depth = d;
+			hit = true;
+		}
+	} else if (e->get_type() == ldraw::type_quadrilateral) {
+		// split as triangle_bvh does
+		const ldraw::element_quadrilateral *q = CAST_AS_CONST_QUADRILATERAL(e);
+		ldraw::vector v[4] = { transform * q->pos1(), transform * q->pos2(), transform * q->pos3(), transform * q->pos4() };
+		if (intersect(r, v[0], v[1], v[2], d) && d < depth) {
+			depth = d;
+			hit = true;
+		}
+		if (intersect(r, v[0], v[2], v[3], d) && d < depth) {
+			depth = d;
+			hit = true;
+		}
+	}
+
+	return hit;
+}
+
+// nearest hit below m placed by transform, closer than depth
+static bool brute_force(const ldraw::model *m, const ldraw::matrix &transform, const ldraw::ray &r, double &depth)
+{
+	bool hit = false;
+
+	for (int i = 0; i < m->size(); ++i)
+		hit |= brute_force(m, m->elements()[i], transform, r, depth);
+
+	return hit;
+}
+
+// what pick() should answer
+static ldraw::pick_result reference_pick(const ldraw::model *m, const ldraw::ray &r, const ldraw::filter *skip)
+{
+	ldraw::pick_result result;
+	double depth = 1e30;
+
+	result.element = -1;
+	result.depth = 0.0f;
+
+	for (int i = 0; i < m->size(); ++i) {
+		if (skip && skip->query(m, i, 0))
+			continue;
+
+		if (brute_force(m, m->elements()[i], ldraw::matrix(), r, depth)) {
+			result.element = i;
+			result.depth = (float)depth;
+		}
+	}
+
+	return result;
+}
+
+static float frand()
+{
+	return (float)std::rand() / RAND_MAX;
+}
+
+// Shoots rays through random points of the bounding box of m and returns the
+// number of answers pick() got wrong; every fourth ray skips odd elements.
+static int run(ldraw::model *m, int rays, double &brute_time, double &pick_time)
+{
+	m->update_custom_data<ldraw::metrics>();
+	const ldraw::metrics *mt = m->custom_data<ldraw::metrics>();
+	ldraw::vector lo = mt->min_(), hi = mt->max_();
+	float reach = (hi - lo).length() * 2.0f;
+
+	odd_filter odd(m);
+	int wrong = 0;
+
+	brute_time = pick_time = 0.0;
+
+	for (int i = 0; i < rays; ++i) {
+		ldraw::vector target(lo.x() + frand() * (hi.x() - lo.x()), lo.y() + frand() * (hi.y() - lo.y()), lo.z() + frand() * (hi.z() - lo.z()));
+		ldraw::vector direction(frand() - 0.5f, frand() - 0.5f, frand() - 0.5f);
+		const ldraw::filter *skip = i % 4 == 3 ? &odd : 0L;
+
+		ldraw::ray r;
+		r.origin = target - direction * reach;
+		r.direction = direction;
+
+		std::chrono::steady_clock::time_point a = std::chrono::steady_clock::now();
+		ldraw::pick_result expected = reference_pick(m, r, skip);
+		std::chrono::steady_clock::time_point b = std::chrono::steady_clock::now();
+		ldraw::pick_result result = ldraw::pick(m, r, skip);
+		std::chrono::steady_clock::time_point c = std::chrono::steady_clock::now();
+
+		brute_time += std::chrono::duration<double>(b - a).count();
+		pick_time += std::chrono::duration<double>(c - b).count();
+
+		if (result.element != expected.element ||
+			(expected.element >= 0 && std::fabs(result.depth - expected.depth) > 1e-3f * expected.depth))
+			++wrong;
+	}
+
+	return wrong;
+}
+
+// halves the first model two references down, so that pick() has to
+// notice a change below a model that did not change itself
+static ldraw::model* edit_nested(ldraw::model *m)
+{
+	for (int i = 0; i < m->size(); ++i) {
+		const ldraw::element_ref *l = CAST_AS_CONST_REF(m->elements()[i]);
+		if (!l || !l->get_model())
+			continue;
+
+		ldraw::model *c = l->get_model();
+		for (int j = 0; j < c->size(); ++j) {
+			const ldraw::element_ref *k = CAST_AS_CONST_REF(c->elements()[j]);
+			if (!k || !k->get_model() || k->get_model()->size() < 2)
+				continue;
+
+			ldraw::model *g = k->get_model();
+			int n = g->size() / 2;
+			while (g->size() > n)
+				g->delete_element(0);
+
+			return g;
+		}
+	}
+
+	return 0L;
+}
+
+int main(int argc, char *argv[])
+{
+	int rays = 2000;
+	int first = 1;
+
+	if (argc > 2 && std::strcmp(argv[1], "-n") == 0) {
+		rays = std::atoi(argv[2]);
+		first = 3;
+	}
+
+	if (first + 2 != argc || rays < 1) {
+		std::cerr << "Usage: " << argv[0] << " [-n rays] ldrawpath filename" << std::endl;
+		return -1;
+	}
+
+	ldraw::color::init();
+
+	ldraw::part_library library(argv[first]);
+	ldraw::model_multipart *mp = ldraw::reader().load_from_file(argv[first + 1]);
+	if (!mp) {
+		std::cerr << "could not read model file: " << argv[first + 1] << std::endl;
+		return -1;
+	}
+	library.link(mp);
+
+	ldraw::model *m = mp->main_model();
+	std::srand(1);
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	ldraw::triangle_bvh::current(m);
+	std::chrono::duration<double> build = std::chrono::steady_clock::now() - start;
+
+	double tb, tp;
+	int wrong = run(m, rays, tb, tp);
+
+	std::cout << argv[first + 1] << ": build " << build.count() * 1000.0 << " ms, brute force " << tb / rays * 1e6
+			  << " us/ray, pick " << tp / rays * 1e6 << " us/ray, speedup " << tb / tp << "x";
+	if (wrong)
+		std::cout << " (" << wrong << " MISMATCHES)";
+	std::cout << std::endl;
+
+	ldraw::model *edited = edit_nested(m);
+	if (edited) {
+		int after = run(m, rays, tb, tp);
+
+		std::cout << "after editing " << edited->name() << ": pick " << tp / rays * 1e6 << " us/ray";
+		if (after)
+			std::cout << " (" << after << " MISMATCHES)";
+		std::cout << std::endl;
+
+		wrong += after;
+	}
+
+	delete mp;
+
+	return wrong ? 1 : 0;
+}
@@ -0,0 +1,476 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <sstream>
+
+#include <libldr/bfc.h>
+#include <libldr/color.h>
+#include <libldr/elements.h>
+#include <libldr/model.h>
+#include <libldr/reader.h>
+#include <libldr/utils.h>
+
+/* Parse-throughput benchmark: the getline()/istringstream parser the reader
+ * started out with vs. the tokenizing stream reader vs. the memory-mapped
+ * reader; then, on a large multipart file built from the inputs, the legacy
+ * parser with and without its "0 FILE" pre-scan vs. the single-pass reader */
+
+/* The legacy parser, kept as the baseline: every line is read with getline()
+ * and trimmed into a new string, numbers go through an istringstream, and a
+ * first pass over the whole file collects the names of the submodels before
+ * the second one parses. */
+namespace legacy
+{
+
+static ldraw::element_base* parse_line(const std::string &command, ldraw::model *m)
+{
+	std::string line = ldraw::utils::trim_string(command);
+
+	if (line.length() == 0)
+		return 0;
+	if (line[0] == '0') {
+		std::string cont = ldraw::utils::trim_string(line.substr(1, line.length()-1));
+		std::string contlc = ldraw::utils::translate_string(cont);
+		if (cont.length() == 0)
+			return 0;
+
+		if (cont[0] == '!') {
+			size_t pos = cont.find_first_of(" ");
+			if (m && pos != std::string::npos)
+				m->set_header(cont.substr(1, pos - 1), cont.substr(pos + 1));
+		} else if (contlc == "step") {
+			return new ldraw::element_state(ldraw::element_state::state_step);
+		} else if (contlc == "pause") {
+			return new ldraw::element_state(ldraw::element_state::state_pause);
+		} else if (contlc == "clear") {
+			return new ldraw::element_state(ldraw::element_state::state_clear);
+		} else if (contlc == "save") {
+			return new ldraw::element_state(ldraw::element_state::state_save);
+		} else if (contlc.length() > 6 && (contlc.substr(0, 5) == "print" || contlc.substr(0, 5) == "write")) {
+			return new ldraw::element_print(cont.substr(6, line.length()-6));
+		} else if (contlc.length() > 3 && contlc.substr(0, 3) == "bfc") {
+			std::string subs = contlc.substr(4, line.length() - 4);
+			int cert = -1, winding = -1;
+
+			if (subs == "ccw")
+				return new ldraw::element_bfc(ldraw::element_bfc::ccw);
+			else if (subs == "cw")
+				return new ldraw::element_bfc(ldraw::element_bfc::cw);
+			else if (subs == "clip")
+				return new ldraw::element_bfc(ldraw::element_bfc::clip);
+			else if (subs == "clip cw" || subs == "cw clip")
+				return new ldraw::element_bfc(ldraw::element_bfc::clip_cw);
+			else if (subs == "clip ccw" || subs == "ccw clip")
+				return new ldraw::element_bfc(ldraw::element_bfc::clip_ccw);
+			else if (subs == "noclip")
+				return new ldraw::element_bfc(ldraw::element_bfc::noclip);
+			else if (subs == "invertnext")
+				return new ldraw::element_bfc(ldraw::element_bfc::invertnext);
+			else if (subs == "certify" || subs == "certify ccw")
+				cert = ldraw::bfc_certification::certified, winding = ldraw::bfc_certification::ccw;
+			else if (subs == "certify cw")
+				cert = ldraw::bfc_certification::certified, winding = ldraw::bfc_certification::cw;
+			else if (subs == "nocertify")
+				cert = ldraw::bfc_certification::uncertified;
+
+			if (m && cert != -1) {
+				ldraw::bfc_certification *c = m->init_custom_data<ldraw::bfc_certification>();
+				c->set_certification((ldraw::bfc_certification::cert_status)cert);
+				if (winding != -1)
+					c->set_orientation((ldraw::bfc_certification::winding)winding);
+			}
+
+			return 0L;
+		} else if (contlc.length() > 0) {
+			return new ldraw::element_comment(cont);
+		}
+	} else if (line[0] == '1') {
+		std::istringstream s(line.substr(2, line.length()-2));
+		std::string col;
+		float x, y, z, a, b, c, d, e, f, g, h, i;
+		char fnbuf[255];
+
+		s >> col >> x >> y >> z >> a >> b >> c >> d >> e >> f >> g >> h >> i;
+		s.getline(fnbuf, 255);
+
+		std::string fn = ldraw::utils::trim_string(std::string(fnbuf));
+
+		return new ldraw::element_ref(ldraw::color(std::stoi(col, nullptr, 0)), ldraw::matrix(a, b, c, d, e, f, g, h, i, x, y, z), fn);
+	} else if (line[0] == '2') {
+		std::istringstream s(line.substr(2, line.length()-2));
+		int col;
+		float x1, y1, z1, x2, y2, z2;
+
+		s >> col >> x1 >> y1 >> z1 >> x2 >> y2 >> z2;
+
+		return new ldraw::element_line(ldraw::color(col), ldraw::vector(x1, y1, z1), ldraw::vector(x2, y2, z2));
+	} else if (line[0] == '3') {
+		std::istringstream s(line.substr(2, line.length()-2));
+		int col;
+		float x1, y1, z1, x2, y2, z2, x3, y3, z3;
+
+		s >> col >> x1 >> y1 >> z1 >> x2 >> y2 >> z2 >> x3 >> y3 >> z3;
+
+		return new ldraw::element_triangle(ldraw::color(col), ldraw::vector(x1, y1, z1), ldraw::vector(x2, y2, z2), ldraw::vector(x3, y3, z3));
+	} else if (line[0] == '4' || line[0] == '5') {
+		std::istringstream s(line.substr(2, line.length()-2));
+		int col;
+		float x1, y1, z1, x2, y2, z2, x3, y3, z3, x4, y4, z4;
+
+		s >> col >> x1 >> y1 >> z1 >> x2 >> y2 >> z2 >> x3 >> y3 >> z3 >> x4 >> y4 >> z4;
+
+		if (line[0] == '4')
+			return new ldraw::element_quadrilateral(ldraw::color(col), ldraw::vector(x1, y1, z1), ldraw::vector(x2, y2, z2), ldraw::vector(x3, y3, z3), ldraw::vector(x4, y4, z4));
+		else
+			return new ldraw::element_condline(ldraw::color(col), ldraw::vector(x1, y1, z1), ldraw::vector(x2, y2, z2), ldraw::vector(x3, y3, z3), ldraw::vector(x4, y4, z4));
+	}
+
+	return 0L;
+}
+
+// true when stopped at the "0 FILE" line of the next submodel
+static bool parse_stream(ldraw::model *m, std::istream &stream, std::string *keyname)
+{
+	std::string line;
+	int lines = 0;
+	int zerocnt = 0;
+	bool founddesc = false;
+	bool foundheader;
+
+	while (!stream.eof()) {
+		std::getline(stream, line);
+		line = ldraw::utils::trim_string(line);
+		long llen = line.length();
+		++lines;
+		if (llen == 0)
+			continue;
+		if (llen > 7 && line.substr(0, 6) == "0 FILE") {
+			if (keyname)
+				*keyname = line.substr(7, llen - 7);
+			if (lines != 1) {
+				stream.seekg((long)stream.tellg() - llen - 1);
+				return true;
+			}
+		}
+
+		foundheader = false;
+
+		if (line[0] == '0') {
+			foundheader = true;
+			++zerocnt;
+
+			std::string cont = ldraw::utils::trim_string(line.substr(1, line.length()-1));
+			std::string contlc = ldraw::utils::translate_string(cont);
+
+			if (contlc.length() > 4 && contlc.substr(0, 4) == "file")
+				;
+			else if (contlc.length() > 6 && contlc.substr(0, 5) == "name:")
+				m->set_name(cont.substr(6, cont.length() - 6));
+			else if (contlc.length() > 5 && contlc.substr(0, 4) == "name")
+				m->set_name(cont.substr(5, cont.length() - 5));
+			else if (contlc.length() > 8 && contlc.substr(0, 7) == "author:")
+				m->set_author(cont.substr(8, cont.length() - 8));
+			else if (contlc.length() > 7 && contlc.substr(0, 6) == "author")
+				m->set_author(cont.substr(7, cont.length() - 7));
+			else if (zerocnt < 3 && !founddesc) {
+				m->set_desc(cont);
+				founddesc = true;
+			} else {
+				foundheader = false;
+			}
+		}
+
+		if (!foundheader) {
+			ldraw::element_base *el = parse_line(line, m);
+			if (el)
+				m->insert_element(el);
+		}
+	}
+
+	return false;
+}
+
+static ldraw::model_multipart* load_from_file(const char *filename, bool prescan = true)
+{
+	std::ifstream stream(filename, std::ios::in);
+	ldraw::model_multipart *nm = new ldraw::model_multipart;
+
+	// the first pass, whose result the second never needed
+	if (prescan) {
+		std::set<std::string> names;
+		std::string line;
+		while (!stream.eof()) {
+			std::getline(stream, line);
+			line = ldraw::utils::trim_string(line);
+			if (line.length() > 7 && line.substr(0, 6) == "0 FILE")
+				names.insert(ldraw::utils::translate_string(line.substr(7, line.length() - 7)));
+		}
+
+		stream.clear();
+		stream.seekg(0, std::ios::beg);
+	}
+
+	std::string keyname;
+	bool more = parse_stream(nm->main_model(), stream, &keyname);
+	if (nm->main_model()->name().empty()) {
+		std::string name(filename);
+		size_t o = name.find_last_of("/");
+		nm->main_model()->set_name(o == std::string::npos ? name : name.substr(o + 1));
+	}
+
+	while (more) {
+		std::string fn;
+		ldraw::model *m = new ldraw::model(nm);
+
+		m->set_modeltype(ldraw::model::submodel);
+		more = parse_stream(m, stream, &fn);
+		m->set_name(keyname);
+
+		nm->insert_submodel(m, keyname);
+
+		keyname = fn;
+	}
+
+	nm->link_submodels();
+
+	return nm;
+}
+
+}
+
+static bool same_vector(const ldraw::vector &a, const ldraw::vector &b)
+{
+	return std::memcmp(a.get_pointer(), b.get_pointer(), sizeof(float) * 3) == 0;
+}
+
+static bool same_element(const ldraw::element_base *a, const ldraw::element_base *b)
+{
+	if (a->get_type() != b->get_type())
+		return false;
+
+	switch (a->get_type()) {
+		case ldraw::type_comment:
+			return CAST_AS_CONST_COMMENT(a)->get_comment() == CAST_AS_CONST_COMMENT(b)->get_comment();
+		case ldraw::type_state:
+			return CAST_AS_CONST_STATE(a)->get_state() == CAST_AS_CONST_STATE(b)->get_state();
+		case ldraw::type_print:
+			return CAST_AS_CONST_PRINT(a)->get_string() == CAST_AS_CONST_PRINT(b)->get_string();
+		case ldraw::type_bfc:
+			return CAST_AS_CONST_BFC(a)->get_command() == CAST_AS_CONST_BFC(b)->get_command();
+		case ldraw::type_ref: {
+			const ldraw::element_ref *l = CAST_AS_CONST_REF(a), *r = CAST_AS_CONST_REF(b);
+			return l->get_color() == r->get_color() && l->filename() == r->filename() &&
+				std::memcmp(l->get_matrix().get_pointer(), r->get_matrix().get_pointer(), sizeof(float) * 16) == 0;
+		}
+		case ldraw::type_line: {
+			const ldraw::element_line *l = CAST_AS_CONST_LINE(a), *r = CAST_AS_CONST_LINE(b);
+			return l->get_color() == r->get_color() && same_vector(l->pos1(), r->pos1()) && same_vector(l->pos2(), r->pos2());
+		}
+		case ldraw::type_triangle: {
+			const ldraw::element_triangle *l = CAST_AS_CONST_TRIANGLE(a), *r = CAST_AS_CONST_TRIANGLE(b);
+			return l->get_color() == r->get_color() && same_vector(l->pos1(), r->pos1()) && same_vector(l->pos2(), r->pos2()) &&
+				same_vector(l->pos3(), r->pos3());
+		}
+		case ldraw::type_quadrilateral: {
+			const ldraw::element_quadrilateral *l = CAST_AS_CONST_QUADRILATERAL(a), *r = CAST_AS_CONST_QUADRILATERAL(b);
+			return l->get_color() == r->get_color() && same_vector(l->pos1(), r->pos1()) && same_vector(l->pos2(), r->pos2()) &&
+				same_vector(l->pos3(), r->pos3()) && same_vector(l->pos4(), r->pos4());
+		}
+		case ldraw::type_condline: {
+			const ldraw::element_condline *l = CAST_AS_CONST_CONDLINE(a), *r = CAST_AS_CONST_CONDLINE(b);
+			return l->get_color() == r->get_color() && same_vector(l->pos1(), r->pos1()) && same_vector(l->pos2(), r->pos2()) &&
+				same_vector(l->pos3(), r->pos3()) && same_vector(l->pos4(), r->pos4());
+		}
+	}
+
+	return false;
+}
+
+static bool same_model(const ldraw::model *a, const ldraw::model *b)
+{
+	if (a->name() != b->name() || a->desc() != b->desc() || a->author() != b->author() || a->headers() != b->headers())
+		return false;
+	if (a->size() != b->size())
+		return false;
+
+	const ldraw::bfc_certification *ca = a->custom_data<ldraw::bfc_certification>();
+	const ldraw::bfc_certification *cb = b->custom_data<ldraw::bfc_certification>();
+	if (!ca != !cb || (ca && (ca->certification() != cb->certification() || ca->orientation() != cb->orientation())))
+		return false;
+
+	for (int i = 0; i < a->size(); ++i) {
+		if (!same_element(a->elements()[i], b->elements()[i]))
+			return false;
+	}
+
+	return true;
+}
+
+static bool same_model(const ldraw::model_multipart *a, const ldraw::model_multipart *b)
+{
+	if (!same_model(a->main_model(), b->main_model()) || a->submodel_list().size() != b->submodel_list().size())
+		return false;
+
+	ldraw::model_multipart::submodel_const_iterator ia = a->submodel_list().begin();
+	ldraw::model_multipart::submodel_const_iterator ib = b->submodel_list().begin();
+	for (; ia != a->submodel_list().end(); ++ia, ++ib) {
+		if ((*ia).first != (*ib).first || !same_model((*ia).second, (*ib).second))
+			return false;
+	}
+
+	return true;
+}
+
+static double run(const ldraw::reader &r, const char *filename, int iterations)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	for (int i = 0; i < iterations; ++i)
+		delete r.load_from_file(filename);
+
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	return elapsed.count();
+}
+
+static double run_legacy(const char *filename, int iterations, bool prescan = true)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	for (int i = 0; i < iterations; ++i)
+		delete legacy::load_from_file(filename, prescan);
+
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	return elapsed.count();
+}
+
+// Writes copies of the inputs, each as a submodel of its own, until there is
+// at least min_bytes; "0 FILE" lines of multipart inputs are left out so that
+// the names stay unique. Returns the number of bytes written.
+static double make_multipart(const char *filename, int argc, char *argv[], int first, double min_bytes)
+{
+	std::ofstream out(filename, std::ios::out | std::ios::binary);
+	double bytes = 0.0;
+	int copies = 0;
+
+	while (bytes < min_bytes) {
+		for (int i = first; i < argc; ++i) {
+			std::ifstream in(argv[i], std::ios::in | std::ios::binary);
+			std::string line;
+			std::ostringstream header;
+
+			header << "0 FILE copy" << copies++ << ".ldr\n";
+			out << header.str();
+			bytes += header.str().length();
+
+			while (std::getline(in, line)) {
+				if (ldraw::utils::trim_string(line).compare(0, 6, "0 FILE") == 0)
+					continue;
+				out << line << '\n';
+				bytes += line.length() + 1;
+			}
+		}
+
+		// nothing to copy
+		if (bytes == 0.0)
+			break;
+	}
+
+	return bytes;
+}
+
+int main(int argc, char *argv[])
+{
+	int iterations = 10;
+	int first = 1;
+
+	if (argc > 2 && std::strcmp(argv[1], "-n") == 0) {
+		iterations = std::atoi(argv[2]);
+		first = 3;
+	}
+
+	if (first >= argc || iterations < 1) {
+		std::cerr << "Usage: " << argv[0] << " [-n iterations] [filename...]" << std::endl;
+		return -1;
+	}
+
+	ldraw::color::init();
+
+	ldraw::reader stream_reader, mmap_reader;
+	stream_reader.set_io_method(ldraw::reader::io_stream);
+	mmap_reader.set_io_method(ldraw::reader::io_mmap);
+
+	bool identical = true;
+	double total_bytes = 0.0, total_legacy = 0.0, total_stream = 0.0, total_mmap = 0.0;
+
+	for (int i = first; i < argc; ++i) {
+		std::ifstream file(argv[i], std::ios::in | std::ios::binary);
+		if (!file.is_open()) {
+			std::cerr << "could not read model file: " << argv[i] << std::endl;
+			return -1;
+		}
+		file.seekg(0, std::ios::end);
+		double bytes = (double)file.tellg() * iterations;
+		file.close();
+
+		ldraw::model_multipart *l = legacy::load_from_file(argv[i]);
+		ldraw::model_multipart *a = stream_reader.load_from_file(argv[i]);
+		ldraw::model_multipart *b = mmap_reader.load_from_file(argv[i]);
+		bool same = same_model(l, a) && same_model(a, b);
+		delete l;
+		delete a;
+		delete b;
+
+		double tl = run_legacy(argv[i], iterations);
+		double ts = run(stream_reader, argv[i], iterations);
+		double tm = run(mmap_reader, argv[i], iterations);
+
+		std::cout << argv[i] << ": legacy " << bytes / tl / 1048576.0 << " MB/s, stream " << bytes / ts / 1048576.0
+				  << " MB/s, mmap " << bytes / tm / 1048576.0 << " MB/s, speedup " << tl / tm << "x"
+				  << (same ? "" : " (MISMATCH)") << std::endl;
+
+		identical &= same;
+		total_bytes += bytes;
+		total_legacy += tl;
+		total_stream += ts;
+		total_mmap += tm;
+	}
+
+	std::cout << "total: legacy " << total_bytes / total_legacy / 1048576.0 << " MB/s, stream "
+			  << total_bytes / total_stream / 1048576.0 << " MB/s, mmap " << total_bytes / total_mmap / 1048576.0
+			  << " MB/s, speedup " << total_legacy / total_mmap << "x" << std::endl;
+
+	// the multipart case, in the working directory
+	const char *multipart = "reader_benchmark.mpd";
+	double bytes = make_multipart(multipart, argc, argv, first, 4.0 * 1048576.0);
+	if (bytes > 0.0) {
+		ldraw::model_multipart *l2 = legacy::load_from_file(multipart, true);
+		ldraw::model_multipart *l1 = legacy::load_from_file(multipart, false);
+		ldraw::model_multipart *a = stream_reader.load_from_file(multipart);
+		bool same = same_model(l2, l1) && same_model(l1, a);
+		int submodels = a->submodel_list().size();
+		delete l2;
+		delete l1;
+		delete a;
+
+		double t2 = run_legacy(multipart, iterations, true);
+		double t1 = run_legacy(multipart, iterations, false);
+		double ts = run(stream_reader, multipart, iterations);
+		bytes *= iterations;
+
+		std::cout << "multipart (" << submodels << " submodels): legacy two-pass " << bytes / t2 / 1048576.0
+				  << " MB/s, legacy single pass " << bytes / t1 / 1048576.0 << " MB/s, pre-scan "
+				  << (t2 - t1) / t2 * 100.0 << "% of the load, reader " << bytes / ts / 1048576.0 << " MB/s"
+				  << (same ? "" : " (MISMATCH)") << std::endl;
+
+		identical &= same;
+	}
+	std::remove(multipart);
+
+	return identical ? 0 : 1;
+}